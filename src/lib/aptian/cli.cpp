@@ -20,6 +20,7 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.*/
 
 #include "cli.hpp"
 
+#include <charconv>
 #include <iostream>
 
 #include <clargs/parser.hpp>
@@ -27,6 +28,9 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.*/
 #include <utki/string.hpp>
 
 #include "operations.hpp"
+#include "parallel.hpp"
+#include "server.hpp"
+#include "watcher.hpp"
 
 using namespace aptian;
 
@@ -39,12 +43,137 @@ namespace {
 constexpr std::string_view program_name = "aptian"sv;
 } // namespace
 
+namespace {
+unsigned parse_positive_number(std::string_view str, std::string_view option_name)
+{
+	unsigned ret = 0;
+	auto res = std::from_chars(str.data(), str.data() + str.size(), ret);
+	if (res.ec != std::errc() || res.ptr != str.data() + str.size() || ret == 0) {
+		throw std::invalid_argument(utki::cat("invalid --", option_name, " argument value: ", str));
+	}
+	return ret;
+}
+} // namespace
+
+namespace {
+std::chrono::milliseconds parse_debounce(std::string_view str)
+{
+	unsigned ret = 0;
+	auto res = std::from_chars(str.data(), str.data() + str.size(), ret);
+	if (res.ec != std::errc() || res.ptr != str.data() + str.size()) {
+		throw std::invalid_argument(utki::cat("invalid --debounce argument value: ", str));
+	}
+	return std::chrono::milliseconds(ret);
+}
+} // namespace
+
+namespace {
+// Add options of adding packages to the parser, those are common for the commands which add packages.
+// The 'given' flag, if any, is set in case any of the options is given in command line.
+void add_options_to_parser(clargs::parser& p, add_options& options, bool* given = nullptr)
+{
+	auto set_given = [given]() {
+		if (given) {
+			*given = true;
+		}
+	};
+
+	p.add( //
+		'j',
+		"jobs"s,
+		utki::cat("number of parallel jobs, default is number of CPUs (", options.num_jobs, ")"),
+		[&, set_given](std::string_view v) {
+			options.num_jobs = parse_positive_number(v, "jobs"sv);
+			set_given();
+		}
+	);
+
+	p.add( //
+		"rsyncable"s,
+		"make compressed index files rsync friendly, at the cost of slightly bigger size"s,
+		[&, set_given]() {
+			options.rsyncable = true;
+			set_given();
+		}
+	);
+
+	p.add( //
+		"pool-insertion"s,
+		"method of putting package files to the pool: copy, hardlink or move. "
+		"Overrides the one set for the repository on init"s,
+		[&, set_given](std::string_view v) {
+			options.pool_insertion = to_insertion_method(v);
+			set_given();
+		}
+	);
+}
+} // namespace
+
+namespace {
+// distributions and components to add packages to, as given in command line
+struct target_options {
+	std::vector<std::string> dists;
+	std::vector<std::string> comps;
+};
+
+void add_target_options_to_parser(clargs::parser& p, target_options& opts)
+{
+	p.add( //
+		"dist"s,
+		"name of *nix distribution, e.g. 'bookworm', 'jammy'. "
+		"Can be given several times or as comma separated list to add the packages to several distributions"s,
+		[&](std::string_view v) {
+			for (auto d : utki::split(v, ',')) {
+				opts.dists.push_back(std::move(d));
+			}
+		}
+	);
+
+	p.add( //
+		"comp"s,
+		"name of APT component, e.g. 'main'. "
+		"Can be given several times or as comma separated list to add the packages to several components"s,
+		[&](std::string_view v) {
+			for (auto c : utki::split(v, ',')) {
+				opts.comps.push_back(std::move(c));
+			}
+		}
+	);
+}
+
+// Make targets of all the combinations of the given distributions and components.
+std::vector<add_target> make_targets(const target_options& opts)
+{
+	if (opts.dists.empty()) {
+		throw std::invalid_argument("--dist argument is not given");
+	}
+	if (opts.comps.empty()) {
+		throw std::invalid_argument("--comp argument is not given");
+	}
+
+	std::vector<add_target> targets;
+	for (const auto& d : opts.dists) {
+		if (d.empty()) {
+			throw std::invalid_argument("empty --dist argument value");
+		}
+		for (const auto& c : opts.comps) {
+			if (c.empty()) {
+				throw std::invalid_argument("empty --comp argument value");
+			}
+			targets.push_back({.dist = d, .comp = c});
+		}
+	}
+	return targets;
+}
+} // namespace
+
 namespace {
 void handle_init_command(utki::span<std::string_view> args)
 {
 	bool help = false;
 	std::string dir;
 	std::string gpg;
+	repository_settings settings;
 
 	clargs::parser p;
 
@@ -75,6 +204,51 @@ void handle_init_command(utki::span<std::string_view> args)
 		}
 	);
 
+	p.add( //
+		"compression"s,
+		"comma separated list of compression formats of index files, supported formats: gz, xz, zst. Default is gz"s,
+		[&](std::string_view v) {
+			for (auto f : utki::split(v, ',')) {
+				settings.compression_formats.push_back(to_compression_format(f));
+			}
+		}
+	);
+
+	p.add( //
+		"pool-insertion"s,
+		"method of putting package files to the pool: copy, hardlink or move. Default is copy"s,
+		[&](std::string_view v) {
+			settings.pool_insertion = to_insertion_method(v);
+		}
+	);
+
+	p.add( //
+		"acquire-by-hash"s,
+		"also store index files under their digests in by-hash directories and keep the given number "
+		"of index file generations there, so that clients and caches never see mismatching index files. "
+		"Recommended value is 3 or more"s,
+		[&](std::string_view v) {
+			settings.by_hash_retention = parse_positive_number(v, "acquire-by-hash"sv);
+		}
+	);
+
+	p.add( //
+		"pdiff"s,
+		"also generate Packages.diff patches, so that clients update their package lists by downloading "
+		"only the changes, and keep the given number of patches"s,
+		[&](std::string_view v) {
+			settings.pdiff_history_size = parse_positive_number(v, "pdiff"sv);
+		}
+	);
+
+	p.add( //
+		"contents"s,
+		"also generate Contents-<arch> indices of the components, those are used by e.g. apt-file"s,
+		[&]() {
+			settings.contents = true;
+		}
+	);
+
 	p.parse(args);
 
 	if (help) {
@@ -87,7 +261,8 @@ void handle_init_command(utki::span<std::string_view> args)
 		std::cout << p.description();
 		std::cout << '\n';
 		std::cout << "Example:" << '\n';
-		std::cout << "  " << program_name << " init --dir=/var/www/repo/ --gpg=mailbox@somemail.com" << '\n';
+		std::cout << "  " << program_name << " init --dir=/var/www/repo/ --gpg=mailbox@somemail.com --compression=gz,xz"
+				  << '\n';
 		std::cout << std::endl;
 		return;
 	}
@@ -99,7 +274,7 @@ void handle_init_command(utki::span<std::string_view> args)
 		throw std::invalid_argument("--gpg argument is not given");
 	}
 
-	init(fsif::as_dir(dir), gpg);
+	init(fsif::as_dir(dir), gpg, settings);
 }
 } // namespace
 
@@ -108,8 +283,10 @@ void handle_add_command(utki::span<std::string_view> args)
 {
 	bool help = false;
 	std::string dir;
-	std::string dist;
-	std::string comp;
+	target_options target_opts;
+	add_options options{.num_jobs = get_default_num_jobs()};
+	bool add_options_given = false;
+	std::string socket_path;
 
 	clargs::parser p;
 
@@ -131,19 +308,16 @@ void handle_add_command(utki::span<std::string_view> args)
 		}
 	);
 
-	p.add( //
-		"dist"s,
-		"name of *nix distribution, e.g. 'bookworm', 'jammy'"s,
-		[&](std::string_view v) {
-			dist = v;
-		}
-	);
+	add_target_options_to_parser(p, target_opts);
+
+	add_options_to_parser(p, options, &add_options_given);
 
 	p.add( //
-		"comp"s,
-		"name of APT component, e.g. 'main'"s,
+		"socket"s,
+		"send the request to 'aptian serve' listening on the given socket instead of adding the packages directly, "
+		"--dir is ignored in that case and the options of adding packages are the ones given to the server"s,
 		[&](std::string_view v) {
-			comp = v;
+			socket_path = v;
 		}
 	);
 
@@ -164,29 +338,220 @@ void handle_add_command(utki::span<std::string_view> args)
 		std::cout << "Example:" << '\n';
 		std::cout << "  " << program_name
 				  << " add --dir=/var/www/repo/ --dist=bookworm --comp=main my-package_1.0.0_amd64.deb" << '\n';
+		std::cout << '\n';
+		std::cout << "The packages are added to each of the given distribution and component combinations:" << '\n';
+		std::cout << "  " << program_name
+				  << " add --dir=/var/www/repo/ --dist=bookworm,noble --comp=main my-package_1.0.0_all.deb" << '\n';
 		std::cout << std::endl;
 		return;
 	}
 
-	if (dir.empty()) {
+	if (dir.empty() && socket_path.empty()) {
 		throw std::invalid_argument("--dir argument is not given");
 	}
-	if (dist.empty()) {
-		throw std::invalid_argument("--dist argument is not given");
-	}
-	if (comp.empty()) {
-		throw std::invalid_argument("--comp argument is not given");
-	}
+
+	auto targets = make_targets(target_opts);
+
 	if (packages.empty()) {
 		throw std::invalid_argument("no package files given");
 	}
 
+	if (!socket_path.empty()) {
+		if (add_options_given) {
+			throw std::invalid_argument(
+				"--jobs, --rsyncable and --pool-insertion cannot be given with --socket, "
+				"the server uses the options it was started with"
+			);
+		}
+		send_add_request(socket_path, {.targets = std::move(targets), .package_paths = std::move(packages)});
+		std::cout << "done" << std::endl;
+		return;
+	}
+
 	add( //
 		fsif::as_dir(dir),
-		dist,
-		comp,
-		packages
+		targets,
+		packages,
+		options
+	);
+}
+} // namespace
+
+namespace {
+void handle_serve_command(utki::span<std::string_view> args)
+{
+	bool help = false;
+	std::string dir;
+	add_options options{.num_jobs = get_default_num_jobs()};
+	serve_options serve_opts;
+
+	clargs::parser p;
+
+	p.add( //
+		"help"s,
+		"show 'serve' command help information"s,
+		[&]() {
+			help = true;
+			p.stop();
+		}
+	);
+
+	p.add( //
+		'd',
+		"dir"s,
+		"path to base directory of APT repository"s,
+		[&](std::string_view v) {
+			dir = v;
+		}
+	);
+
+	p.add( //
+		"socket"s,
+		"path of Unix domain socket to listen on"s,
+		[&](std::string_view v) {
+			serve_opts.socket_path = v;
+		}
+	);
+
+	p.add( //
+		"debounce"s,
+		utki::cat(
+			"time in milliseconds to collect requests after the first queued one before publishing them as one batch, "
+			"default is ",
+			serve_opts.debounce.count()
+		),
+		[&](std::string_view v) {
+			serve_opts.debounce = parse_debounce(v);
+		}
+	);
+
+	add_options_to_parser(p, options);
+
+	p.parse(args);
+
+	if (help) {
+		std::cout << "serve requests to add packages to APT repository" << '\n';
+		std::cout << '\n';
+		std::cout << "Requests are sent with 'add --socket=<socket>' command. Requests received close in time" << '\n';
+		std::cout << "are published together, the Release file is signed once per batch. The client gets" << '\n';
+		std::cout << "its response after the packages are published. The socket is accessible only to its" << '\n';
+		std::cout << "owner and only the clients running as the same user as the server are served." << '\n';
+		std::cout << '\n';
+		std::cout << "Usage:" << '\n';
+		std::cout << "  " << program_name << " serve --dir=<repo-base-dir> --socket=<socket>" << '\n';
+		std::cout << '\n';
+		std::cout << "Options:" << '\n';
+		std::cout << p.description();
+		std::cout << '\n';
+		std::cout << "Example:" << '\n';
+		std::cout << "  " << program_name << " serve --dir=/var/www/repo/ --socket=/run/aptian/aptian.sock" << '\n';
+		std::cout << "  " << program_name
+				  << " add --socket=/run/aptian/aptian.sock --dist=bookworm --comp=main my-package_1.0.0_amd64.deb"
+				  << '\n';
+		std::cout << std::endl;
+		return;
+	}
+
+	if (dir.empty()) {
+		throw std::invalid_argument("--dir argument is not given");
+	}
+	if (serve_opts.socket_path.empty()) {
+		throw std::invalid_argument("--socket argument is not given");
+	}
+
+	serve(fsif::as_dir(dir), options, serve_opts);
+}
+} // namespace
+
+namespace {
+void handle_watch_command(utki::span<std::string_view> args)
+{
+	bool help = false;
+	std::string dir;
+	target_options target_opts;
+	add_options options{.num_jobs = get_default_num_jobs()};
+	watch_options watch_opts;
+
+	clargs::parser p;
+
+	p.add( //
+		"help"s,
+		"show 'watch' command help information"s,
+		[&]() {
+			help = true;
+			p.stop();
+		}
+	);
+
+	p.add( //
+		'd',
+		"dir"s,
+		"path to base directory of APT repository"s,
+		[&](std::string_view v) {
+			dir = v;
+		}
+	);
+
+	p.add( //
+		"incoming"s,
+		"path to directory to watch for new package files"s,
+		[&](std::string_view v) {
+			watch_opts.incoming_dir = v;
+		}
+	);
+
+	add_target_options_to_parser(p, target_opts);
+
+	p.add( //
+		"debounce"s,
+		utki::cat(
+			"time in milliseconds to collect package files after the first detected one before adding them as one batch, "
+			"default is ",
+			watch_opts.debounce.count()
+		),
+		[&](std::string_view v) {
+			watch_opts.debounce = parse_debounce(v);
+		}
 	);
+
+	add_options_to_parser(p, options);
+
+	p.parse(args);
+
+	if (help) {
+		std::cout << "watch incoming directory and add package files appearing there to APT repository" << '\n';
+		std::cout << '\n';
+		std::cout << "Package files are picked up when closed after writing or moved into the directory." << '\n';
+		std::cout << "Uploaders must write the files under a temporary name without .deb suffix and rename" << '\n';
+		std::cout << "those when done, so that incompletely uploaded files are not picked up." << '\n';
+		std::cout << "The added files are removed from the incoming directory, the ones which could not be" << '\n';
+		std::cout << "added are moved to its 'failed' subdirectory." << '\n';
+		std::cout << '\n';
+		std::cout << "Usage:" << '\n';
+		std::cout << "  " << program_name
+				  << " watch --dir=<repo-base-dir> --incoming=<incoming-dir> --dist=<distribution> --comp=<component>"
+				  << '\n';
+		std::cout << '\n';
+		std::cout << "Options:" << '\n';
+		std::cout << p.description();
+		std::cout << '\n';
+		std::cout << "Example:" << '\n';
+		std::cout << "  " << program_name
+				  << " watch --dir=/var/www/repo/ --incoming=/srv/incoming/ --dist=bookworm --comp=main" << '\n';
+		std::cout << std::endl;
+		return;
+	}
+
+	if (dir.empty()) {
+		throw std::invalid_argument("--dir argument is not given");
+	}
+	if (watch_opts.incoming_dir.empty()) {
+		throw std::invalid_argument("--incoming argument is not given");
+	}
+
+	watch_opts.targets = make_targets(target_opts);
+
+	watch(fsif::as_dir(dir), options, watch_opts);
 }
 } // namespace
 
@@ -197,6 +562,10 @@ void handle_command(std::string_view command, utki::span<std::string_view> args)
 		handle_init_command(args);
 	} else if (command == "add") {
 		handle_add_command(args);
+	} else if (command == "serve") {
+		handle_serve_command(args);
+	} else if (command == "watch") {
+		handle_watch_command(args);
 	} else {
 		std::stringstream ss;
 		ss << "invalid commad given: " << command;
@@ -212,6 +581,8 @@ void print_commands_list()
 	std::cout << "Commands:" << "\n";
 	std::cout << "  init  initialize APT repository directory structure" << "\n";
 	std::cout << "  add   add debian packages to an APT repository" << "\n";
+	std::cout << "  serve serve requests to add debian packages to an APT repository" << "\n";
+	std::cout << "  watch add debian packages appearing in incoming directory to an APT repository" << "\n";
 }
 
 void print_help(std::string_view args_description)
@@ -0,0 +1,527 @@
+/*
+aptian - apt repository tool
+
+Copyright (C) 2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.*/
+
+/* ================ LICENSE END ================ */
+
+#include "compressor.hpp"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+#include <lzma.h>
+#include <utki/debug.hpp>
+#include <utki/string.hpp>
+#include <zlib.h>
+#include <zstd.h>
+
+#include "parallel.hpp"
+
+using namespace std::string_view_literals;
+
+using namespace aptian;
+
+namespace {
+// amount of output buffer space to add on each compression step
+constexpr size_t out_chunk_size = 0x10000;
+
+// Extend the buffer by a chunk and return the span of the added part.
+utki::span<uint8_t> grow(std::vector<uint8_t>& out)
+{
+	auto old_size = out.size();
+	out.resize(old_size + out_chunk_size);
+	return utki::make_span(out).subspan(old_size);
+}
+} // namespace
+
+namespace {
+// same as pigz uses
+constexpr size_t gzip_block_size = 0x20000;
+
+// deflate window size
+constexpr size_t gzip_dictionary_size = 0x8000;
+
+// The rsync reset point is where the sum of the last rsync_window_size bytes is divisible by rsync_window_size,
+// so the reset points occur once per rsync_window_size bytes on average. Same as 'gzip --rsyncable' does.
+constexpr size_t rsync_window_size = 0x1000;
+} // namespace
+
+namespace {
+struct gzip_block {
+	utki::span<const uint8_t> data;
+	utki::span<const uint8_t> dictionary;
+
+	// offsets within the block data where the compressor state has to be reset
+	std::vector<size_t> reset_points;
+
+	bool last;
+
+	std::vector<uint8_t> compressed;
+	uint32_t crc;
+};
+
+class deflate_stream
+{
+	z_stream stream{};
+
+public:
+	deflate_stream(int level)
+	{
+		// negative window bits means raw deflate data without zlib header
+		if (deflateInit2(&this->stream, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) { // NOLINT
+			throw std::runtime_error("gzip_compressor: deflateInit2() failed");
+		}
+	}
+
+	deflate_stream(const deflate_stream&) = delete;
+	deflate_stream& operator=(const deflate_stream&) = delete;
+
+	deflate_stream(deflate_stream&&) = delete;
+	deflate_stream& operator=(deflate_stream&&) = delete;
+
+	~deflate_stream()
+	{
+		deflateEnd(&this->stream);
+	}
+
+	void set_dictionary(utki::span<const uint8_t> dictionary)
+	{
+		if (deflateSetDictionary(&this->stream, dictionary.data(), uInt(dictionary.size())) != Z_OK) {
+			throw std::runtime_error("gzip_compressor: deflateSetDictionary() failed");
+		}
+	}
+
+	// Compress data and append the compressed data to the output buffer.
+	// The flush is one of Z_SYNC_FLUSH, Z_FULL_FLUSH or Z_FINISH.
+	void compress(utki::span<const uint8_t> in, int flush, std::vector<uint8_t>& out)
+	{
+		// NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast, "zlib API is not const correct")
+		this->stream.next_in = const_cast<uint8_t*>(in.data());
+		this->stream.avail_in = uInt(in.size());
+
+		for (;;) {
+			auto buf = grow(out);
+			this->stream.next_out = buf.data();
+			this->stream.avail_out = uInt(buf.size());
+
+			auto res = deflate(&this->stream, flush);
+
+			// drop unused part of the output buffer
+			out.erase(std::prev(out.end(), this->stream.avail_out), out.end());
+
+			if (res == Z_STREAM_END) {
+				break;
+			}
+			if (res != Z_OK && res != Z_BUF_ERROR) {
+				throw std::runtime_error(utki::cat("gzip_compressor: deflate() failed, error = ", res));
+			}
+			if (flush != Z_FINISH && this->stream.avail_out != 0) {
+				// all input consumed and flushed
+				break;
+			}
+		}
+
+		ASSERT(this->stream.avail_in == 0)
+	}
+};
+
+void compress_block(gzip_block& block, int level)
+{
+	deflate_stream stream(level);
+
+	if (!block.dictionary.empty()) {
+		stream.set_dictionary(block.dictionary);
+	}
+
+	size_t pos = 0;
+	for (auto p : block.reset_points) {
+		stream.compress(block.data.subspan(pos, p - pos), Z_FULL_FLUSH, block.compressed);
+		pos = p;
+	}
+
+	// Sync flush ends the compressed block on a byte boundary, so that
+	// the next independently compressed block can be appended right after it.
+	stream.compress(block.data.subspan(pos), block.last ? Z_FINISH : Z_SYNC_FLUSH, block.compressed);
+
+	block.crc = crc32_z(crc32_z(0, nullptr, 0), block.data.data(), block.data.size());
+}
+} // namespace
+
+gzip_compressor::gzip_compressor(sink& output, const parameters& params) :
+	output(output),
+	params(params),
+	crc(crc32_z(0, nullptr, 0))
+{}
+
+void gzip_compressor::find_rsync_points(size_t begin)
+{
+	// the buffer always holds enough of already compressed data to cover the rsync window
+	ASSERT(this->buffer_offset == 0 || begin >= rsync_window_size)
+
+	auto sum = this->rsync_sum;
+	for (size_t i = begin; i != this->buffer.size(); ++i) {
+		sum += this->buffer[i];
+
+		auto offset = this->buffer_offset + i;
+		if (offset < rsync_window_size) {
+			continue;
+		}
+		sum -= this->buffer[i - rsync_window_size];
+
+		if (sum % rsync_window_size == 0) {
+			this->rsync_points.push_back(offset + 1);
+		}
+	}
+	this->rsync_sum = sum;
+}
+
+void gzip_compressor::write(utki::span<const uint8_t> data)
+{
+	auto old_size = this->buffer.size();
+
+	this->buffer.insert(this->buffer.end(), data.begin(), data.end());
+
+	if (this->params.rsyncable) {
+		this->find_rsync_points(old_size);
+	}
+
+	if (this->buffer.size() - this->history_size >= gzip_block_size * std::max(this->params.num_jobs, 1u)) {
+		this->compress_buffered(false);
+	}
+}
+
+void gzip_compressor::compress_buffered(bool last)
+{
+	auto data = utki::make_span(this->buffer);
+
+	auto to_offset = [&](size_t pos) {
+		return this->buffer_offset + pos;
+	};
+
+	auto rsync_point = this->rsync_points.begin();
+
+	auto make_block = [](utki::span<const uint8_t> dictionary) {
+		return gzip_block{
+			.data = {},
+			.dictionary = dictionary,
+			.reset_points = {},
+			.last = false,
+			.compressed = {},
+			.crc = 0
+		};
+	};
+
+	// split the data into blocks
+	std::vector<gzip_block> blocks;
+	size_t pos = this->history_size;
+	while (pos != data.size()) {
+		auto end = pos + gzip_block_size;
+		if (end > data.size()) {
+			if (!last) {
+				// leave incomplete block for the next time
+				break;
+			}
+			end = data.size();
+		}
+
+		auto offset = to_offset(pos);
+
+		while (rsync_point != this->rsync_points.end() && *rsync_point < offset) {
+			++rsync_point;
+		}
+		bool at_rsync_point = rsync_point != this->rsync_points.end() && *rsync_point == offset;
+		if (at_rsync_point) {
+			++rsync_point;
+		}
+
+		// the block which starts at rsync point does not use dictionary, this resets the compressor state
+		auto dictionary_size = offset == 0 || at_rsync_point ? 0 : std::min(pos, gzip_dictionary_size);
+		auto block = make_block(data.subspan(pos - dictionary_size, dictionary_size));
+
+		for (; rsync_point != this->rsync_points.end() && *rsync_point <= to_offset(end); ++rsync_point) {
+			block.reset_points.push_back(size_t(*rsync_point - offset));
+		}
+
+		// end the block at the last rsync point within it, so that the next block starts with reset state
+		if (!block.reset_points.empty()) {
+			end = pos + block.reset_points.back();
+			block.reset_points.pop_back();
+			--rsync_point;
+		}
+
+		block.data = data.subspan(pos, end - pos);
+		blocks.push_back(std::move(block));
+		pos = end;
+	}
+
+	if (last) {
+		if (blocks.empty()) {
+			blocks.push_back(make_block({}));
+		}
+		blocks.back().last = true;
+	}
+
+	parallel_for(blocks.size(), this->params.num_jobs, [&](size_t i) {
+		compress_block(blocks[i], this->params.level);
+	});
+
+	if (!this->header_written) {
+		// no file name, no modification time, OS is unix
+		constexpr std::array<uint8_t, 10> header = {0x1f, 0x8b, Z_DEFLATED, 0, 0, 0, 0, 0, 0, 3};
+		this->output.write(header);
+		this->header_written = true;
+	}
+
+	for (const auto& b : blocks) {
+		this->output.write(b.compressed);
+		this->crc = uint32_t(crc32_combine(this->crc, b.crc, z_off_t(b.data.size())));
+	}
+
+	// drop compressed data, except the part needed as dictionary for the next block
+	auto keep = std::min(pos, gzip_dictionary_size);
+	this->rsync_points.erase(
+		this->rsync_points.begin(),
+		std::lower_bound(this->rsync_points.begin(), this->rsync_points.end(), to_offset(pos))
+	);
+	this->buffer.erase(this->buffer.begin(), this->buffer.begin() + ptrdiff_t(pos - keep));
+	this->buffer_offset += pos - keep;
+	this->history_size = keep;
+}
+
+void gzip_compressor::finish()
+{
+	this->compress_buffered(true);
+
+	auto size = this->buffer_offset + this->buffer.size();
+
+	std::array<uint8_t, 8> trailer{};
+	for (unsigned i = 0; i != 4; ++i) {
+		trailer[i] = uint8_t(this->crc >> (i * 8));
+		trailer[i + 4] = uint8_t(size >> (i * 8));
+	}
+	this->output.write(trailer);
+
+	this->output.finish();
+}
+
+namespace {
+// Size of independently compressed blocks. The xz default is 3 times the dictionary size,
+// which is 24 MiB for preset 6, it is too big to get any parallelism for typical index file sizes.
+constexpr uint64_t xz_block_size = 0x200000;
+
+// same as xz command line tool uses by default
+constexpr uint32_t xz_preset = 6;
+
+class xz_compressor : public sink
+{
+	sink& output;
+
+	lzma_stream stream = LZMA_STREAM_INIT;
+
+	std::vector<uint8_t> out_buffer = std::vector<uint8_t>(out_chunk_size);
+
+	// returns true when the stream end is reached
+	bool code(lzma_action action)
+	{
+		this->stream.next_out = this->out_buffer.data();
+		this->stream.avail_out = this->out_buffer.size();
+
+		auto ret = lzma_code(&this->stream, action);
+
+		this->output.write(utki::make_span(this->out_buffer).subspan(0, this->out_buffer.size() - this->stream.avail_out));
+
+		if (ret == LZMA_STREAM_END) {
+			return true;
+		}
+		if (ret != LZMA_OK) {
+			throw std::runtime_error(utki::cat("xz_compressor: lzma_code() failed, error = ", ret));
+		}
+		return false;
+	}
+
+public:
+	xz_compressor(sink& output, unsigned num_jobs) :
+		output(output)
+	{
+		// Multi-threaded encoder is used even for one job, because its output
+		// is different from the single-threaded encoder output.
+		lzma_mt mt{};
+		mt.threads = std::max(num_jobs, 1u);
+		mt.block_size = xz_block_size;
+		mt.preset = xz_preset;
+		mt.check = LZMA_CHECK_CRC64;
+
+		if (lzma_stream_encoder_mt(&this->stream, &mt) != LZMA_OK) {
+			throw std::runtime_error("xz_compressor: lzma_stream_encoder_mt() failed");
+		}
+	}
+
+	xz_compressor(const xz_compressor&) = delete;
+	xz_compressor& operator=(const xz_compressor&) = delete;
+
+	xz_compressor(xz_compressor&&) = delete;
+	xz_compressor& operator=(xz_compressor&&) = delete;
+
+	~xz_compressor() override
+	{
+		lzma_end(&this->stream);
+	}
+
+	void write(utki::span<const uint8_t> data) override
+	{
+		this->stream.next_in = data.data();
+		this->stream.avail_in = data.size();
+
+		while (this->stream.avail_in != 0) {
+			this->code(LZMA_RUN);
+		}
+	}
+
+	void finish() override
+	{
+		while (!this->code(LZMA_FINISH)) {
+		}
+		this->output.finish();
+	}
+};
+} // namespace
+
+namespace {
+// same as zstd command line tool uses by default
+constexpr int zstd_level = ZSTD_CLEVEL_DEFAULT;
+
+class zstd_compressor : public sink
+{
+	sink& output;
+
+	ZSTD_CCtx* context;
+
+	std::vector<uint8_t> out_buffer = std::vector<uint8_t>(out_chunk_size);
+
+	// returns number of bytes which remain to be flushed
+	size_t compress(ZSTD_inBuffer& in, ZSTD_EndDirective mode)
+	{
+		ZSTD_outBuffer out = {.dst = this->out_buffer.data(), .size = this->out_buffer.size(), .pos = 0};
+
+		auto ret = ZSTD_compressStream2(this->context, &out, &in, mode);
+		if (ZSTD_isError(ret)) {
+			throw std::runtime_error(utki::cat("zstd_compressor: ZSTD_compressStream2() failed: ", ZSTD_getErrorName(ret)));
+		}
+
+		this->output.write(utki::make_span(this->out_buffer).subspan(0, out.pos));
+
+		return ret;
+	}
+
+public:
+	zstd_compressor(sink& output, unsigned num_jobs) :
+		output(output),
+		context(ZSTD_createCCtx())
+	{
+		if (!this->context) {
+			throw std::runtime_error("zstd_compressor: ZSTD_createCCtx() failed");
+		}
+
+		ZSTD_CCtx_setParameter(this->context, ZSTD_c_compressionLevel, zstd_level);
+		ZSTD_CCtx_setParameter(this->context, ZSTD_c_checksumFlag, 1);
+
+		// With one or more workers the output does not depend on the number of workers.
+		// In case libzstd is built without multi-threading support setting the parameter fails,
+		// then the compression is done in the calling thread.
+		ZSTD_CCtx_setParameter(this->context, ZSTD_c_nbWorkers, int(std::max(num_jobs, 1u)));
+	}
+
+	zstd_compressor(const zstd_compressor&) = delete;
+	zstd_compressor& operator=(const zstd_compressor&) = delete;
+
+	zstd_compressor(zstd_compressor&&) = delete;
+	zstd_compressor& operator=(zstd_compressor&&) = delete;
+
+	~zstd_compressor() override
+	{
+		ZSTD_freeCCtx(this->context);
+	}
+
+	void write(utki::span<const uint8_t> data) override
+	{
+		ZSTD_inBuffer in = {.src = data.data(), .size = data.size(), .pos = 0};
+		while (in.pos != in.size) {
+			this->compress(in, ZSTD_e_continue);
+		}
+	}
+
+	void finish() override
+	{
+		ZSTD_inBuffer in = {.src = nullptr, .size = 0, .pos = 0};
+		while (this->compress(in, ZSTD_e_end) != 0) {
+		}
+		this->output.finish();
+	}
+};
+} // namespace
+
+std::string_view aptian::to_suffix(compression_format format)
+{
+	switch (format) {
+		case compression_format::gzip:
+			return ".gz"sv;
+		case compression_format::xz:
+			return ".xz"sv;
+		case compression_format::zstd:
+			return ".zst"sv;
+		case compression_format::enum_size:
+			break;
+	}
+	throw std::invalid_argument("to_suffix(): unknown compression format");
+}
+
+compression_format aptian::to_compression_format(std::string_view name)
+{
+	for (size_t i = 0; i != size_t(compression_format::enum_size); ++i) {
+		auto format = compression_format(i);
+		if (to_suffix(format).substr(1) == name) {
+			return format;
+		}
+	}
+	throw std::invalid_argument(utki::cat("unknown compression format: ", name));
+}
+
+std::unique_ptr<sink> aptian::make_compressor(
+	compression_format format,
+	sink& output,
+	const compressor_parameters& params
+)
+{
+	switch (format) {
+		case compression_format::gzip:
+			return std::make_unique<gzip_compressor>(
+				output,
+				gzip_compressor::parameters{
+					.num_jobs = params.num_jobs, //
+					.rsyncable = params.rsyncable
+				}
+			);
+		case compression_format::xz:
+			return std::make_unique<xz_compressor>(output, params.num_jobs);
+		case compression_format::zstd:
+			return std::make_unique<zstd_compressor>(output, params.num_jobs);
+		case compression_format::enum_size:
+			break;
+	}
+	throw std::invalid_argument("make_compressor(): unknown compression format");
+}
@@ -0,0 +1,145 @@
+/*
+aptian - apt repository tool
+
+Copyright (C) 2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.*/
+
+/* ================ LICENSE END ================ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "sink.hpp"
+
+namespace aptian {
+
+/**
+ * @brief Compressing sinks.
+ * Compressing sink compresses the data written to it and writes the compressed
+ * data to the output sink. Calling finish() on compressing sink also finishes the output sink.
+ */
+
+/**
+ * @brief gzip compressor.
+ * The data is split into blocks which are compressed independently, possibly in parallel,
+ * and the compressed blocks are concatenated into a single gzip stream (the same way as pigz does).
+ * To keep the compression ratio each block uses the end of the previous block's data as
+ * the compression dictionary.
+ * The compressed output does not depend on the number of parallel jobs.
+ */
+class gzip_compressor : public sink
+{
+public:
+	struct parameters {
+		// compression level, from 1 (fastest) to 9 (best compression)
+		int level = 6; // NOLINT(cppcoreguidelines-avoid-magic-numbers, readability-magic-numbers)
+
+		// number of blocks to compress in parallel
+		unsigned num_jobs = 1;
+
+		// Make compressed output rsync friendly, like 'gzip --rsyncable' does.
+		// The compressor state is reset at the points determined by the input data contents,
+		// so that a local change in the input data only causes a local change in the compressed output.
+		bool rsyncable = false;
+	};
+
+private:
+	sink& output;
+
+	const parameters params;
+
+	// Data which is not compressed yet, preceded by up to window size of already compressed data
+	// which is kept to be used as compression dictionary.
+	std::vector<uint8_t> buffer;
+
+	// number of already compressed bytes at the beginning of the buffer
+	size_t history_size = 0;
+
+	// offset of the buffer beginning within the whole uncompressed data
+	uint64_t buffer_offset = 0;
+
+	// offsets of rsync reset points within the whole uncompressed data
+	std::vector<uint64_t> rsync_points;
+	// sum of the bytes within the rsync window
+	size_t rsync_sum = 0;
+
+	uint32_t crc;
+
+	bool header_written = false;
+
+	void find_rsync_points(size_t begin);
+
+	void compress_buffered(bool last);
+
+public:
+	gzip_compressor(sink& output, const parameters& params);
+
+	void write(utki::span<const uint8_t> data) override;
+
+	void finish() override;
+};
+
+enum class compression_format {
+	gzip,
+	xz,
+	zstd,
+
+	enum_size
+};
+
+/**
+ * @brief Get file name suffix of the compression format.
+ * @param format - compression format.
+ * @return File name suffix, e.g. ".gz".
+ */
+std::string_view to_suffix(compression_format format);
+
+/**
+ * @brief Parse compression format name.
+ * The name is the file name suffix without the dot, i.e. one of 'gz', 'xz' or 'zst'.
+ * @param name - compression format name.
+ * @return Compression format.
+ * @throw std::invalid_argument - in case of unknown compression format name.
+ */
+compression_format to_compression_format(std::string_view name);
+
+struct compressor_parameters {
+	// number of parallel jobs to use for compression
+	unsigned num_jobs = 1;
+
+	// make compressed output rsync friendly, only supported by gzip, ignored by other formats
+	bool rsyncable = false;
+};
+
+/**
+ * @brief Create compressing sink.
+ * The xz and zstd compressors use the multi-threaded encoders of liblzma and libzstd.
+ * The compressed output does not depend on the number of jobs.
+ * @param format - compression format.
+ * @param output - sink to write compressed data to.
+ * @param params - compressor parameters.
+ * @return Compressing sink.
+ */
+std::unique_ptr<sink> make_compressor(
+	compression_format format,
+	sink& output,
+	const compressor_parameters& params
+);
+
+} // namespace aptian
@@ -20,6 +20,9 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.*/
 
 #include "configuration.hpp"
 
+#include <algorithm>
+#include <charconv>
+
 #include <fsif/native_file.hpp>
 #include <tml/crawler.hpp>
 
@@ -30,6 +33,12 @@ using namespace aptian;
 
 namespace {
 constexpr std::string_view config_filename = "aptian.conf"sv;
+constexpr std::string_view gpg_key = "gpg"sv;
+constexpr std::string_view compression_key = "compression"sv;
+constexpr std::string_view pool_insertion_key = "pool_insertion"sv;
+constexpr std::string_view by_hash_key = "acquire_by_hash"sv;
+constexpr std::string_view pdiff_key = "pdiff"sv;
+constexpr std::string_view contents_key = "contents"sv;
 } // namespace
 
 configuration::configuration(std::string_view base_repo_dir) :
@@ -42,9 +51,33 @@ configuration::configuration(std::string_view base_repo_dir) :
 	}())
 {}
 
-void configuration::create(std::string_view dir, std::string_view gpg)
+void configuration::create(std::string_view dir, std::string_view gpg, const repository_settings& settings)
 {
-	tml::forest cfg = {tml::tree("gpg"s, {tml::tree(gpg)})};
+	tml::forest cfg = {tml::tree(gpg_key, {tml::tree(gpg)})};
+
+	if (!settings.compression_formats.empty()) {
+		tml::forest formats;
+		for (auto f : settings.compression_formats) {
+			formats.emplace_back(to_suffix(f).substr(1));
+		}
+		cfg.emplace_back(compression_key, std::move(formats));
+	}
+
+	if (settings.pool_insertion != insertion_method::copy) {
+		cfg.emplace_back(pool_insertion_key, tml::forest{tml::tree(to_string(settings.pool_insertion))});
+	}
+
+	if (settings.by_hash_retention != 0) {
+		cfg.emplace_back(by_hash_key, tml::forest{tml::tree(utki::cat(settings.by_hash_retention))});
+	}
+
+	if (settings.pdiff_history_size != 0) {
+		cfg.emplace_back(pdiff_key, tml::forest{tml::tree(utki::cat(settings.pdiff_history_size))});
+	}
+
+	if (settings.contents) {
+		cfg.emplace_back(contents_key);
+	}
 
 	fsif::native_file cfg_file(utki::cat(dir, config_filename));
 
@@ -55,5 +88,98 @@ void configuration::create(std::string_view dir, std::string_view gpg)
 
 std::string_view configuration::get_gpg()
 {
-	return tml::crawler(this->conf).to("gpg").in().get().value.string;
+	return tml::crawler(this->conf).to(gpg_key).in().get().value.string;
+}
+
+std::vector<compression_format> configuration::get_compression_formats()
+{
+	// TODO: use std::ranges::find_if() when ubuntu focal support can be dropped
+	// NOLINTNEXTLINE(modernize-use-ranges, "ranges not supported in gcc from ubuntu focal")
+	auto i = std::find_if(this->conf.begin(), this->conf.end(), [](const auto& t) {
+		return t.value.string == compression_key;
+	});
+	if (i == this->conf.end()) {
+		return {compression_format::gzip};
+	}
+
+	std::vector<compression_format> ret;
+	for (const auto& f : i->children) {
+		auto format = to_compression_format(f.value.string);
+		// TODO: use std::ranges::find() when ubuntu focal support can be dropped
+		// NOLINTNEXTLINE(modernize-use-ranges, "ranges not supported in gcc from ubuntu focal")
+		if (std::find(ret.begin(), ret.end(), format) == ret.end()) {
+			ret.push_back(format);
+		}
+	}
+
+	if (ret.empty()) {
+		throw std::invalid_argument(utki::cat("no compression formats given in ", config_filename));
+	}
+
+	return ret;
+}
+
+insertion_method configuration::get_pool_insertion_method()
+{
+	// TODO: use std::ranges::find_if() when ubuntu focal support can be dropped
+	// NOLINTNEXTLINE(modernize-use-ranges, "ranges not supported in gcc from ubuntu focal")
+	auto i = std::find_if(this->conf.begin(), this->conf.end(), [](const auto& t) {
+		return t.value.string == pool_insertion_key;
+	});
+	if (i == this->conf.end()) {
+		return insertion_method::copy;
+	}
+
+	if (i->children.size() != 1) {
+		throw std::invalid_argument(utki::cat("exactly one value expected for ", pool_insertion_key, " in ", config_filename));
+	}
+
+	return to_insertion_method(i->children.front().value.string);
+}
+
+namespace {
+unsigned get_unsigned(const tml::forest& conf, std::string_view key)
+{
+	// TODO: use std::ranges::find_if() when ubuntu focal support can be dropped
+	// NOLINTNEXTLINE(modernize-use-ranges, "ranges not supported in gcc from ubuntu focal")
+	auto i = std::find_if(conf.begin(), conf.end(), [&](const auto& t) {
+		return t.value.string == key;
+	});
+	if (i == conf.end()) {
+		return 0;
+	}
+
+	if (i->children.size() != 1) {
+		throw std::invalid_argument(utki::cat("exactly one value expected for ", key, " in ", config_filename));
+	}
+
+	const auto& str = i->children.front().value.string;
+
+	unsigned ret = 0;
+	auto res = std::from_chars(str.data(), str.data() + str.size(), ret);
+	if (res.ec != std::errc() || res.ptr != str.data() + str.size()) {
+		throw std::invalid_argument(utki::cat("invalid ", key, " value in ", config_filename, ": ", str));
+	}
+
+	return ret;
+}
+} // namespace
+
+unsigned configuration::get_by_hash_retention()
+{
+	return get_unsigned(this->conf, by_hash_key);
+}
+
+unsigned configuration::get_pdiff_history_size()
+{
+	return get_unsigned(this->conf, pdiff_key);
+}
+
+bool configuration::get_contents()
+{
+	// TODO: use std::ranges::find_if() when ubuntu focal support can be dropped
+	// NOLINTNEXTLINE(modernize-use-ranges, "ranges not supported in gcc from ubuntu focal")
+	return std::find_if(this->conf.begin(), this->conf.end(), [](const auto& t) {
+			   return t.value.string == contents_key;
+		   }) != this->conf.end();
 }
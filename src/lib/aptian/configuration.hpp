@@ -21,11 +21,35 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.*/
 #pragma once
 
 #include <string_view>
+#include <vector>
 
 #include <tml/tree.hpp>
 
+#include "compressor.hpp"
+#include "file_insertion.hpp"
+
 namespace aptian {
 
+/**
+ * @brief Repository settings stored in the configuration file.
+ */
+struct repository_settings {
+	// compression formats of the index files, if empty, only gzip is used
+	std::vector<compression_format> compression_formats;
+
+	// default method of putting package files to the pool
+	insertion_method pool_insertion = insertion_method::copy;
+
+	// number of index file generations to keep in by-hash directories, 0 means that by-hash directories are not used
+	unsigned by_hash_retention = 0;
+
+	// number of Packages file patches to keep, 0 means that patches are not generated
+	unsigned pdiff_history_size = 0;
+
+	// whether to generate Contents indices of the components
+	bool contents = false;
+};
+
 class configuration
 {
 	tml::forest conf;
@@ -35,7 +59,43 @@ public:
 
 	std::string_view get_gpg();
 
-	static void create(std::string_view dir, std::string_view gpg);
+	/**
+	 * @brief Get compression formats of the index files.
+	 * If not set in the configuration file, only gzip is used.
+	 * @return List of compression formats.
+	 */
+	std::vector<compression_format> get_compression_formats();
+
+	/**
+	 * @brief Get method of putting package files to the pool.
+	 * If not set in the configuration file, the package files are copied.
+	 * @return Pool insertion method.
+	 */
+	insertion_method get_pool_insertion_method();
+
+	/**
+	 * @brief Get number of index file generations to keep in by-hash directories.
+	 * The index files are also stored under their SHA256 digests in the by-hash directories,
+	 * so that APT clients can download those without race with the repository updates.
+	 * @return Number of index file generations to keep, 0 if by-hash directories are not used.
+	 */
+	unsigned get_by_hash_retention();
+
+	/**
+	 * @brief Get number of Packages file patches to keep.
+	 * The patches allow APT clients to update their copy of the Packages file
+	 * without downloading the whole file, see pdiff_history.
+	 * @return Number of patches to keep, 0 if patches are not generated.
+	 */
+	unsigned get_pdiff_history_size();
+
+	/**
+	 * @brief Check if Contents indices are generated.
+	 * @return true if Contents-<arch> indices of the components are generated.
+	 */
+	bool get_contents();
+
+	static void create(std::string_view dir, std::string_view gpg, const repository_settings& settings);
 };
 
 } // namespace aptian
@@ -0,0 +1,211 @@
+/*
+aptian - apt repository tool
+
+Copyright (C) 2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.*/
+
+/* ================ LICENSE END ================ */
+
+#include "contents.hpp"
+
+#include <filesystem>
+
+#include <fsif/native_file.hpp>
+#include <utki/string.hpp>
+
+using namespace std::string_literals;
+using namespace std::string_view_literals;
+
+using namespace aptian;
+
+/*
+The per-package cache file format:
+
+<sha256 of the package file>
+<file path>
+...
+*/
+
+namespace {
+constexpr std::string_view section_entry = "Section: "sv;
+} // namespace
+
+void contents_index::add(std::string_view qualified_name, utki::span<const std::string> files)
+{
+	for (const auto& f : files) {
+		auto i = this->entries.find(f);
+		if (i == this->entries.end()) {
+			i = this->entries.emplace(f, decltype(this->entries)::mapped_type()).first;
+		}
+		i->second.emplace(qualified_name);
+	}
+}
+
+namespace {
+// Output buffer for writing the index line by line without passing each line to the sink separately.
+class line_writer
+{
+	sink& out;
+	std::string buffer;
+
+public:
+	line_writer(sink& out) :
+		out(out)
+	{}
+
+	template <typename names_type>
+	void write(std::string_view path, const names_type& names)
+	{
+		this->buffer.append(path);
+		this->buffer.push_back('\t');
+		bool first = true;
+		for (const auto& n : names) {
+			if (!first) {
+				this->buffer.push_back(',');
+			}
+			first = false;
+			this->buffer.append(n);
+		}
+		this->buffer.push_back('\n');
+
+		constexpr size_t flush_size = 0x10000;
+		if (this->buffer.size() >= flush_size) {
+			this->flush();
+		}
+	}
+
+	void flush()
+	{
+		this->out.write(utki::to_uint8_t(utki::make_span(this->buffer)));
+		this->buffer.clear();
+	}
+};
+} // namespace
+
+void contents_index::write(std::string_view existing, sink& out) const
+{
+	line_writer writer(out);
+
+	// both the existing index and the added entries are sorted by file path, so merge those in one pass
+	auto i = this->entries.begin();
+
+	while (!existing.empty()) {
+		auto line_end = existing.find('\n');
+		auto line = existing.substr(0, line_end);
+		existing = line_end == std::string_view::npos ? std::string_view() : existing.substr(line_end + 1);
+
+		if (line.empty()) {
+			continue;
+		}
+
+		// file path can contain spaces, the package names cannot
+		auto names_begin = line.find_last_of(" \t"sv);
+		if (names_begin == std::string_view::npos) {
+			throw std::invalid_argument(utki::cat("malformed Contents index line: ", line));
+		}
+		auto path = line.substr(0, line.find_last_not_of(" \t"sv, names_begin) + 1);
+		auto names = line.substr(names_begin + 1);
+
+		for (; i != this->entries.end() && std::string_view(i->first) < path; ++i) {
+			writer.write(i->first, i->second);
+		}
+
+		if (i == this->entries.end() || i->first != path) {
+			writer.write(path, utki::split(names, ','));
+			continue;
+		}
+
+		auto merged = i->second;
+		for (const auto& n : utki::split(names, ',')) {
+			merged.emplace(n);
+		}
+		writer.write(path, merged);
+		++i;
+	}
+
+	for (; i != this->entries.end(); ++i) {
+		writer.write(i->first, i->second);
+	}
+
+	writer.flush();
+}
+
+std::string aptian::get_qualified_name(const package& pkg)
+{
+	auto control = pkg.get_control();
+
+	while (!control.empty()) {
+		auto line_end = control.find('\n');
+		std::string_view line = control.substr(0, line_end);
+		control = line_end == std::string_view::npos ? std::string_view() : control.substr(line_end + 1);
+
+		if (line.starts_with(section_entry)) {
+			auto section = utki::trim(line.substr(section_entry.size()));
+			if (section.empty()) {
+				break;
+			}
+			return utki::cat(section, '/', pkg.fields.package);
+		}
+	}
+
+	return std::string(pkg.fields.package);
+}
+
+void aptian::save_package_files(std::string_view path, std::string_view sha256, utki::span<const std::string> files)
+{
+	std::string data(sha256);
+	data.push_back('\n');
+	for (const auto& f : files) {
+		data.append(f);
+		data.push_back('\n');
+	}
+
+	std::filesystem::create_directories(fsif::dir(path));
+
+	// write to temporary file and then rename it to make the cache update atomic
+	auto tmp_path = utki::cat(path, ".new"sv);
+	{
+		fsif::native_file fi(tmp_path);
+		fsif::file::guard file_guard(fi, fsif::mode::create);
+		fi.write(data);
+	}
+	std::filesystem::rename(tmp_path, path);
+}
+
+std::optional<std::vector<std::string>> aptian::load_package_files(std::string_view path, std::string_view sha256)
+{
+	fsif::native_file fi(path);
+	if (!fi.exists()) {
+		return std::nullopt;
+	}
+
+	auto data = fi.load();
+	auto lines = utki::make_string_view(data);
+
+	auto line_end = lines.find('\n');
+	if (line_end == std::string_view::npos || lines.substr(0, line_end) != sha256 || !lines.ends_with('\n')) {
+		return std::nullopt;
+	}
+	lines = lines.substr(line_end + 1);
+
+	std::vector<std::string> ret;
+	while (!lines.empty()) {
+		line_end = lines.find('\n');
+		ret.emplace_back(lines.substr(0, line_end));
+		lines = lines.substr(line_end + 1);
+	}
+
+	return ret;
+}
@@ -0,0 +1,92 @@
+/*
+aptian - apt repository tool
+
+Copyright (C) 2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.*/
+
+/* ================ LICENSE END ================ */
+
+#pragma once
+
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <utki/span.hpp>
+
+#include "packages.hpp"
+#include "sink.hpp"
+
+namespace aptian {
+
+/**
+ * @brief Contents index.
+ * The Contents index maps file paths to the packages containing those files, it is used by e.g. apt-file.
+ * Each line of the index is a file path followed by comma separated list of qualified package names.
+ * The lines are sorted by file path.
+ * For the format info refer to: https://wiki.debian.org/DebianRepository/Format#A.22Contents.22_indices
+ * The index is built incrementally: the files of the added packages are merged into the existing index.
+ */
+class contents_index
+{
+	// file path -> qualified package names
+	std::map<std::string, std::set<std::string, std::less<>>, std::less<>> entries;
+
+public:
+	/**
+	 * @brief Add files of a package.
+	 * @param qualified_name - qualified package name, see get_qualified_name().
+	 * @param files - file paths of the package.
+	 */
+	void add(std::string_view qualified_name, utki::span<const std::string> files);
+
+	/**
+	 * @brief Write the index.
+	 * The added files are merged with the existing index.
+	 * @param existing - existing index contents, empty if there is no existing index.
+	 * @param out - sink to write the index to. The sink is not finished.
+	 * @throw std::invalid_argument - if the existing index is malformed.
+	 */
+	void write(std::string_view existing, sink& out) const;
+};
+
+/**
+ * @brief Get qualified package name for the Contents index.
+ * @param pkg - package.
+ * @return Package name prefixed with its section, if the package has one, e.g. 'utils/hello'.
+ */
+std::string get_qualified_name(const package& pkg);
+
+/**
+ * @brief Save list of the package files to the per-package cache.
+ * @param path - path to the cache file.
+ * @param sha256 - SHA256 digest of the package file the list belongs to.
+ * @param files - file paths of the package.
+ */
+void save_package_files(std::string_view path, std::string_view sha256, utki::span<const std::string> files);
+
+/**
+ * @brief Load list of the package files from the per-package cache.
+ * @param path - path to the cache file.
+ * @param sha256 - SHA256 digest of the package file.
+ * @return File paths of the package.
+ * @return std::nullopt if the cache file does not exist, is malformed or belongs to a different package file.
+ */
+std::optional<std::vector<std::string>> load_package_files(std::string_view path, std::string_view sha256);
+
+} // namespace aptian
@@ -0,0 +1,556 @@
+/*
+aptian - apt repository tool
+
+Copyright (C) 2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.*/
+
+/* ================ LICENSE END ================ */
+
+#include "deb.hpp"
+
+#include <algorithm>
+#include <optional>
+#include <stdexcept>
+
+#include <utki/debug.hpp>
+#include <utki/string.hpp>
+
+#include "decompressor.hpp"
+
+using namespace std::string_view_literals;
+
+using namespace aptian;
+
+/*
+Debian binary package is an ar archive with the following members:
+	debian-binary
+	control.tar[.gz|.xz|.zst]
+	data.tar[.gz|.xz|.zst|...]
+
+For the format info refer to: man deb(5), man ar(5), man tar(5)
+*/
+
+namespace {
+constexpr std::string_view ar_magic = "!<arch>\n"sv;
+constexpr std::string_view ar_member_end_magic = "`\n"sv;
+constexpr std::string_view control_tar_prefix = "control.tar"sv;
+constexpr std::string_view control_filename = "control"sv;
+constexpr std::string_view data_tar_prefix = "data.tar"sv;
+
+constexpr size_t ar_header_size = 60;
+constexpr size_t ar_name_size = 16;
+constexpr size_t ar_size_offset = 48;
+constexpr size_t ar_size_size = 10;
+constexpr size_t ar_end_magic_offset = 58;
+
+constexpr size_t tar_block_size = 512;
+constexpr size_t tar_name_size = 100;
+constexpr size_t tar_size_offset = 124;
+constexpr size_t tar_size_size = 12;
+constexpr size_t tar_type_offset = 156;
+constexpr size_t tar_ustar_magic_offset = 257;
+constexpr size_t tar_prefix_offset = 345;
+constexpr size_t tar_prefix_size = 155;
+// POSIX ustar magic, old GNU tar format has "ustar  \0" magic and no name prefix field
+constexpr std::string_view tar_ustar_magic = "ustar\0"sv;
+constexpr std::string_view tar_pax_path_key = "path"sv;
+
+// maximal size of GNU long name and pax extended header data
+constexpr uint64_t tar_max_extended_header_size = 0x100000;
+} // namespace
+
+namespace {
+// Sequential reader which feeds all the bytes read from the file to the hasher.
+class hashing_reader
+{
+	const fsif::file& fi;
+
+	std::vector<uint8_t> buf;
+	utki::span<const uint8_t> unread;
+
+	bool eof = false;
+
+	void fill()
+	{
+		constexpr auto read_buffer_size = 0x40000;
+		this->buf.resize(read_buffer_size);
+
+		auto num_bytes_read = this->fi.read(this->buf);
+		if (num_bytes_read == 0) {
+			this->eof = true;
+		}
+
+		this->unread = utki::make_span(this->buf.data(), num_bytes_read);
+		this->h.update(this->unread);
+	}
+
+public:
+	aptian::hasher h;
+
+	hashing_reader(const fsif::file& fi) :
+		fi(fi)
+	{}
+
+	// read up to dst.size() bytes, returns number of bytes read, less than dst.size() only when EOF reached
+	size_t read(utki::span<uint8_t> dst)
+	{
+		size_t num_read = 0;
+		while (num_read != dst.size()) {
+			if (this->unread.empty()) {
+				this->fill();
+				if (this->eof) {
+					break;
+				}
+			}
+			auto n = std::min(dst.size() - num_read, this->unread.size());
+			std::copy_n(this->unread.begin(), n, std::next(dst.begin(), ptrdiff_t(num_read)));
+			this->unread = this->unread.subspan(n);
+			num_read += n;
+		}
+		return num_read;
+	}
+
+	// call the function for each chunk of next 'size' bytes
+	template <typename function_type>
+	void consume(uint64_t size, const function_type& func)
+	{
+		while (size != 0) {
+			if (this->unread.empty()) {
+				this->fill();
+				if (this->eof) {
+					throw std::invalid_argument("unexpected end of file");
+				}
+			}
+			auto n = size_t(std::min(size, uint64_t(this->unread.size())));
+			func(this->unread.subspan(0, n));
+			this->unread = this->unread.subspan(n);
+			size -= n;
+		}
+	}
+
+	void skip(uint64_t size)
+	{
+		this->consume(size, [](auto) {});
+	}
+
+	// read till the end of file, so that all the file gets hashed
+	void skip_to_end()
+	{
+		while (!this->eof) {
+			this->fill();
+		}
+		this->unread = {};
+	}
+};
+} // namespace
+
+namespace {
+template <typename integer_type>
+integer_type parse_number(std::string_view str, unsigned base, std::string_view what)
+{
+	str = utki::trim(str);
+
+	// tar numeric fields can be terminated by null character
+	str = str.substr(0, str.find('\0'));
+	str = utki::trim(str);
+
+	if (str.empty()) {
+		throw std::invalid_argument(utki::cat("empty ", what));
+	}
+
+	integer_type ret = 0;
+	for (char c : str) {
+		auto digit = unsigned(c - '0');
+		if (c < '0' || digit >= base) {
+			throw std::invalid_argument(utki::cat("malformed ", what, ": ", str));
+		}
+		ret = ret * base + digit;
+	}
+	return ret;
+}
+
+std::string_view to_string_view(utki::span<const uint8_t> span)
+{
+	auto sv = utki::make_string_view(span);
+	return sv.substr(0, sv.find('\0'));
+}
+} // namespace
+
+namespace {
+struct tar_header {
+	std::string name;
+	uint64_t size;
+	char type;
+
+	bool is_regular_file() const noexcept
+	{
+		return this->type == '0' || this->type == '\0';
+	}
+};
+
+// Parse size field of tar entry header.
+// GNU tar stores sizes which do not fit the octal field in base-256, marked by the highest bit of the first byte.
+uint64_t parse_tar_size(utki::span<const uint8_t> field)
+{
+	constexpr uint8_t base256_flag = 0x80;
+	if ((field.front() & base256_flag) == 0) {
+		return parse_number<uint64_t>(utki::make_string_view(field), 8, "tar entry size"sv);
+	}
+
+	// negative sizes have all bits of the first byte set
+	if (field.front() != base256_flag) {
+		throw std::invalid_argument("malformed tar entry size");
+	}
+
+	uint64_t ret = 0;
+	for (auto b : field.subspan(1)) {
+		constexpr auto bits_per_byte = 8;
+		if ((ret >> (sizeof(ret) * bits_per_byte - bits_per_byte)) != 0) {
+			throw std::invalid_argument("tar entry size is too big");
+		}
+		ret = (ret << bits_per_byte) | b;
+	}
+	return ret;
+}
+
+// Parse tar entry header block.
+// Returns std::nullopt in case of zero block which marks the archive end.
+std::optional<tar_header> parse_tar_header(utki::span<const uint8_t> header)
+{
+	ASSERT(header.size() == tar_block_size)
+
+	// archive ends with zero blocks
+	// TODO: use std::ranges::all_of() when ubuntu focal support can be dropped
+	// NOLINTNEXTLINE(modernize-use-ranges, "ranges not supported in gcc from ubuntu focal")
+	if (std::all_of(header.begin(), header.end(), [](auto b) {
+			return b == 0;
+		}))
+	{
+		return std::nullopt;
+	}
+
+	tar_header ret{
+		.name = std::string(to_string_view(header.subspan(0, tar_name_size))),
+		.size = parse_tar_size(header.subspan(tar_size_offset, tar_size_size)),
+		.type = char(header[tar_type_offset])
+	};
+
+	if (utki::make_string_view(header.subspan(tar_ustar_magic_offset, tar_ustar_magic.size())) == tar_ustar_magic) {
+		auto prefix = to_string_view(header.subspan(tar_prefix_offset, tar_prefix_size));
+		if (!prefix.empty()) {
+			ret.name = utki::cat(prefix, '/', ret.name);
+		}
+	}
+
+	return ret;
+}
+
+uint64_t tar_padded_size(uint64_t size)
+{
+	return (size + tar_block_size - 1) / tar_block_size * tar_block_size;
+}
+
+std::string_view strip_dot_slash(std::string_view path)
+{
+	if (path.starts_with("./"sv)) {
+		path = path.substr(2);
+	}
+	return path;
+}
+} // namespace
+
+namespace {
+// Find regular file in the tar archive and return its contents.
+std::string find_tar_file(utki::span<const uint8_t> tar, std::string_view name)
+{
+	while (tar.size() >= tar_block_size) {
+		auto header = parse_tar_header(tar.subspan(0, tar_block_size));
+		if (!header.has_value()) {
+			break;
+		}
+
+		tar = tar.subspan(tar_block_size);
+
+		if (header->size > tar.size()) {
+			throw std::invalid_argument("tar archive is truncated");
+		}
+
+		if (header->is_regular_file() && strip_dot_slash(header->name) == name) {
+			return std::string(utki::make_string_view(tar.subspan(0, size_t(header->size))));
+		}
+
+		tar = tar.subspan(size_t(std::min(tar_padded_size(header->size), uint64_t(tar.size()))));
+	}
+
+	throw std::invalid_argument(utki::cat("file '", name, "' not found in tar archive"));
+}
+} // namespace
+
+namespace {
+// Lister of the files in tar archive which is fed in arbitrary portions,
+// so that the archive never needs to be held in memory as a whole.
+// Only the entry headers are looked at, the entry data is skipped.
+class tar_file_lister
+{
+	// incomplete header block or extended header data
+	std::vector<uint8_t> buffer;
+
+	// number of bytes of the current entry data left to skip
+	uint64_t to_skip = 0;
+
+	// type and size of the extended header entry whose data is being collected
+	std::optional<char> extended_type;
+	uint64_t extended_size = 0;
+
+	// file name given by the extended header for the next entry
+	std::string next_name;
+
+	bool end = false;
+
+	void parse_pax_records(std::string_view data)
+	{
+		// each record is '<length> <key>=<value>\n', the length includes the whole record
+		while (!data.empty()) {
+			auto space = data.find(' ');
+			if (space == std::string_view::npos) {
+				throw std::invalid_argument("malformed pax extended header");
+			}
+			auto length = parse_number<size_t>(data.substr(0, space), 10, "pax record length"sv);
+			if (length <= space || length > data.size()) {
+				throw std::invalid_argument("malformed pax extended header");
+			}
+
+			auto record = data.substr(space + 1, length - space - 1);
+			data = data.substr(length);
+
+			if (record.ends_with('\n')) {
+				record.remove_suffix(1);
+			}
+
+			auto eq = record.find('=');
+			if (eq != std::string_view::npos && record.substr(0, eq) == tar_pax_path_key) {
+				this->next_name = record.substr(eq + 1);
+			}
+		}
+	}
+
+	void handle_extended_data()
+	{
+		ASSERT(this->extended_type.has_value())
+
+		auto data = utki::make_string_view(utki::make_span(this->buffer).subspan(0, size_t(this->extended_size)));
+
+		if (this->extended_type.value() == 'L') {
+			// GNU long name
+			this->next_name = data.substr(0, data.find('\0'));
+		} else {
+			this->parse_pax_records(data);
+		}
+
+		this->extended_type.reset();
+	}
+
+	void handle_header(const tar_header& header)
+	{
+		switch (header.type) {
+			case 'L': // GNU long name
+			case 'x': // pax extended header
+				if (header.size > tar_max_extended_header_size) {
+					throw std::invalid_argument("tar extended header is too big");
+				}
+				this->extended_type = header.type;
+				this->extended_size = header.size;
+				return;
+			case '0':
+			case '\0':
+			case '1': // hard link
+			case '2': // symbolic link
+			case '7': // contiguous file
+				{
+					auto name = strip_dot_slash(this->next_name.empty() ? header.name : this->next_name);
+					while (name.starts_with('/')) {
+						name = name.substr(1);
+					}
+					// file names with new lines cannot be listed in line based indices
+					if (!name.empty() && name.find('\n') == std::string_view::npos) {
+						this->files.emplace_back(name);
+					}
+				}
+				break;
+			default:
+				// directories, devices, global pax headers etc.
+				break;
+		}
+
+		this->next_name.clear();
+		this->to_skip = tar_padded_size(header.size);
+	}
+
+public:
+	std::vector<std::string> files;
+
+	void feed(utki::span<const uint8_t> data)
+	{
+		while (!data.empty() && !this->end) {
+			if (this->to_skip != 0) {
+				auto n = size_t(std::min(this->to_skip, uint64_t(data.size())));
+				data = data.subspan(n);
+				this->to_skip -= n;
+				continue;
+			}
+
+			auto needed = size_t(this->extended_type.has_value() ? tar_padded_size(this->extended_size) : tar_block_size);
+
+			auto n = std::min(needed - this->buffer.size(), data.size());
+			this->buffer.insert(this->buffer.end(), data.begin(), std::next(data.begin(), ptrdiff_t(n)));
+			data = data.subspan(n);
+
+			if (this->buffer.size() != needed) {
+				break;
+			}
+
+			if (this->extended_type.has_value()) {
+				this->handle_extended_data();
+			} else if (auto header = parse_tar_header(this->buffer)) {
+				this->handle_header(header.value());
+			} else {
+				this->end = true;
+			}
+
+			this->buffer.clear();
+		}
+	}
+
+	void finish() const
+	{
+		if (this->to_skip != 0 || !this->buffer.empty() || this->extended_type.has_value()) {
+			throw std::invalid_argument("tar archive is truncated");
+		}
+	}
+};
+} // namespace
+
+deb_file_info aptian::read_deb(const fsif::file& fi, bool list_files)
+{
+	fsif::file::guard file_guard(fi, fsif::mode::read);
+
+	hashing_reader reader(fi);
+
+	{
+		std::array<uint8_t, ar_magic.size()> magic{};
+		if (reader.read(magic) != magic.size() || utki::make_string_view(magic) != ar_magic) {
+			throw std::invalid_argument("not a debian package, ar archive magic not found");
+		}
+	}
+
+	std::string control;
+	bool control_found = false;
+
+	std::vector<std::string> files;
+	bool files_listed = false;
+	bool data_found = false;
+
+	for (;;) {
+		std::array<uint8_t, ar_header_size> header{};
+		auto num_read = reader.read(header);
+		if (num_read == 0) {
+			// end of archive
+			break;
+		}
+		if (num_read != header.size()) {
+			throw std::invalid_argument("ar archive is truncated");
+		}
+
+		auto header_span = utki::make_span(header);
+
+		if (utki::make_string_view(header_span.subspan(ar_end_magic_offset, ar_member_end_magic.size())) !=
+			ar_member_end_magic)
+		{
+			throw std::invalid_argument("malformed ar archive member header");
+		}
+
+		auto name = utki::trim(utki::make_string_view(header_span.subspan(0, ar_name_size)));
+		// GNU ar terminates member names with '/'
+		if (name.ends_with('/')) {
+			name.remove_suffix(1);
+		}
+
+		auto size = parse_number<uint64_t>(
+			utki::make_string_view(header_span.subspan(ar_size_offset, ar_size_size)),
+			10, // decimal
+			"ar member size"sv
+		);
+
+		if (!control_found && name.starts_with(control_tar_prefix)) {
+			auto decomp = make_decompressor(name);
+
+			std::vector<uint8_t> tar;
+			reader.consume(size, [&](auto chunk) {
+				decomp->feed(chunk, tar);
+			});
+			decomp->finish(tar);
+
+			control = find_tar_file(tar, control_filename);
+			control_found = true;
+		} else if (list_files && !data_found && name.starts_with(data_tar_prefix) && !can_decompress(name)) {
+			// the files cannot be listed, the data.tar is only hashed
+			reader.skip(size);
+			data_found = true;
+		} else if (list_files && !data_found && name.starts_with(data_tar_prefix)) {
+			// data.tar can be big, so it is decompressed and listed chunk by chunk
+			auto decomp = make_decompressor(name);
+
+			tar_file_lister lister;
+			std::vector<uint8_t> tar;
+			reader.consume(size, [&](auto chunk) {
+				decomp->feed(chunk, tar);
+				lister.feed(tar);
+				tar.clear();
+			});
+			decomp->finish(tar);
+			lister.feed(tar);
+			lister.finish();
+
+			files = std::move(lister.files);
+			files_listed = true;
+			data_found = true;
+		} else {
+			// data.tar and other members are only hashed
+			reader.skip(size);
+		}
+
+		// ar archive members are aligned to 2 bytes
+		if (size % 2 != 0) {
+			reader.skip(1);
+		}
+	}
+
+	if (!control_found) {
+		throw std::invalid_argument("control.tar not found in the package");
+	}
+	if (list_files && !data_found) {
+		throw std::invalid_argument("data.tar not found in the package");
+	}
+
+	reader.skip_to_end();
+
+	return {
+		.control = std::move(control),
+		.files = std::move(files),
+		.files_listed = files_listed,
+		.size = reader.h.get_size(),
+		.hashes = reader.h.finish()
+	};
+}
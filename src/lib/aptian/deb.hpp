@@ -0,0 +1,63 @@
+/*
+aptian - apt repository tool
+
+Copyright (C) 2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.*/
+
+/* ================ LICENSE END ================ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <fsif/file.hpp>
+
+#include "hasher.hpp"
+
+namespace aptian {
+
+struct deb_file_info {
+	// contents of the 'control' file from the control.tar archive of the package
+	std::string control;
+
+	// paths of the files of the package, relative to the root directory, in order of the data.tar archive,
+	// only in case the listing was requested
+	std::vector<std::string> files;
+
+	// whether the files were listed, those cannot be listed in case compression of the data.tar is not supported
+	bool files_listed;
+
+	// size of the .deb file in bytes
+	uint64_t size;
+
+	file_hashes hashes;
+};
+
+/**
+ * @brief Read debian package file.
+ * The .deb file is read only once, sequentially. The control.tar member is decompressed
+ * in memory to extract the 'control' file. Unless listing of the files is requested,
+ * the data.tar member is not decompressed, its bytes are only fed to the hasher.
+ * Otherwise, the data.tar member is decompressed on the fly and only the tar entry headers are looked at,
+ * the decompressed data is not kept in memory. In case compression type of the data.tar member
+ * is not supported, the files are not listed.
+ * @param fi - .deb file to read.
+ * @param list_files - whether to list the files of the package.
+ * @return Control information, size and hash sums of the package file.
+ */
+deb_file_info read_deb(const fsif::file& fi, bool list_files = false);
+
+} // namespace aptian
@@ -0,0 +1,288 @@
+/*
+aptian - apt repository tool
+
+Copyright (C) 2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.*/
+
+/* ================ LICENSE END ================ */
+
+#include "decompressor.hpp"
+
+#include <limits>
+#include <stdexcept>
+
+#include <lzma.h>
+#include <utki/string.hpp>
+#include <zlib.h>
+#include <zstd.h>
+
+using namespace std::string_view_literals;
+
+using namespace aptian;
+
+namespace {
+// amount of output buffer space to add on each decompression step
+constexpr size_t out_chunk_size = 0x10000;
+
+// Extend the buffer by a chunk and return the span of the added part.
+utki::span<uint8_t> grow(std::vector<uint8_t>& out)
+{
+	auto old_size = out.size();
+	out.resize(old_size + out_chunk_size);
+	return utki::make_span(out).subspan(old_size);
+}
+} // namespace
+
+namespace {
+class plain_decompressor : public decompressor
+{
+public:
+	void feed(utki::span<const uint8_t> in, std::vector<uint8_t>& out) override
+	{
+		out.insert(out.end(), in.begin(), in.end());
+	}
+
+	void finish(std::vector<uint8_t>& out) override {}
+};
+} // namespace
+
+namespace {
+class gzip_decompressor : public decompressor
+{
+	z_stream stream{};
+	bool stream_end = false;
+
+public:
+	gzip_decompressor()
+	{
+		// 16 added to window bits means to decode gzip header
+		// NOLINTNEXTLINE(cppcoreguidelines-avoid-magic-numbers, readability-magic-numbers)
+		if (inflateInit2(&this->stream, 16 + MAX_WBITS) != Z_OK) {
+			throw std::runtime_error("gzip_decompressor: inflateInit2() failed");
+		}
+	}
+
+	gzip_decompressor(const gzip_decompressor&) = delete;
+	gzip_decompressor& operator=(const gzip_decompressor&) = delete;
+
+	gzip_decompressor(gzip_decompressor&&) = delete;
+	gzip_decompressor& operator=(gzip_decompressor&&) = delete;
+
+	~gzip_decompressor() override
+	{
+		inflateEnd(&this->stream);
+	}
+
+	void feed(utki::span<const uint8_t> in, std::vector<uint8_t>& out) override
+	{
+		// NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast)
+		this->stream.next_in = const_cast<Bytef*>(in.data());
+		this->stream.avail_in = uInt(in.size());
+
+		while (this->stream.avail_in != 0) {
+			if (this->stream_end) {
+				// next gzip member follows
+				inflateReset(&this->stream);
+				this->stream_end = false;
+			}
+
+			auto buf = grow(out);
+			this->stream.next_out = buf.data();
+			this->stream.avail_out = uInt(buf.size());
+
+			int ret = inflate(&this->stream, Z_NO_FLUSH);
+
+			out.resize(out.size() - this->stream.avail_out);
+
+			if (ret == Z_STREAM_END) {
+				this->stream_end = true;
+			} else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+				throw std::invalid_argument(utki::cat("gzip_decompressor: corrupted data, inflate() returned ", ret));
+			}
+		}
+	}
+
+	void finish(std::vector<uint8_t>& out) override
+	{
+		// flush remaining output
+		while (!this->stream_end) {
+			auto buf = grow(out);
+			this->stream.next_out = buf.data();
+			this->stream.avail_out = uInt(buf.size());
+
+			int ret = inflate(&this->stream, Z_FINISH);
+
+			out.resize(out.size() - this->stream.avail_out);
+
+			if (ret == Z_STREAM_END) {
+				break;
+			}
+			if (ret == Z_BUF_ERROR && this->stream.avail_out != 0) {
+				throw std::invalid_argument("gzip_decompressor: truncated data");
+			}
+			if (ret != Z_OK && ret != Z_BUF_ERROR) {
+				throw std::invalid_argument(utki::cat("gzip_decompressor: corrupted data, inflate() returned ", ret));
+			}
+		}
+	}
+};
+} // namespace
+
+namespace {
+class xz_decompressor : public decompressor
+{
+	lzma_stream stream = LZMA_STREAM_INIT;
+
+	bool code(lzma_action action, std::vector<uint8_t>& out)
+	{
+		auto buf = grow(out);
+		this->stream.next_out = buf.data();
+		this->stream.avail_out = buf.size();
+
+		auto ret = lzma_code(&this->stream, action);
+
+		out.resize(out.size() - this->stream.avail_out);
+
+		if (ret == LZMA_STREAM_END) {
+			return true;
+		}
+		if (ret == LZMA_BUF_ERROR && action == LZMA_FINISH) {
+			throw std::invalid_argument("xz_decompressor: truncated data");
+		}
+		if (ret != LZMA_OK) {
+			throw std::invalid_argument(utki::cat("xz_decompressor: corrupted data, lzma_code() returned ", ret));
+		}
+		return false;
+	}
+
+public:
+	xz_decompressor()
+	{
+		if (lzma_stream_decoder(&this->stream, std::numeric_limits<uint64_t>::max(), LZMA_CONCATENATED) != LZMA_OK) {
+			throw std::runtime_error("xz_decompressor: lzma_stream_decoder() failed");
+		}
+	}
+
+	xz_decompressor(const xz_decompressor&) = delete;
+	xz_decompressor& operator=(const xz_decompressor&) = delete;
+
+	xz_decompressor(xz_decompressor&&) = delete;
+	xz_decompressor& operator=(xz_decompressor&&) = delete;
+
+	~xz_decompressor() override
+	{
+		lzma_end(&this->stream);
+	}
+
+	void feed(utki::span<const uint8_t> in, std::vector<uint8_t>& out) override
+	{
+		this->stream.next_in = in.data();
+		this->stream.avail_in = in.size();
+
+		while (this->stream.avail_in != 0) {
+			this->code(LZMA_RUN, out);
+		}
+	}
+
+	void finish(std::vector<uint8_t>& out) override
+	{
+		// with LZMA_CONCATENATED flag the decoder needs LZMA_FINISH to report the stream end
+		while (!this->code(LZMA_FINISH, out)) {
+		}
+	}
+};
+} // namespace
+
+namespace {
+class zstd_decompressor : public decompressor
+{
+	ZSTD_DCtx* context;
+
+	// result of last ZSTD_decompressStream() call, 0 means that frame is completely decoded
+	size_t last_ret = 0;
+
+public:
+	zstd_decompressor() :
+		context(ZSTD_createDCtx())
+	{
+		if (!this->context) {
+			throw std::runtime_error("zstd_decompressor: ZSTD_createDCtx() failed");
+		}
+	}
+
+	zstd_decompressor(const zstd_decompressor&) = delete;
+	zstd_decompressor& operator=(const zstd_decompressor&) = delete;
+
+	zstd_decompressor(zstd_decompressor&&) = delete;
+	zstd_decompressor& operator=(zstd_decompressor&&) = delete;
+
+	~zstd_decompressor() override
+	{
+		ZSTD_freeDCtx(this->context);
+	}
+
+	void feed(utki::span<const uint8_t> in, std::vector<uint8_t>& out) override
+	{
+		ZSTD_inBuffer in_buf = {.src = in.data(), .size = in.size(), .pos = 0};
+
+		// also loop while the output buffer gets completely filled, as decoder might have more data to flush
+		for (bool out_full = true; in_buf.pos != in_buf.size || out_full;) {
+			auto buf = grow(out);
+			ZSTD_outBuffer out_buf = {.dst = buf.data(), .size = buf.size(), .pos = 0};
+
+			this->last_ret = ZSTD_decompressStream(this->context, &out_buf, &in_buf);
+
+			out.resize(out.size() - (out_buf.size - out_buf.pos));
+
+			if (ZSTD_isError(this->last_ret)) {
+				throw std::invalid_argument(
+					utki::cat("zstd_decompressor: corrupted data: ", ZSTD_getErrorName(this->last_ret))
+				);
+			}
+
+			out_full = out_buf.pos == out_buf.size;
+		}
+	}
+
+	void finish(std::vector<uint8_t>& out) override
+	{
+		if (this->last_ret != 0) {
+			throw std::invalid_argument("zstd_decompressor: truncated data");
+		}
+	}
+};
+} // namespace
+
+bool aptian::can_decompress(std::string_view file_name)
+{
+	return !file_name.ends_with(".bz2"sv) && !file_name.ends_with(".lzma"sv);
+}
+
+std::unique_ptr<decompressor> aptian::make_decompressor(std::string_view file_name)
+{
+	if (!can_decompress(file_name)) {
+		throw std::invalid_argument(utki::cat("unsupported compression type of ", file_name));
+	}
+
+	if (file_name.ends_with(".gz"sv)) {
+		return std::make_unique<gzip_decompressor>();
+	} else if (file_name.ends_with(".xz"sv)) {
+		return std::make_unique<xz_decompressor>();
+	} else if (file_name.ends_with(".zst"sv)) {
+		return std::make_unique<zstd_decompressor>();
+	}
+
+	return std::make_unique<plain_decompressor>();
+}
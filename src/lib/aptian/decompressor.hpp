@@ -0,0 +1,80 @@
+/*
+aptian - apt repository tool
+
+Copyright (C) 2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.*/
+
+/* ================ LICENSE END ================ */
+
+#pragma once
+
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include <utki/span.hpp>
+
+namespace aptian {
+
+/**
+ * @brief Streaming decompressor.
+ * Compressed data is fed in arbitrary portions, the decompressed data is appended to the output buffer.
+ */
+class decompressor
+{
+public:
+	decompressor() = default;
+
+	decompressor(const decompressor&) = delete;
+	decompressor& operator=(const decompressor&) = delete;
+
+	decompressor(decompressor&&) = delete;
+	decompressor& operator=(decompressor&&) = delete;
+
+	virtual ~decompressor() = default;
+
+	/**
+	 * @brief Decompress next portion of compressed data.
+	 * @param in - compressed data.
+	 * @param out - buffer to append decompressed data to.
+	 */
+	virtual void feed(utki::span<const uint8_t> in, std::vector<uint8_t>& out) = 0;
+
+	/**
+	 * @brief Signal end of compressed data.
+	 * @param out - buffer to append remaining decompressed data to.
+	 * @throw std::invalid_argument - in case compressed data is truncated.
+	 */
+	virtual void finish(std::vector<uint8_t>& out) = 0;
+};
+
+/**
+ * @brief Check if compression type of the file is supported by make_decompressor().
+ * @param file_name - name of the compressed file.
+ * @return true if the compression type is supported or the file is not compressed.
+ */
+bool can_decompress(std::string_view file_name);
+
+/**
+ * @brief Create decompressor based on file name suffix.
+ * Supported suffixes are .gz, .xz and .zst. For file names without
+ * compression suffix the returned decompressor just passes the data through.
+ * @param file_name - name of the compressed file.
+ * @return Decompressor.
+ * @throw std::invalid_argument - in case compression type is not supported.
+ */
+std::unique_ptr<decompressor> make_decompressor(std::string_view file_name);
+
+} // namespace aptian
@@ -0,0 +1,637 @@
+/*
+aptian - apt repository tool
+
+Copyright (C) 2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.*/
+
+/* ================ LICENSE END ================ */
+
+#include "digest.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+#include <vector>
+
+#include "digest_kernels.hpp"
+
+using namespace aptian;
+
+// NOLINTBEGIN(cppcoreguidelines-avoid-magic-numbers, readability-magic-numbers)
+// NOLINTBEGIN(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+
+namespace {
+uint32_t load_le32(const uint8_t* p)
+{
+	return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+}
+
+uint32_t load_be32(const uint8_t* p)
+{
+	return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+uint64_t load_be64(const uint8_t* p)
+{
+	return (uint64_t(load_be32(p)) << 32) | uint64_t(load_be32(p + 4));
+}
+
+template <typename word_type>
+void store_le(word_type w, uint8_t* p)
+{
+	for (size_t i = 0; i != sizeof(word_type); ++i) {
+		p[i] = uint8_t(w >> (i * 8));
+	}
+}
+
+template <typename word_type>
+void store_be(word_type w, uint8_t* p)
+{
+	for (size_t i = 0; i != sizeof(word_type); ++i) {
+		p[i] = uint8_t(w >> ((sizeof(word_type) - 1 - i) * 8));
+	}
+}
+
+// Accumulate data into the block buffer and pass all complete blocks to the block processing function.
+// Whole blocks are passed directly from the input data, without copying to the buffer.
+template <size_t block_size, typename process_type>
+void feed(
+	std::array<uint8_t, block_size>& buffer,
+	uint64_t& length,
+	utki::span<const uint8_t> data,
+	const process_type& process
+)
+{
+	auto buffered = size_t(length % block_size);
+	length += data.size();
+
+	if (buffered != 0) {
+		auto n = std::min(block_size - buffered, data.size());
+		std::copy_n(data.begin(), n, std::next(buffer.begin(), ptrdiff_t(buffered)));
+		data = data.subspan(n);
+		buffered += n;
+		if (buffered != block_size) {
+			return;
+		}
+		process(buffer.data(), 1);
+	}
+
+	auto num_blocks = data.size() / block_size;
+	if (num_blocks != 0) {
+		process(data.data(), num_blocks);
+		data = data.subspan(num_blocks * block_size);
+	}
+
+	std::copy(data.begin(), data.end(), buffer.begin());
+}
+
+template <typename word_type>
+word_type load_le(const uint8_t* p)
+{
+	word_type ret = 0;
+	for (size_t i = 0; i != sizeof(word_type); ++i) {
+		ret |= word_type(p[i]) << (i * 8);
+	}
+	return ret;
+}
+
+// Serialized state format: length, state words, buffered bytes. All numbers are little-endian.
+template <typename word_type, size_t num_words, size_t block_size>
+std::vector<uint8_t> save_digest_state(
+	const std::array<word_type, num_words>& state,
+	const std::array<uint8_t, block_size>& buffer,
+	uint64_t length
+)
+{
+	auto buffered = size_t(length % block_size);
+
+	std::vector<uint8_t> ret(sizeof(length) + num_words * sizeof(word_type) + buffered);
+
+	auto p = ret.data();
+	store_le(length, p);
+	p += sizeof(length);
+	for (auto w : state) {
+		store_le(w, p);
+		p += sizeof(word_type);
+	}
+	std::copy_n(buffer.begin(), buffered, p);
+
+	return ret;
+}
+
+template <typename word_type, size_t num_words, size_t block_size>
+void load_digest_state(
+	utki::span<const uint8_t> saved,
+	std::array<word_type, num_words>& state,
+	std::array<uint8_t, block_size>& buffer,
+	uint64_t& length
+)
+{
+	constexpr auto header_size = sizeof(length) + num_words * sizeof(word_type);
+	if (saved.size() < header_size) {
+		throw std::invalid_argument("load_state(): saved state is too short");
+	}
+
+	auto p = saved.data();
+	auto saved_length = load_le<uint64_t>(p);
+	p += sizeof(saved_length);
+
+	auto buffered = size_t(saved_length % block_size);
+	if (saved.size() != header_size + buffered) {
+		throw std::invalid_argument("load_state(): saved state size does not match");
+	}
+
+	for (auto& w : state) {
+		w = load_le<word_type>(p);
+		p += sizeof(word_type);
+	}
+	std::copy_n(p, buffered, buffer.begin());
+	length = saved_length;
+}
+
+// Merkle–Damgård padding: 0x80 byte, zeros, then message length in bits.
+template <bool big_endian, size_t length_field_size, size_t block_size, typename process_type>
+void pad(std::array<uint8_t, block_size>& buffer, uint64_t length, const process_type& process)
+{
+	auto buffered = size_t(length % block_size);
+
+	buffer[buffered] = 0x80;
+	++buffered;
+
+	if (buffered > block_size - length_field_size) {
+		std::fill(std::next(buffer.begin(), ptrdiff_t(buffered)), buffer.end(), 0);
+		process(buffer.data(), 1);
+		buffered = 0;
+	}
+
+	std::fill(std::next(buffer.begin(), ptrdiff_t(buffered)), buffer.end(), 0);
+
+	uint64_t bit_length = length * 8;
+	if constexpr (big_endian) {
+		store_be(bit_length, buffer.data() + block_size - sizeof(bit_length));
+	} else {
+		store_le(bit_length, buffer.data() + block_size - sizeof(bit_length));
+	}
+
+	process(buffer.data(), 1);
+}
+} // namespace
+
+namespace {
+void md5_process(std::array<uint32_t, 4>& state, const uint8_t* data, size_t num_blocks)
+{
+	constexpr std::array<uint32_t, 64> k = {
+		0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+		0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+		0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+		0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+		0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+		0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+		0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+		0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+	};
+	constexpr std::array<int, 64> r = {
+		7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, //
+		5, 9,  14, 20, 5, 9,  14, 20, 5, 9,  14, 20, 5, 9,  14, 20, //
+		4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, //
+		6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+	};
+
+	for (; num_blocks != 0; --num_blocks, data += md5::block_size) {
+		std::array<uint32_t, 16> m{};
+		for (size_t i = 0; i != m.size(); ++i) {
+			m[i] = load_le32(data + i * 4);
+		}
+
+		uint32_t a = state[0];
+		uint32_t b = state[1];
+		uint32_t c = state[2];
+		uint32_t d = state[3];
+
+		// the rounds are split into groups having same round function, so that the compiler
+		// can fully unroll each group without branches
+		auto round = [&](size_t i, uint32_t f, size_t g) {
+			f += a + k[i] + m[g];
+			a = d;
+			d = c;
+			c = b;
+			b += std::rotl(f, r[i]);
+		};
+
+		for (size_t i = 0; i != 16; ++i) {
+			round(i, (b & c) | (~b & d), i);
+		}
+		for (size_t i = 16; i != 32; ++i) {
+			round(i, (d & b) | (~d & c), (5 * i + 1) % 16);
+		}
+		for (size_t i = 32; i != 48; ++i) {
+			round(i, b ^ c ^ d, (3 * i + 5) % 16);
+		}
+		for (size_t i = 48; i != k.size(); ++i) {
+			round(i, c ^ (b | ~d), (7 * i) % 16);
+		}
+
+		state[0] += a;
+		state[1] += b;
+		state[2] += c;
+		state[3] += d;
+	}
+}
+} // namespace
+
+md5::md5()
+{
+	this->reset();
+}
+
+void md5::reset()
+{
+	this->state = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476};
+	this->length = 0;
+}
+
+void md5::update(utki::span<const uint8_t> data)
+{
+	feed(this->buffer, this->length, data, [this](const uint8_t* blocks, size_t num_blocks) {
+		md5_process(this->state, blocks, num_blocks);
+	});
+}
+
+std::vector<uint8_t> md5::save_state() const
+{
+	return save_digest_state(this->state, this->buffer, this->length);
+}
+
+void md5::load_state(utki::span<const uint8_t> saved)
+{
+	load_digest_state(saved, this->state, this->buffer, this->length);
+}
+
+std::array<uint8_t, md5::digest_size> md5::finish()
+{
+	pad<false, sizeof(uint64_t)>(this->buffer, this->length, [this](const uint8_t* blocks, size_t num_blocks) {
+		md5_process(this->state, blocks, num_blocks);
+	});
+
+	std::array<uint8_t, digest_size> ret{};
+	for (size_t i = 0; i != this->state.size(); ++i) {
+		store_le(this->state[i], ret.data() + i * sizeof(uint32_t));
+	}
+
+	this->reset();
+	return ret;
+}
+
+namespace {
+void sha1_process(std::array<uint32_t, 5>& state, const uint8_t* data, size_t num_blocks)
+{
+	for (; num_blocks != 0; --num_blocks, data += sha1::block_size) {
+		std::array<uint32_t, 80> w{};
+		for (size_t i = 0; i != 16; ++i) {
+			w[i] = load_be32(data + i * 4);
+		}
+		for (size_t i = 16; i != w.size(); ++i) {
+			w[i] = std::rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+		}
+
+		uint32_t a = state[0];
+		uint32_t b = state[1];
+		uint32_t c = state[2];
+		uint32_t d = state[3];
+		uint32_t e = state[4];
+
+		// the rounds are split into groups having same round function, so that the compiler
+		// can fully unroll each group without branches
+		auto round = [&](size_t i, uint32_t f, uint32_t k) {
+			uint32_t t = std::rotl(a, 5) + f + e + k + w[i];
+			e = d;
+			d = c;
+			c = std::rotl(b, 30);
+			b = a;
+			a = t;
+		};
+
+		for (size_t i = 0; i != 20; ++i) {
+			round(i, (b & c) | (~b & d), 0x5a827999);
+		}
+		for (size_t i = 20; i != 40; ++i) {
+			round(i, b ^ c ^ d, 0x6ed9eba1);
+		}
+		for (size_t i = 40; i != 60; ++i) {
+			round(i, (b & c) | (b & d) | (c & d), 0x8f1bbcdc);
+		}
+		for (size_t i = 60; i != w.size(); ++i) {
+			round(i, b ^ c ^ d, 0xca62c1d6);
+		}
+
+		state[0] += a;
+		state[1] += b;
+		state[2] += c;
+		state[3] += d;
+		state[4] += e;
+	}
+}
+} // namespace
+
+sha1::sha1()
+{
+	this->reset();
+}
+
+void sha1::reset()
+{
+	this->state = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0};
+	this->length = 0;
+}
+
+void sha1::update(utki::span<const uint8_t> data)
+{
+	feed(this->buffer, this->length, data, [this](const uint8_t* blocks, size_t num_blocks) {
+		sha1_process(this->state, blocks, num_blocks);
+	});
+}
+
+std::vector<uint8_t> sha1::save_state() const
+{
+	return save_digest_state(this->state, this->buffer, this->length);
+}
+
+void sha1::load_state(utki::span<const uint8_t> saved)
+{
+	load_digest_state(saved, this->state, this->buffer, this->length);
+}
+
+std::array<uint8_t, sha1::digest_size> sha1::finish()
+{
+	pad<true, sizeof(uint64_t)>(this->buffer, this->length, [this](const uint8_t* blocks, size_t num_blocks) {
+		sha1_process(this->state, blocks, num_blocks);
+	});
+
+	std::array<uint8_t, digest_size> ret{};
+	for (size_t i = 0; i != this->state.size(); ++i) {
+		store_be(this->state[i], ret.data() + i * sizeof(uint32_t));
+	}
+
+	this->reset();
+	return ret;
+}
+
+// NOLINTNEXTLINE(cppcoreguidelines-avoid-c-arrays, modernize-avoid-c-arrays)
+alignas(16) const uint32_t aptian::kernels::sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+void aptian::kernels::sha256_generic(sha256::state_type& state, const uint8_t* data, size_t num_blocks)
+{
+	const auto& k = kernels::sha256_k;
+
+	for (; num_blocks != 0; --num_blocks, data += sha256::block_size) {
+		std::array<uint32_t, 64> w{};
+		for (size_t i = 0; i != 16; ++i) {
+			w[i] = load_be32(data + i * 4);
+		}
+		for (size_t i = 16; i != w.size(); ++i) {
+			uint32_t s0 = std::rotr(w[i - 15], 7) ^ std::rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+			uint32_t s1 = std::rotr(w[i - 2], 17) ^ std::rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+			w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+		}
+
+		auto v = state;
+
+		for (size_t i = 0; i != w.size(); ++i) {
+			uint32_t s1 = std::rotr(v[4], 6) ^ std::rotr(v[4], 11) ^ std::rotr(v[4], 25);
+			uint32_t ch = (v[4] & v[5]) ^ (~v[4] & v[6]);
+			uint32_t t1 = v[7] + s1 + ch + k[i] + w[i];
+			uint32_t s0 = std::rotr(v[0], 2) ^ std::rotr(v[0], 13) ^ std::rotr(v[0], 22);
+			uint32_t maj = (v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]);
+			uint32_t t2 = s0 + maj;
+			v[7] = v[6];
+			v[6] = v[5];
+			v[5] = v[4];
+			v[4] = v[3] + t1;
+			v[3] = v[2];
+			v[2] = v[1];
+			v[1] = v[0];
+			v[0] = t1 + t2;
+		}
+
+		for (size_t i = 0; i != state.size(); ++i) {
+			state[i] += v[i];
+		}
+	}
+}
+
+utki::span<const sha256::kernel> sha256::get_kernels()
+{
+	static const std::vector<kernel> kernels = []() {
+		std::vector<kernel> ret;
+#ifdef APTIAN_DIGEST_X86
+		if (kernels::is_x86_sha_ni_supported()) {
+			ret.push_back({.name = "x86 SHA-NI", .process = &kernels::sha256_x86_sha_ni});
+		}
+#endif
+#ifdef APTIAN_DIGEST_ARM64
+		if (kernels::is_arm64_sha2_supported()) {
+			ret.push_back({.name = "ARMv8 SHA2", .process = &kernels::sha256_arm64_sha2});
+		}
+#endif
+		ret.push_back({.name = "generic", .process = &kernels::sha256_generic});
+		return ret;
+	}();
+
+	return kernels;
+}
+
+sha256::sha256() :
+	sha256(get_kernels().front())
+{}
+
+sha256::sha256(const kernel& k) :
+	process(k.process)
+{
+	this->reset();
+}
+
+void sha256::reset()
+{
+	this->state = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+	this->length = 0;
+}
+
+void sha256::update(utki::span<const uint8_t> data)
+{
+	feed(this->buffer, this->length, data, [this](const uint8_t* blocks, size_t num_blocks) {
+		this->process(this->state, blocks, num_blocks);
+	});
+}
+
+std::vector<uint8_t> sha256::save_state() const
+{
+	return save_digest_state(this->state, this->buffer, this->length);
+}
+
+void sha256::load_state(utki::span<const uint8_t> saved)
+{
+	load_digest_state(saved, this->state, this->buffer, this->length);
+}
+
+std::array<uint8_t, sha256::digest_size> sha256::finish()
+{
+	pad<true, sizeof(uint64_t)>(this->buffer, this->length, [this](const uint8_t* blocks, size_t num_blocks) {
+		this->process(this->state, blocks, num_blocks);
+	});
+
+	std::array<uint8_t, digest_size> ret{};
+	for (size_t i = 0; i != this->state.size(); ++i) {
+		store_be(this->state[i], ret.data() + i * sizeof(uint32_t));
+	}
+
+	this->reset();
+	return ret;
+}
+
+void aptian::kernels::sha512_generic(sha512::state_type& state, const uint8_t* data, size_t num_blocks)
+{
+	constexpr std::array<uint64_t, 80> k = {
+		0x428a2f98d728ae22, 0x7137449123ef65cd, 0xb5c0fbcfec4d3b2f, 0xe9b5dba58189dbbc, 0x3956c25bf348b538,
+		0x59f111f1b605d019, 0x923f82a4af194f9b, 0xab1c5ed5da6d8118, 0xd807aa98a3030242, 0x12835b0145706fbe,
+		0x243185be4ee4b28c, 0x550c7dc3d5ffb4e2, 0x72be5d74f27b896f, 0x80deb1fe3b1696b1, 0x9bdc06a725c71235,
+		0xc19bf174cf692694, 0xe49b69c19ef14ad2, 0xefbe4786384f25e3, 0x0fc19dc68b8cd5b5, 0x240ca1cc77ac9c65,
+		0x2de92c6f592b0275, 0x4a7484aa6ea6e483, 0x5cb0a9dcbd41fbd4, 0x76f988da831153b5, 0x983e5152ee66dfab,
+		0xa831c66d2db43210, 0xb00327c898fb213f, 0xbf597fc7beef0ee4, 0xc6e00bf33da88fc2, 0xd5a79147930aa725,
+		0x06ca6351e003826f, 0x142929670a0e6e70, 0x27b70a8546d22ffc, 0x2e1b21385c26c926, 0x4d2c6dfc5ac42aed,
+		0x53380d139d95b3df, 0x650a73548baf63de, 0x766a0abb3c77b2a8, 0x81c2c92e47edaee6, 0x92722c851482353b,
+		0xa2bfe8a14cf10364, 0xa81a664bbc423001, 0xc24b8b70d0f89791, 0xc76c51a30654be30, 0xd192e819d6ef5218,
+		0xd69906245565a910, 0xf40e35855771202a, 0x106aa07032bbd1b8, 0x19a4c116b8d2d0c8, 0x1e376c085141ab53,
+		0x2748774cdf8eeb99, 0x34b0bcb5e19b48a8, 0x391c0cb3c5c95a63, 0x4ed8aa4ae3418acb, 0x5b9cca4f7763e373,
+		0x682e6ff3d6b2b8a3, 0x748f82ee5defb2fc, 0x78a5636f43172f60, 0x84c87814a1f0ab72, 0x8cc702081a6439ec,
+		0x90befffa23631e28, 0xa4506cebde82bde9, 0xbef9a3f7b2c67915, 0xc67178f2e372532b, 0xca273eceea26619c,
+		0xd186b8c721c0c207, 0xeada7dd6cde0eb1e, 0xf57d4f7fee6ed178, 0x06f067aa72176fba, 0x0a637dc5a2c898a6,
+		0x113f9804bef90dae, 0x1b710b35131c471b, 0x28db77f523047d84, 0x32caab7b40c72493, 0x3c9ebe0a15c9bebc,
+		0x431d67c49c100d4c, 0x4cc5d4becb3e42b6, 0x597f299cfc657e2a, 0x5fcb6fab3ad6faec, 0x6c44198c4a475817
+	};
+
+	for (; num_blocks != 0; --num_blocks, data += sha512::block_size) {
+		std::array<uint64_t, 80> w{};
+		for (size_t i = 0; i != 16; ++i) {
+			w[i] = load_be64(data + i * 8);
+		}
+		for (size_t i = 16; i != w.size(); ++i) {
+			uint64_t s0 = std::rotr(w[i - 15], 1) ^ std::rotr(w[i - 15], 8) ^ (w[i - 15] >> 7);
+			uint64_t s1 = std::rotr(w[i - 2], 19) ^ std::rotr(w[i - 2], 61) ^ (w[i - 2] >> 6);
+			w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+		}
+
+		auto v = state;
+
+		for (size_t i = 0; i != w.size(); ++i) {
+			uint64_t s1 = std::rotr(v[4], 14) ^ std::rotr(v[4], 18) ^ std::rotr(v[4], 41);
+			uint64_t ch = (v[4] & v[5]) ^ (~v[4] & v[6]);
+			uint64_t t1 = v[7] + s1 + ch + k[i] + w[i];
+			uint64_t s0 = std::rotr(v[0], 28) ^ std::rotr(v[0], 34) ^ std::rotr(v[0], 39);
+			uint64_t maj = (v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]);
+			uint64_t t2 = s0 + maj;
+			v[7] = v[6];
+			v[6] = v[5];
+			v[5] = v[4];
+			v[4] = v[3] + t1;
+			v[3] = v[2];
+			v[2] = v[1];
+			v[1] = v[0];
+			v[0] = t1 + t2;
+		}
+
+		for (size_t i = 0; i != state.size(); ++i) {
+			state[i] += v[i];
+		}
+	}
+}
+
+utki::span<const sha512::kernel> sha512::get_kernels()
+{
+	static const std::vector<kernel> kernels = {
+		{.name = "generic", .process = &kernels::sha512_generic}
+	};
+
+	return kernels;
+}
+
+sha512::sha512() :
+	sha512(get_kernels().front())
+{}
+
+sha512::sha512(const kernel& k) :
+	process(k.process)
+{
+	this->reset();
+}
+
+void sha512::reset()
+{
+	this->state = {
+		0x6a09e667f3bcc908,
+		0xbb67ae8584caa73b,
+		0x3c6ef372fe94f82b,
+		0xa54ff53a5f1d36f1,
+		0x510e527fade682d1,
+		0x9b05688c2b3e6c1f,
+		0x1f83d9abfb41bd6b,
+		0x5be0cd19137e2179
+	};
+	this->length = 0;
+}
+
+void sha512::update(utki::span<const uint8_t> data)
+{
+	feed(this->buffer, this->length, data, [this](const uint8_t* blocks, size_t num_blocks) {
+		this->process(this->state, blocks, num_blocks);
+	});
+}
+
+std::vector<uint8_t> sha512::save_state() const
+{
+	return save_digest_state(this->state, this->buffer, this->length);
+}
+
+void sha512::load_state(utki::span<const uint8_t> saved)
+{
+	load_digest_state(saved, this->state, this->buffer, this->length);
+}
+
+std::array<uint8_t, sha512::digest_size> sha512::finish()
+{
+	// SHA-512 message length field is 128 bits, upper 64 bits are always zero here
+	pad<true, 2 * sizeof(uint64_t)>(this->buffer, this->length, [this](const uint8_t* blocks, size_t num_blocks) {
+		this->process(this->state, blocks, num_blocks);
+	});
+
+	std::array<uint8_t, digest_size> ret{};
+	for (size_t i = 0; i != this->state.size(); ++i) {
+		store_be(this->state[i], ret.data() + i * sizeof(uint64_t));
+	}
+
+	this->reset();
+	return ret;
+}
+
+// NOLINTEND(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+// NOLINTEND(cppcoreguidelines-avoid-magic-numbers, readability-magic-numbers)
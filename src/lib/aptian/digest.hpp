@@ -0,0 +1,195 @@
+/*
+aptian - apt repository tool
+
+Copyright (C) 2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.*/
+
+/* ================ LICENSE END ================ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include <utki/span.hpp>
+
+namespace aptian {
+
+/**
+ * @brief Block processing function of a digest.
+ * Several implementations of the same digest can exist, e.g. portable one and
+ * the ones using CPU specific instructions. The implementation to use is selected
+ * at runtime based on the CPU capabilities.
+ * @tparam state_type - type of the digest state.
+ */
+template <typename state_type>
+struct digest_kernel {
+	std::string_view name;
+	void (*process)(state_type& state, const uint8_t* blocks, size_t num_blocks);
+};
+
+/**
+ * @brief Streaming message digest calculators.
+ * Each calculator accepts data by calling update() arbitrary number of times,
+ * then the digest is obtained by calling finish(). After finish() the calculator
+ * is reset to initial state and can be reused.
+ * The intermediate state can be saved with save_state() and restored later with load_state()
+ * to continue the calculation, e.g. when more data is appended to a file.
+ * The load_state() throws std::invalid_argument if the saved state is malformed.
+ */
+
+class md5
+{
+public:
+	constexpr static size_t block_size = 64;
+	constexpr static size_t digest_size = 16;
+
+private:
+	std::array<uint32_t, 4> state{};
+	std::array<uint8_t, block_size> buffer{};
+	uint64_t length = 0;
+
+	void reset();
+
+public:
+	md5();
+
+	void update(utki::span<const uint8_t> data);
+
+	std::array<uint8_t, digest_size> finish();
+
+	std::vector<uint8_t> save_state() const;
+
+	void load_state(utki::span<const uint8_t> saved);
+};
+
+class sha1
+{
+public:
+	constexpr static size_t block_size = 64;
+	constexpr static size_t digest_size = 20;
+
+private:
+	std::array<uint32_t, 5> state{};
+	std::array<uint8_t, block_size> buffer{};
+	uint64_t length = 0;
+
+	void reset();
+
+public:
+	sha1();
+
+	void update(utki::span<const uint8_t> data);
+
+	std::array<uint8_t, digest_size> finish();
+
+	std::vector<uint8_t> save_state() const;
+
+	void load_state(utki::span<const uint8_t> saved);
+};
+
+class sha256
+{
+public:
+	constexpr static size_t block_size = 64;
+	constexpr static size_t digest_size = 32;
+
+	using state_type = std::array<uint32_t, 8>;
+	using kernel = digest_kernel<state_type>;
+
+	/**
+	 * @brief Get kernels supported by the CPU.
+	 * @return List of kernels, the fastest one goes first.
+	 */
+	static utki::span<const kernel> get_kernels();
+
+private:
+	decltype(kernel::process) process;
+
+	state_type state{};
+	std::array<uint8_t, block_size> buffer{};
+	uint64_t length = 0;
+
+	void reset();
+
+public:
+	/**
+	 * @brief Create digest calculator using the fastest kernel supported by the CPU.
+	 */
+	sha256();
+
+	/**
+	 * @brief Create digest calculator using specific kernel.
+	 * @param k - kernel to use, must be one of returned by get_kernels().
+	 */
+	sha256(const kernel& k);
+
+	void update(utki::span<const uint8_t> data);
+
+	std::array<uint8_t, digest_size> finish();
+
+	std::vector<uint8_t> save_state() const;
+
+	void load_state(utki::span<const uint8_t> saved);
+};
+
+class sha512
+{
+public:
+	constexpr static size_t block_size = 128;
+	constexpr static size_t digest_size = 64;
+
+	using state_type = std::array<uint64_t, 8>;
+	using kernel = digest_kernel<state_type>;
+
+	/**
+	 * @brief Get kernels supported by the CPU.
+	 * @return List of kernels, the fastest one goes first.
+	 */
+	static utki::span<const kernel> get_kernels();
+
+private:
+	decltype(kernel::process) process;
+
+	state_type state{};
+	std::array<uint8_t, block_size> buffer{};
+	uint64_t length = 0;
+
+	void reset();
+
+public:
+	/**
+	 * @brief Create digest calculator using the fastest kernel supported by the CPU.
+	 */
+	sha512();
+
+	/**
+	 * @brief Create digest calculator using specific kernel.
+	 * @param k - kernel to use, must be one of returned by get_kernels().
+	 */
+	sha512(const kernel& k);
+
+	void update(utki::span<const uint8_t> data);
+
+	std::array<uint8_t, digest_size> finish();
+
+	std::vector<uint8_t> save_state() const;
+
+	void load_state(utki::span<const uint8_t> saved);
+};
+
+} // namespace aptian
@@ -0,0 +1,96 @@
+/*
+aptian - apt repository tool
+
+Copyright (C) 2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.*/
+
+/* ================ LICENSE END ================ */
+
+#include "digest_kernels.hpp"
+
+#ifdef APTIAN_DIGEST_ARM64
+
+#	include <arm_neon.h>
+
+#	ifdef __linux__
+#		include <sys/auxv.h>
+
+#		ifndef HWCAP_SHA2
+#			define HWCAP_SHA2 (1 << 6)
+#		endif
+#	endif
+
+using namespace aptian;
+
+// NOLINTBEGIN(cppcoreguidelines-avoid-magic-numbers, readability-magic-numbers)
+// NOLINTBEGIN(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+
+bool aptian::kernels::is_arm64_sha2_supported()
+{
+#	ifdef __linux__
+	return (getauxval(AT_HWCAP) & HWCAP_SHA2) != 0;
+#	else
+	// all 64-bit ARM CPUs used by Apple support SHA2 instructions
+	return true;
+#	endif
+}
+
+__attribute__((target("arch=armv8-a+crypto"))) void aptian::kernels::sha256_arm64_sha2(
+	sha256::state_type& state,
+	const uint8_t* data,
+	size_t num_blocks
+)
+{
+	uint32x4_t state0 = vld1q_u32(&state[0]); // ABCD
+	uint32x4_t state1 = vld1q_u32(&state[4]); // EFGH
+
+	for (; num_blocks != 0; --num_blocks, data += sha256::block_size) {
+		const uint32x4_t abcd_save = state0;
+		const uint32x4_t efgh_save = state1;
+
+		// NOLINTNEXTLINE(cppcoreguidelines-avoid-c-arrays, modernize-avoid-c-arrays)
+		uint32x4_t msg[4];
+		for (size_t i = 0; i != 4; ++i) {
+			msg[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + i * sizeof(uint32x4_t))));
+		}
+
+		// 16 groups of 4 rounds each
+		for (size_t i = 0; i != 16; ++i) {
+			uint32x4_t& cur = msg[i % 4];
+
+			const uint32x4_t wk = vaddq_u32(cur, vld1q_u32(&sha256_k[i * 4]));
+
+			// calculate message words for group i + 4
+			if (i < 12) {
+				cur = vsha256su1q_u32(vsha256su0q_u32(cur, msg[(i + 1) % 4]), msg[(i + 2) % 4], msg[(i + 3) % 4]);
+			}
+
+			const uint32x4_t abcd = state0;
+			state0 = vsha256hq_u32(state0, state1, wk);
+			state1 = vsha256h2q_u32(state1, abcd, wk);
+		}
+
+		state0 = vaddq_u32(state0, abcd_save);
+		state1 = vaddq_u32(state1, efgh_save);
+	}
+
+	vst1q_u32(&state[0], state0);
+	vst1q_u32(&state[4], state1);
+}
+
+// NOLINTEND(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+// NOLINTEND(cppcoreguidelines-avoid-magic-numbers, readability-magic-numbers)
+
+#endif // ~APTIAN_DIGEST_ARM64
@@ -0,0 +1,53 @@
+/*
+aptian - apt repository tool
+
+Copyright (C) 2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.*/
+
+/* ================ LICENSE END ================ */
+
+#pragma once
+
+#include "digest.hpp"
+
+// Implementations of digest block processing functions.
+// These are internal to the library, use get_kernels() of the digest class to obtain the supported ones.
+
+#if defined(__x86_64__) || defined(__i386__)
+#	define APTIAN_DIGEST_X86 1
+#elif defined(__aarch64__)
+#	define APTIAN_DIGEST_ARM64 1
+#endif
+
+namespace aptian::kernels {
+
+// SHA-256 round constants
+// NOLINTNEXTLINE(cppcoreguidelines-avoid-c-arrays, modernize-avoid-c-arrays)
+extern const uint32_t sha256_k[64];
+
+void sha256_generic(sha256::state_type& state, const uint8_t* data, size_t num_blocks);
+void sha512_generic(sha512::state_type& state, const uint8_t* data, size_t num_blocks);
+
+#ifdef APTIAN_DIGEST_X86
+bool is_x86_sha_ni_supported();
+void sha256_x86_sha_ni(sha256::state_type& state, const uint8_t* data, size_t num_blocks);
+#endif
+
+#ifdef APTIAN_DIGEST_ARM64
+bool is_arm64_sha2_supported();
+void sha256_arm64_sha2(sha256::state_type& state, const uint8_t* data, size_t num_blocks);
+#endif
+
+} // namespace aptian::kernels
@@ -0,0 +1,131 @@
+/*
+aptian - apt repository tool
+
+Copyright (C) 2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.*/
+
+/* ================ LICENSE END ================ */
+
+#include "digest_kernels.hpp"
+
+#ifdef APTIAN_DIGEST_X86
+
+#	include <cpuid.h>
+#	include <immintrin.h>
+
+using namespace aptian;
+
+// NOLINTBEGIN(cppcoreguidelines-avoid-magic-numbers, readability-magic-numbers)
+// NOLINTBEGIN(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+
+bool aptian::kernels::is_x86_sha_ni_supported()
+{
+	unsigned eax = 0;
+	unsigned ebx = 0;
+	unsigned ecx = 0;
+	unsigned edx = 0;
+
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+		return false;
+	}
+
+	constexpr unsigned ssse3_bit = 1 << 9;
+	constexpr unsigned sse4_1_bit = 1 << 19;
+	if ((ecx & ssse3_bit) == 0 || (ecx & sse4_1_bit) == 0) {
+		return false;
+	}
+
+	if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+		return false;
+	}
+
+	constexpr unsigned sha_bit = 1 << 29;
+	return (ebx & sha_bit) != 0;
+}
+
+// The implementation follows the Intel SHA extensions reference code.
+// Message schedule is kept in a ring of 4 registers, each holding 4 message words.
+__attribute__((target("sha,sse4.1,ssse3"))) void aptian::kernels::sha256_x86_sha_ni(
+	sha256::state_type& state,
+	const uint8_t* data,
+	size_t num_blocks
+)
+{
+	// byte order mask to convert big-endian message words to little-endian
+	const __m128i byte_swap_mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+	// SHA-NI instructions operate on state packed as ABEF and CDGH
+	__m128i tmp = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[0]));
+	__m128i state1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[4]));
+
+	tmp = _mm_shuffle_epi32(tmp, 0xb1); // CDAB
+	state1 = _mm_shuffle_epi32(state1, 0x1b); // EFGH
+	__m128i state0 = _mm_alignr_epi8(tmp, state1, 8); // ABEF
+	state1 = _mm_blend_epi16(state1, tmp, 0xf0); // CDGH
+
+	for (; num_blocks != 0; --num_blocks, data += sha256::block_size) {
+		const __m128i abef_save = state0;
+		const __m128i cdgh_save = state1;
+
+		// NOLINTNEXTLINE(cppcoreguidelines-avoid-c-arrays, modernize-avoid-c-arrays)
+		__m128i msg[4];
+		for (size_t i = 0; i != 4; ++i) {
+			msg[i] = _mm_shuffle_epi8(
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i * sizeof(__m128i))),
+				byte_swap_mask
+			);
+		}
+
+		// 16 groups of 4 rounds each
+		for (size_t i = 0; i != 16; ++i) {
+			__m128i& cur = msg[i % 4];
+
+			__m128i wk = _mm_add_epi32(cur, _mm_load_si128(reinterpret_cast<const __m128i*>(&sha256_k[i * 4])));
+			state1 = _mm_sha256rnds2_epu32(state1, state0, wk);
+
+			// calculate message words for group i + 1
+			if (i >= 3 && i < 15) {
+				__m128i& next = msg[(i + 1) % 4];
+				next = _mm_add_epi32(next, _mm_alignr_epi8(cur, msg[(i + 3) % 4], 4));
+				next = _mm_sha256msg2_epu32(next, cur);
+			}
+
+			wk = _mm_shuffle_epi32(wk, 0x0e);
+			state0 = _mm_sha256rnds2_epu32(state0, state1, wk);
+
+			// start calculation of message words for group i + 3
+			if (i >= 1 && i < 13) {
+				__m128i& prev = msg[(i + 3) % 4];
+				prev = _mm_sha256msg1_epu32(prev, cur);
+			}
+		}
+
+		state0 = _mm_add_epi32(state0, abef_save);
+		state1 = _mm_add_epi32(state1, cdgh_save);
+	}
+
+	tmp = _mm_shuffle_epi32(state0, 0x1b); // FEBA
+	state1 = _mm_shuffle_epi32(state1, 0xb1); // DCHG
+	state0 = _mm_blend_epi16(tmp, state1, 0xf0); // DCBA
+	state1 = _mm_alignr_epi8(state1, tmp, 8); // HGFE
+
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(&state[0]), state0);
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(&state[4]), state1);
+}
+
+// NOLINTEND(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+// NOLINTEND(cppcoreguidelines-avoid-magic-numbers, readability-magic-numbers)
+
+#endif // ~APTIAN_DIGEST_X86
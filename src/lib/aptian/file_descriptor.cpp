@@ -0,0 +1,42 @@
+/*
+aptian - apt repository tool
+
+Copyright (C) 2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.*/
+
+/* ================ LICENSE END ================ */
+
+#include "file_descriptor.hpp"
+
+#include <cerrno>
+#include <string>
+#include <system_error>
+
+#include <unistd.h>
+
+using namespace aptian;
+
+file_descriptor::file_descriptor(int fd, std::string_view error_message) :
+	fd(fd)
+{
+	if (this->fd < 0) {
+		throw std::system_error(errno, std::generic_category(), std::string(error_message));
+	}
+}
+
+file_descriptor::~file_descriptor()
+{
+	close(this->fd);
+}
@@ -0,0 +1,54 @@
+/*
+aptian - apt repository tool
+
+Copyright (C) 2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.*/
+
+/* ================ LICENSE END ================ */
+
+#pragma once
+
+#include <string_view>
+
+namespace aptian {
+
+/**
+ * @brief Owner of POSIX file descriptor.
+ * Closes the file descriptor on destruction.
+ */
+class file_descriptor
+{
+public:
+	const int fd;
+
+	/**
+	 * @brief Take ownership of file descriptor.
+	 * Intended to wrap a call returning file descriptor, like open() or socket().
+	 * @param fd - file descriptor to own, negative value means that the call returning it has failed.
+	 * @param error_message - error message in case the call returning the file descriptor has failed.
+	 * @throw std::system_error - in case the fd is negative, the error code is taken from errno.
+	 */
+	file_descriptor(int fd, std::string_view error_message);
+
+	file_descriptor(const file_descriptor&) = delete;
+	file_descriptor& operator=(const file_descriptor&) = delete;
+
+	file_descriptor(file_descriptor&&) = delete;
+	file_descriptor& operator=(file_descriptor&&) = delete;
+
+	~file_descriptor();
+};
+
+} // namespace aptian
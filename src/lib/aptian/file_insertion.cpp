@@ -0,0 +1,218 @@
+/*
+aptian - apt repository tool
+
+Copyright (C) 2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.*/
+
+/* ================ LICENSE END ================ */
+
+#include "file_insertion.hpp"
+
+#include <array>
+#include <cerrno>
+#include <filesystem>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utki/string.hpp>
+
+#include "file_descriptor.hpp"
+
+using namespace std::string_view_literals;
+
+using namespace aptian;
+
+namespace {
+constexpr std::string_view tmp_file_suffix = ".new"sv;
+} // namespace
+
+std::string_view aptian::to_string(insertion_method method)
+{
+	switch (method) {
+		case insertion_method::copy:
+			return "copy"sv;
+		case insertion_method::hardlink:
+			return "hardlink"sv;
+		case insertion_method::move:
+			return "move"sv;
+		case insertion_method::enum_size:
+			break;
+	}
+	throw std::invalid_argument("to_string(): unknown insertion method");
+}
+
+insertion_method aptian::to_insertion_method(std::string_view name)
+{
+	for (size_t i = 0; i != size_t(insertion_method::enum_size); ++i) {
+		auto method = insertion_method(i);
+		if (to_string(method) == name) {
+			return method;
+		}
+	}
+	throw std::invalid_argument(utki::cat("unknown file insertion method: ", name));
+}
+
+namespace {
+// Copy with read()/write() through user space buffer.
+void copy_data(int src, int dst, const std::string& dst_path)
+{
+	constexpr size_t buffer_size = 0x40000;
+	std::vector<uint8_t> buffer(buffer_size);
+
+	for (;;) {
+		auto num_read = read(src, buffer.data(), buffer.size());
+		if (num_read < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			throw std::system_error(errno, std::generic_category(), "could not read file");
+		}
+		if (num_read == 0) {
+			return;
+		}
+
+		for (ssize_t num_written = 0; num_written != num_read;) {
+			auto res = write(dst, buffer.data() + num_written, size_t(num_read - num_written));
+			if (res < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				throw std::system_error(errno, std::generic_category(), utki::cat("could not write file ", dst_path));
+			}
+			num_written += res;
+		}
+	}
+}
+
+// Copy in kernel, without passing the data through user space.
+// Returns false if copy_file_range() is not supported for the files.
+bool copy_file_range_data(int src, int dst, const std::string& dst_path)
+{
+	bool copied_any = false;
+	for (;;) {
+		constexpr size_t max_chunk_size = 0x40000000;
+		auto res = copy_file_range(src, nullptr, dst, nullptr, max_chunk_size, 0);
+		if (res < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (!copied_any &&
+				(errno == EXDEV || errno == ENOSYS || errno == EOPNOTSUPP || errno == EINVAL || errno == EPERM))
+			{
+				return false;
+			}
+			throw std::system_error(errno, std::generic_category(), utki::cat("could not copy to file ", dst_path));
+		}
+		if (res == 0) {
+			return true;
+		}
+		copied_any = true;
+	}
+}
+
+void copy_file(const std::string& src, const std::string& dst)
+{
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg, "POSIX API")
+	file_descriptor src_file(open(src.c_str(), O_RDONLY | O_CLOEXEC), utki::cat("could not open file ", src));
+
+	// NOLINTNEXTLINE(hicpp-signed-bitwise)
+	constexpr mode_t file_mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH;
+
+	file_descriptor dst_file(
+		// NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg, hicpp-signed-bitwise, "POSIX API")
+		open(dst.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, file_mode),
+		utki::cat("could not create file ", dst)
+	);
+
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg, hicpp-signed-bitwise, "POSIX API")
+	if (ioctl(dst_file.fd, FICLONE, src_file.fd) == 0) {
+		return;
+	}
+
+	if (copy_file_range_data(src_file.fd, dst_file.fd, dst)) {
+		return;
+	}
+
+	copy_data(src_file.fd, dst_file.fd, dst);
+}
+
+// Copy the file to temporary file and then hard link it to the destination path.
+// link() is used instead of rename(), because rename() replaces the destination
+// file if it exists, e.g. if it was inserted by concurrent 'add' after the
+// destination path was checked.
+void copy_file_atomically(const std::string& src, const std::string& dst)
+{
+	auto tmp_path = utki::cat(dst, tmp_file_suffix);
+	std::filesystem::remove(tmp_path);
+
+	try {
+		copy_file(src, tmp_path);
+
+		if (link(tmp_path.c_str(), dst.c_str()) != 0) {
+			throw std::system_error(errno, std::generic_category(), utki::cat("could not create file ", dst));
+		}
+	} catch (...) {
+		std::error_code ec;
+		std::filesystem::remove(tmp_path, ec);
+		throw;
+	}
+
+	std::filesystem::remove(tmp_path);
+}
+} // namespace
+
+void aptian::insert_file(std::string_view src, std::string_view dst, insertion_method method)
+{
+	auto src_path = std::string(src);
+	auto dst_path = std::string(dst);
+
+	switch (method) {
+		case insertion_method::hardlink:
+			if (link(src_path.c_str(), dst_path.c_str()) == 0) {
+				return;
+			}
+			if (errno != EXDEV && errno != EPERM && errno != EMLINK) {
+				throw std::system_error(
+					errno,
+					std::generic_category(),
+					utki::cat("could not create hard link ", dst, " to ", src)
+				);
+			}
+			break;
+		case insertion_method::move:
+			// link() does not replace the destination file if it exists, unlike rename()
+			if (link(src_path.c_str(), dst_path.c_str()) == 0) {
+				std::filesystem::remove(src_path);
+				return;
+			}
+			if (errno != EXDEV && errno != EPERM && errno != EMLINK) {
+				throw std::system_error(errno, std::generic_category(), utki::cat("could not move ", src, " to ", dst));
+			}
+			copy_file_atomically(src_path, dst_path);
+			std::filesystem::remove(src_path);
+			return;
+		case insertion_method::copy:
+		case insertion_method::enum_size:
+			break;
+	}
+
+	copy_file_atomically(src_path, dst_path);
+}
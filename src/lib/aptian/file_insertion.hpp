@@ -0,0 +1,71 @@
+/*
+aptian - apt repository tool
+
+Copyright (C) 2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.*/
+
+/* ================ LICENSE END ================ */
+
+#pragma once
+
+#include <string_view>
+
+namespace aptian {
+
+/**
+ * @brief Method of putting a file to its destination.
+ */
+enum class insertion_method {
+	// Copy the file. Reflink (FICLONE) is tried first, which shares the data extents on copy-on-write
+	// file systems like btrfs and XFS, then in-kernel copy_file_range(), then plain read/write copy.
+	copy,
+
+	// Make a hard link to the source file, falls back to copy if the source is on a different file system.
+	// Note, that modifying the source file in place then modifies the destination file as well.
+	hardlink,
+
+	// Move the source file, falls back to copy and removing the source if the source is on a different file system.
+	move,
+
+	enum_size
+};
+
+/**
+ * @brief Get name of the insertion method.
+ * @param method - insertion method.
+ * @return Name of the method, e.g. "copy".
+ */
+std::string_view to_string(insertion_method method);
+
+/**
+ * @brief Parse insertion method name.
+ * @param name - insertion method name, one of 'copy', 'hardlink' or 'move'.
+ * @return Insertion method.
+ * @throw std::invalid_argument - in case of unknown insertion method name.
+ */
+insertion_method to_insertion_method(std::string_view name);
+
+/**
+ * @brief Put file to its destination.
+ * The destination file appears atomically, i.e. it is never seen partially written.
+ * @param src - path to the source file.
+ * @param dst - path to the destination file, must not exist.
+ *              The existing destination file is never replaced, with any insertion method.
+ * @param method - insertion method.
+ * @throw std::system_error - in case of file system errors, including existing destination file.
+ */
+void insert_file(std::string_view src, std::string_view dst, insertion_method method);
+
+} // namespace aptian
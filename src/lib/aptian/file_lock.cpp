@@ -0,0 +1,60 @@
+/*
+aptian - apt repository tool
+
+Copyright (C) 2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.*/
+
+/* ================ LICENSE END ================ */
+
+#include "file_lock.hpp"
+
+#include <cerrno>
+#include <filesystem>
+#include <string>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#include <fsif/native_file.hpp>
+#include <utki/string.hpp>
+
+using namespace aptian;
+
+namespace {
+int open_lock_file(std::string_view path)
+{
+	std::filesystem::create_directories(fsif::dir(path));
+
+	// NOLINTNEXTLINE(hicpp-signed-bitwise)
+	constexpr mode_t file_mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH;
+
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg, hicpp-signed-bitwise, "POSIX API")
+	return open(std::string(path).c_str(), O_RDWR | O_CREAT | O_CLOEXEC, file_mode);
+}
+} // namespace
+
+file_lock::file_lock(std::string_view path, mode m) :
+	file(open_lock_file(path), utki::cat("could not open lock file ", path))
+{
+	int operation = m == mode::shared ? LOCK_SH : LOCK_EX;
+
+	while (flock(this->file.fd, operation) != 0) {
+		if (errno != EINTR) {
+			throw std::system_error(errno, std::generic_category(), utki::cat("could not lock file ", path));
+		}
+	}
+}
@@ -0,0 +1,66 @@
+/*
+aptian - apt repository tool
+
+Copyright (C) 2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.*/
+
+/* ================ LICENSE END ================ */
+
+#pragma once
+
+#include <string_view>
+
+#include "file_descriptor.hpp"
+
+namespace aptian {
+
+/**
+ * @brief Advisory lock of a file.
+ * Uses flock(), so the lock is held by the open file description and is released
+ * when the lock object is destroyed or the process exits, even abnormally.
+ * Intended to serialize modifications of the repository files by concurrent aptian processes.
+ */
+class file_lock
+{
+	const file_descriptor file;
+
+public:
+	enum class mode {
+		// several processes can hold shared lock at the same time
+		shared,
+
+		// only one process can hold exclusive lock, no shared locks are held meanwhile
+		exclusive
+	};
+
+	/**
+	 * @brief Acquire lock.
+	 * Blocks until the lock is acquired.
+	 * @param path - path to the lock file. The file and its directory are created if those do not exist.
+	 * @param m - lock mode.
+	 * @throw std::system_error - in case the lock file cannot be opened or locked.
+	 */
+	file_lock(std::string_view path, mode m = mode::exclusive);
+
+	file_lock(const file_lock&) = delete;
+	file_lock& operator=(const file_lock&) = delete;
+
+	file_lock(file_lock&&) = delete;
+	file_lock& operator=(file_lock&&) = delete;
+
+	~file_lock() = default;
+};
+
+} // namespace aptian
@@ -0,0 +1,57 @@
+/*
+aptian - apt repository tool
+
+Copyright (C) 2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.*/
+
+/* ================ LICENSE END ================ */
+
+#include "file_stat.hpp"
+
+#include <cerrno>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+#include <sys/stat.h>
+#include <utki/string.hpp>
+
+using namespace aptian;
+
+std::optional<file_stat> aptian::get_file_stat(std::string_view path)
+{
+	struct stat st {};
+
+	if (stat(std::string(path).c_str(), &st) != 0) {
+		if (errno == ENOENT) {
+			return std::nullopt;
+		}
+		throw std::system_error(errno, std::generic_category(), utki::cat("stat() failed for ", path));
+	}
+
+#if defined(__APPLE__)
+	const auto& mtime = st.st_mtimespec;
+#else
+	const auto& mtime = st.st_mtim;
+#endif
+
+	constexpr int64_t nanoseconds_in_second = 1000000000;
+
+	return file_stat{
+		.size = uint64_t(st.st_size),
+		.mtime_ns = int64_t(mtime.tv_sec) * nanoseconds_in_second + int64_t(mtime.tv_nsec),
+		.inode = uint64_t(st.st_ino)
+	};
+}
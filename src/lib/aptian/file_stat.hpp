@@ -0,0 +1,49 @@
+/*
+aptian - apt repository tool
+
+Copyright (C) 2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.*/
+
+/* ================ LICENSE END ================ */
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+namespace aptian {
+
+/**
+ * @brief File identity information.
+ * Used to detect if a file was changed since it was last seen.
+ */
+struct file_stat {
+	uint64_t size;
+	int64_t mtime_ns; // modification time in nanoseconds since epoch
+	uint64_t inode;
+
+	bool operator==(const file_stat&) const = default;
+};
+
+/**
+ * @brief Get file stat information.
+ * @param path - path to the file.
+ * @return File stat information.
+ * @return std::nullopt if the file does not exist.
+ */
+std::optional<file_stat> get_file_stat(std::string_view path);
+
+} // namespace aptian
@@ -0,0 +1,253 @@
+/*
+aptian - apt repository tool
+
+Copyright (C) 2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.*/
+
+/* ================ LICENSE END ================ */
+
+#include "hash_cache.hpp"
+
+#include <charconv>
+#include <filesystem>
+
+#include <fsif/native_file.hpp>
+#include <tml/tree.hpp>
+#include <utki/string.hpp>
+
+using namespace std::string_literals;
+using namespace std::string_view_literals;
+
+using namespace aptian;
+
+/*
+The cache file format is TML:
+
+<file-path>{
+	size{<size>}
+	mtime{<modification time in ns>}
+	inode{<inode number>}
+	md5{<md5>}
+	sha1{<sha1>}
+	sha256{<sha256>}
+	sha512{<sha512>}
+	state{<hasher state>}
+}
+...
+*/
+
+namespace {
+constexpr std::string_view size_key = "size"sv;
+constexpr std::string_view mtime_key = "mtime"sv;
+constexpr std::string_view inode_key = "inode"sv;
+constexpr std::string_view md5_key = "md5"sv;
+constexpr std::string_view sha1_key = "sha1"sv;
+constexpr std::string_view sha256_key = "sha256"sv;
+constexpr std::string_view sha512_key = "sha512"sv;
+constexpr std::string_view hasher_state_key = "state"sv;
+} // namespace
+
+namespace {
+template <typename number_type>
+number_type parse_number(std::string_view str)
+{
+	number_type ret = 0;
+	auto res = std::from_chars(str.data(), str.data() + str.size(), ret);
+	if (res.ec != std::errc() || res.ptr != str.data() + str.size()) {
+		throw std::invalid_argument(utki::cat("malformed number: ", str));
+	}
+	return ret;
+}
+
+hash_cache::file_info parse_entry(const tml::forest& properties)
+{
+	hash_cache::file_info ret{};
+
+	for (const auto& p : properties) {
+		if (p.children.size() != 1) {
+			throw std::invalid_argument(utki::cat("malformed cache entry property: ", p.value.string));
+		}
+		const auto& key = p.value.string;
+		const auto& value = p.children.front().value.string;
+
+		if (key == size_key) {
+			ret.stat.size = parse_number<uint64_t>(value);
+		} else if (key == mtime_key) {
+			ret.stat.mtime_ns = parse_number<int64_t>(value);
+		} else if (key == inode_key) {
+			ret.stat.inode = parse_number<uint64_t>(value);
+		} else if (key == md5_key) {
+			ret.hashes.md5 = value;
+		} else if (key == sha1_key) {
+			ret.hashes.sha1 = value;
+		} else if (key == sha256_key) {
+			ret.hashes.sha256 = value;
+		} else if (key == sha512_key) {
+			ret.hashes.sha512 = value;
+		} else if (key == hasher_state_key) {
+			ret.hasher_state = value;
+		}
+	}
+
+	if (ret.hashes.md5.empty() || ret.hashes.sha1.empty() || ret.hashes.sha256.empty() || ret.hashes.sha512.empty()) {
+		throw std::invalid_argument("cache entry does not have all hash sums");
+	}
+
+	return ret;
+}
+} // namespace
+
+hash_cache::hash_cache(std::string cache_file_path, std::string base_dir) :
+	cache_file_path(std::move(cache_file_path)),
+	base_dir(std::move(base_dir))
+{
+	fsif::native_file file(this->cache_file_path);
+	if (!file.exists()) {
+		return;
+	}
+
+	try {
+		for (const auto& t : tml::read(file)) {
+			this->entries.insert_or_assign(t.value.string, entry{.info = parse_entry(t.children)});
+		}
+	} catch (std::exception& e) {
+		// the cache is just an optimization, so in case it is corrupted, start with empty cache
+		this->entries.clear();
+		this->changed = true;
+	}
+}
+
+const hash_cache::file_info& hash_cache::get(std::string_view path)
+{
+	auto full_path = utki::cat(this->base_dir, path);
+
+	auto stat = get_file_stat(full_path);
+	if (!stat.has_value()) {
+		throw std::invalid_argument(utki::cat("file not found: ", path));
+	}
+
+	auto i = this->entries.find(path);
+	if (i != this->entries.end() && i->second.info.stat == stat.value()) {
+		i->second.used = true;
+		return i->second.info;
+	}
+
+	hasher h;
+	h.update(fsif::native_file(full_path));
+	auto hasher_state = h.save_state();
+	auto hashes = h.finish();
+
+	// in case the file was changed while it was being hashed, the hash sums are not valid
+	auto stat_after = get_file_stat(full_path);
+	if (stat_after != stat) {
+		throw std::runtime_error(utki::cat("file was modified while calculating its hash sums: ", path));
+	}
+
+	this->changed = true;
+
+	auto res = this->entries.insert_or_assign(
+		std::string(path),
+		entry{
+			.info =
+				{.stat = stat.value(), .hashes = std::move(hashes), .hasher_state = std::move(hasher_state)},
+			.used = true
+		}
+	);
+	return res.first->second.info;
+}
+
+const hash_cache::file_info* hash_cache::get_if_cached(std::string_view path)
+{
+	auto i = this->entries.find(path);
+	if (i == this->entries.end()) {
+		return nullptr;
+	}
+
+	auto stat = get_file_stat(utki::cat(this->base_dir, path));
+	if (stat != i->second.info.stat) {
+		return nullptr;
+	}
+
+	i->second.used = true;
+	return &i->second.info;
+}
+
+void hash_cache::put(std::string_view path, file_hashes hashes, std::string hasher_state)
+{
+	auto stat = get_file_stat(utki::cat(this->base_dir, path));
+	if (!stat.has_value()) {
+		throw std::invalid_argument(utki::cat("file not found: ", path));
+	}
+
+	this->changed = true;
+
+	this->entries.insert_or_assign(
+		std::string(path),
+		entry{
+			.info =
+				{.stat = stat.value(), .hashes = std::move(hashes), .hasher_state = std::move(hasher_state)},
+			.used = true
+		}
+	);
+}
+
+void hash_cache::save()
+{
+	tml::forest forest;
+
+	for (auto i = this->entries.begin(); i != this->entries.end();) {
+		if (!i->second.used) {
+			// the file was not accessed, it was probably removed from the repository
+			i = this->entries.erase(i);
+			this->changed = true;
+			continue;
+		}
+
+		const auto& info = i->second.info;
+
+		tml::forest properties{
+			tml::tree(size_key, {tml::tree(utki::cat(info.stat.size))}),
+			tml::tree(mtime_key, {tml::tree(utki::cat(info.stat.mtime_ns))}),
+			tml::tree(inode_key, {tml::tree(utki::cat(info.stat.inode))}),
+			tml::tree(md5_key, {tml::tree(info.hashes.md5)}),
+			tml::tree(sha1_key, {tml::tree(info.hashes.sha1)}),
+			tml::tree(sha256_key, {tml::tree(info.hashes.sha256)}),
+			tml::tree(sha512_key, {tml::tree(info.hashes.sha512)})
+		};
+		if (!info.hasher_state.empty()) {
+			properties.emplace_back(hasher_state_key, tml::forest{tml::tree(info.hasher_state)});
+		}
+
+		forest.emplace_back(i->first, std::move(properties));
+
+		// in case the cache lives on, the entry has to be accessed again before the next save() to be kept
+		i->second.used = false;
+
+		++i;
+	}
+
+	if (!this->changed) {
+		return;
+	}
+
+	std::filesystem::create_directories(fsif::dir(this->cache_file_path));
+
+	// write to temporary file and then rename it to make the cache update atomic
+	auto tmp_path = utki::cat(this->cache_file_path, ".new"sv);
+	tml::write(forest, fsif::native_file(tmp_path));
+	std::filesystem::rename(tmp_path, this->cache_file_path);
+
+	this->changed = false;
+}
@@ -0,0 +1,112 @@
+/*
+aptian - apt repository tool
+
+Copyright (C) 2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.*/
+
+/* ================ LICENSE END ================ */
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <string_view>
+
+#include "file_stat.hpp"
+#include "hasher.hpp"
+
+namespace aptian {
+
+/**
+ * @brief Persistent cache of file hash sums.
+ * The cache entries are keyed by file path relative to the base directory and are valid as long as file's
+ * size, modification time and inode number do not change.
+ * The cache is loaded from file on construction and stored to the file by save().
+ */
+class hash_cache
+{
+public:
+	struct file_info {
+		file_stat stat;
+		file_hashes hashes;
+
+		// hasher state after hashing the whole file, allows appending to the file without reading it back
+		std::string hasher_state;
+	};
+
+private:
+	struct entry {
+		file_info info;
+
+		// whether the entry was accessed since the cache was loaded
+		bool used = false;
+	};
+
+	std::string cache_file_path;
+	std::string base_dir;
+
+	std::map<std::string, entry, std::less<>> entries;
+
+	bool changed = false;
+
+public:
+	/**
+	 * @brief Constructor.
+	 * @param cache_file_path - path to the cache file. If the file does not exist or cannot be read,
+	 *                          the cache starts empty.
+	 * @param base_dir - directory relative to which the file paths are given.
+	 */
+	hash_cache(std::string cache_file_path, std::string base_dir);
+
+	/**
+	 * @brief Get hash sums of a file.
+	 * The hash sums are calculated only if the file is not in the cache or
+	 * if it has changed since it was cached.
+	 * @param path - path to the file relative to the base directory.
+	 * @return File stat and hash sums.
+	 * @throw std::invalid_argument - if the file does not exist.
+	 */
+	const file_info& get(std::string_view path);
+
+	/**
+	 * @brief Get cached hash sums of a file.
+	 * Unlike get(), the hash sums are never calculated.
+	 * @param path - path to the file relative to the base directory.
+	 * @return Pointer to file stat and hash sums, or nullptr if the file does not exist,
+	 *         is not in the cache or has changed since it was cached.
+	 */
+	const file_info* get_if_cached(std::string_view path);
+
+	/**
+	 * @brief Put hash sums of a file to the cache.
+	 * Used for files whose hash sums were calculated while writing them,
+	 * so that those files do not need to be read back to calculate the hash sums.
+	 * @param path - path to the file relative to the base directory.
+	 * @param hashes - hash sums of the file contents.
+	 * @param hasher_state - hasher state after hashing the file contents, see hasher::save_state().
+	 * @throw std::invalid_argument - if the file does not exist.
+	 */
+	void put(std::string_view path, file_hashes hashes, std::string hasher_state);
+
+	/**
+	 * @brief Save cache to the file.
+	 * Entries which were not accessed with get() or put() since the cache was loaded
+	 * or previously saved are dropped.
+	 * Nothing is written if the cache did not change.
+	 */
+	void save();
+};
+
+} // namespace aptian
@@ -0,0 +1,149 @@
+/*
+aptian - apt repository tool
+
+Copyright (C) 2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.*/
+
+/* ================ LICENSE END ================ */
+
+#include "hasher.hpp"
+
+#include <charconv>
+#include <stdexcept>
+#include <vector>
+
+#include <utki/string.hpp>
+
+using namespace aptian;
+
+namespace {
+std::string to_hex(utki::span<const uint8_t> digest)
+{
+	constexpr std::string_view hex_digits = "0123456789abcdef";
+
+	std::string ret;
+	ret.reserve(digest.size() * 2);
+	for (auto b : digest) {
+		// NOLINTNEXTLINE(cppcoreguidelines-avoid-magic-numbers, readability-magic-numbers)
+		ret.push_back(hex_digits[b >> 4]);
+		// NOLINTNEXTLINE(cppcoreguidelines-avoid-magic-numbers, readability-magic-numbers)
+		ret.push_back(hex_digits[b & 0xf]);
+	}
+	return ret;
+}
+
+std::vector<uint8_t> from_hex(std::string_view hex)
+{
+	if (hex.size() % 2 != 0) {
+		throw std::invalid_argument("from_hex(): odd number of hex digits");
+	}
+
+	std::vector<uint8_t> ret;
+	ret.reserve(hex.size() / 2);
+	for (size_t i = 0; i != hex.size(); i += 2) {
+		uint8_t b = 0;
+		auto res = std::from_chars(hex.data() + i, hex.data() + i + 2, b, 16); // NOLINT
+		if (res.ec != std::errc() || res.ptr != hex.data() + i + 2) {
+			throw std::invalid_argument(utki::cat("from_hex(): malformed hex string: ", hex));
+		}
+		ret.push_back(b);
+	}
+	return ret;
+}
+} // namespace
+
+void hasher::update(utki::span<const uint8_t> data)
+{
+	this->md5.update(data);
+	this->sha1.update(data);
+	this->sha256.update(data);
+	this->sha512.update(data);
+
+	this->size += data.size();
+}
+
+file_hashes hasher::finish()
+{
+	this->size = 0;
+
+	return {
+		.md5 = to_hex(this->md5.finish()),
+		.sha1 = to_hex(this->sha1.finish()),
+		.sha256 = to_hex(this->sha256.finish()),
+		.sha512 = to_hex(this->sha512.finish())
+	};
+}
+
+std::string hasher::save_state() const
+{
+	// the data size is stored within the digest states
+	return utki::cat(
+		to_hex(this->md5.save_state()),
+		':',
+		to_hex(this->sha1.save_state()),
+		':',
+		to_hex(this->sha256.save_state()),
+		':',
+		to_hex(this->sha512.save_state())
+	);
+}
+
+void hasher::load_state(std::string_view saved)
+{
+	auto parts = utki::split(saved, ':');
+	if (parts.size() != 4) {
+		throw std::invalid_argument("hasher::load_state(): malformed state");
+	}
+
+	this->md5.load_state(from_hex(parts[0]));
+	this->sha1.load_state(from_hex(parts[1]));
+	this->sha256.load_state(from_hex(parts[2]));
+
+	auto sha512_state = from_hex(parts[3]);
+	this->sha512.load_state(sha512_state);
+
+	// digest state begins with little-endian data length
+	uint64_t length = 0;
+	for (size_t i = 0; i != sizeof(length); ++i) {
+		length |= uint64_t(sha512_state[i]) << (i * 8); // NOLINT
+	}
+	this->size = length;
+}
+
+void hasher::update(const fsif::file& fi)
+{
+	fsif::file::guard file_guard(fi, fsif::mode::read);
+
+	// big enough to make the reading efficient, while each chunk still fits into L2 cache
+	// when fed to all the digests one after another
+	constexpr auto read_buffer_size = 0x40000;
+	std::vector<uint8_t> buf(read_buffer_size);
+
+	for (;;) {
+		auto num_bytes_read = fi.read(buf);
+		if (num_bytes_read == 0) {
+			// EOF reached
+			break;
+		}
+		this->update(utki::make_span(buf.data(), num_bytes_read));
+	}
+}
+
+file_hashes aptian::get_file_hashes(const fsif::file& fi)
+{
+	hasher h;
+	h.update(fi);
+	return h.finish();
+}
@@ -0,0 +1,110 @@
+/*
+aptian - apt repository tool
+
+Copyright (C) 2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.*/
+
+/* ================ LICENSE END ================ */
+
+#pragma once
+
+#include <string>
+
+#include <fsif/file.hpp>
+#include <utki/span.hpp>
+
+#include "digest.hpp"
+
+namespace aptian {
+
+struct file_hashes {
+	std::string md5;
+	std::string sha1;
+	std::string sha256;
+	std::string sha512;
+
+	bool operator==(const file_hashes& h) const
+	{
+		return //
+			this->md5 == h.md5 && //
+			this->sha1 == h.sha1 && //
+			this->sha256 == h.sha256 && //
+			this->sha512 == h.sha512;
+	}
+};
+
+/**
+ * @brief Calculator of all hash sums needed for APT repository index files.
+ * Feeds same data to md5, sha1, sha256 and sha512 digests at once,
+ * so that the data needs to be read only once.
+ */
+class hasher
+{
+	aptian::md5 md5;
+	aptian::sha1 sha1;
+	aptian::sha256 sha256;
+	aptian::sha512 sha512;
+
+	uint64_t size = 0;
+
+public:
+	void update(utki::span<const uint8_t> data);
+
+	/**
+	 * @brief Feed whole file contents to the hasher.
+	 * @param fi - file to read.
+	 */
+	void update(const fsif::file& fi);
+
+	/**
+	 * @brief Get number of bytes fed to the hasher so far.
+	 */
+	uint64_t get_size() const noexcept
+	{
+		return this->size;
+	}
+
+	/**
+	 * @brief Finish calculation of the hash sums.
+	 * After the call the hasher is reset to initial state.
+	 * @return Hex-encoded hash sums of the data.
+	 */
+	file_hashes finish();
+
+	/**
+	 * @brief Save intermediate state.
+	 * The saved state allows continuing the calculation later, e.g. when more data
+	 * is appended to a file, without feeding the already hashed data again.
+	 * @return Text representation of the state.
+	 */
+	std::string save_state() const;
+
+	/**
+	 * @brief Restore intermediate state.
+	 * @param saved - state returned by save_state().
+	 * @throw std::invalid_argument - if the saved state is malformed.
+	 */
+	void load_state(std::string_view saved);
+};
+
+/**
+ * @brief Calculate hash sums of a file.
+ * The file is read only once.
+ * @param fi - file to calculate hash sums of.
+ * @return Hex-encoded hash sums of the file contents.
+ */
+file_hashes get_file_hashes(const fsif::file& fi);
+
+} // namespace aptian
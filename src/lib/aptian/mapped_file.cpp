@@ -0,0 +1,78 @@
+/*
+aptian - apt repository tool
+
+Copyright (C) 2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.*/
+
+/* ================ LICENSE END ================ */
+
+#include "mapped_file.hpp"
+
+#include <cerrno>
+#include <string>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utki/string.hpp>
+
+using namespace aptian;
+
+mapped_file::mapped_file(std::string_view path)
+{
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg, "POSIX API")
+	int fd = open(std::string(path).c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		throw std::system_error(errno, std::generic_category(), utki::cat("could not open file ", path));
+	}
+
+	struct stat st {};
+	if (fstat(fd, &st) != 0) {
+		auto error = errno;
+		close(fd);
+		throw std::system_error(error, std::generic_category(), utki::cat("fstat() failed for ", path));
+	}
+
+	// zero length mapping is not allowed
+	if (st.st_size == 0) {
+		close(fd);
+		return;
+	}
+
+	auto size = size_t(st.st_size);
+
+	void* addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+	// the mapping stays valid after the file descriptor is closed
+	auto error = errno;
+	close(fd);
+
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-cstyle-cast, performance-no-int-to-ptr, "MAP_FAILED is a macro")
+	if (addr == MAP_FAILED) {
+		throw std::system_error(error, std::generic_category(), utki::cat("mmap() failed for ", path));
+	}
+
+	this->data = utki::make_span(static_cast<const uint8_t*>(addr), size);
+}
+
+mapped_file::~mapped_file()
+{
+	if (!this->data.empty()) {
+		// NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast, "munmap() API is not const correct")
+		munmap(const_cast<uint8_t*>(this->data.data()), this->data.size());
+	}
+}
@@ -0,0 +1,61 @@
+/*
+aptian - apt repository tool
+
+Copyright (C) 2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.*/
+
+/* ================ LICENSE END ================ */
+
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+#include <utki/span.hpp>
+
+namespace aptian {
+
+/**
+ * @brief Read-only memory mapping of a whole file.
+ * The file contents are accessed directly in the page cache, without copying
+ * to a user space buffer.
+ */
+class mapped_file
+{
+	utki::span<const uint8_t> data;
+
+public:
+	/**
+	 * @brief Map file to memory.
+	 * @param path - path to the file.
+	 * @throw std::system_error - in case the file could not be opened or mapped.
+	 */
+	mapped_file(std::string_view path);
+
+	mapped_file(const mapped_file&) = delete;
+	mapped_file& operator=(const mapped_file&) = delete;
+
+	mapped_file(mapped_file&&) = delete;
+	mapped_file& operator=(mapped_file&&) = delete;
+
+	~mapped_file();
+
+	utki::span<const uint8_t> span() const noexcept
+	{
+		return this->data;
+	}
+};
+
+} // namespace aptian
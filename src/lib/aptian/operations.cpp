@@ -20,9 +20,19 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.*/
 
 #include "operations.hpp"
 
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <filesystem>
 #include <iostream>
 #include <map>
+#include <optional>
+#include <set>
+#include <system_error>
+#include <unordered_set>
 
 #include <fsif/native_file.hpp>
 #include <tml/tree.hpp>
@@ -30,8 +40,22 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.*/
 #include <utki/string.hpp>
 #include <utki/util.hpp>
 
+#include "compressor.hpp"
 #include "configuration.hpp"
+#include "contents.hpp"
+#include "deb.hpp"
+#include "decompressor.hpp"
+#include "file_insertion.hpp"
+#include "file_lock.hpp"
+#include "hash_cache.hpp"
+#include "hasher.hpp"
+#include "mapped_file.hpp"
 #include "packages.hpp"
+#include "packages_index.hpp"
+#include "parallel.hpp"
+#include "pdiff.hpp"
+#include "signing.hpp"
+#include "sink.hpp"
 
 using namespace std::string_literals;
 using namespace std::string_view_literals;
@@ -49,8 +73,18 @@ dists
 	<dists>
 		<comps>
 			binary-<archs>
+				by-hash
+					SHA256
+						<index-file-digests>
+				Packages.diff
+					by-hash
+						SHA256
+							<index-file-digests>
+					Index
+					<patches>
 				Packages
 				Packages.gz
+			Contents-<archs>.gz
 		InRelease
 		Release
 		Release.gpg
@@ -60,18 +94,58 @@ pool
 			<prefix>
 				<package-source-name>
 					<package-files>
+.aptian
+	dists
+		<dists>
+			<comps>
+				binary-<archs>
+					Packages.idx
+					pdiff_history
+				Packages.lock
+			hash_cache
+			Release.lock
+	contents
+		pool
+			<dists>
+				<comps>
+					<prefix>
+						<package-source-name>
+							<package-files>
 aptian.conf
 
+The .aptian directory holds aptian's internal state which is not part of the APT repository,
+e.g. cached hash sums of the index files and binary indices of the Packages files.
+The .aptian/contents directory holds lists of the files of each package in the pool,
+so that the package files do not need to be read again to update the Contents indices.
+
+Several aptian processes can modify the repository concurrently:
+- each invocation uses its own subdirectory of the tmp directory for temporary files
+- pool and index files of a component are modified while holding exclusive lock of the
+  component's Packages.lock file, so additions to different components proceed in parallel
+- Release file of a dist is regenerated and signed while holding exclusive lock of the dist's Release.lock file,
+  the component's index files are hashed for the Release file while holding shared lock of its Packages.lock
+
 */
 
 namespace {
 constexpr std::string_view dists_subdir = "dists/"sv;
 constexpr std::string_view pool_subdir = "pool/"sv;
 constexpr std::string_view tmp_subdir = "tmp/"sv;
+constexpr std::string_view state_subdir = ".aptian/"sv;
+constexpr std::string_view hash_cache_filename = "hash_cache"sv;
+constexpr std::string_view release_lock_filename = "Release.lock"sv;
+constexpr std::string_view packages_lock_filename = "Packages.lock"sv;
 constexpr std::string_view lib_prefix = "lib"sv;
 constexpr std::string_view binary_prefix = "binary-"sv;
-constexpr std::string_view control_filename = "control"sv;
 constexpr std::string_view packages_filename = "Packages"sv;
+constexpr std::string_view packages_index_filename = "Packages.idx"sv;
+constexpr std::string_view packages_append_marker_filename = "Packages.appending"sv;
+constexpr std::string_view by_hash_sha256_subdir = "by-hash/SHA256/"sv;
+constexpr std::string_view packages_diff_subdir = "Packages.diff/"sv;
+constexpr std::string_view pdiff_index_filename = "Index"sv;
+constexpr std::string_view pdiff_history_filename = "pdiff_history"sv;
+constexpr std::string_view contents_prefix = "Contents-"sv;
+constexpr std::string_view contents_cache_subdir = "contents/"sv;
 constexpr std::string_view release_filename = "Release"sv;
 constexpr std::string_view release_gpg_filename = "Release.gpg"sv;
 constexpr std::string_view inrelease_filename = "InRelease"sv;
@@ -91,9 +165,18 @@ std::string apt_pool_prefix(std::string_view package_name)
 }
 } // namespace
 
+namespace {
+// Get path of the per-package cache file holding list of the files of the pool package.
+std::string get_package_files_cache_path(std::string_view base_dir, std::string_view pool_filename)
+{
+	return utki::cat(base_dir, state_subdir, contents_cache_subdir, pool_filename);
+}
+} // namespace
+
 void aptian::init( //
 	std::string_view dir,
-	std::string_view gpg
+	std::string_view gpg,
+	const repository_settings& settings
 )
 {
 	ASSERT(!dir.empty())
@@ -110,7 +193,7 @@ void aptian::init( //
 	std::cout << "initialize APT repository" << std::endl;
 
 	std::cout << "create configuration file" << std::endl;
-	configuration::create(dir, gpg);
+	configuration::create(dir, gpg, settings);
 
 	auto pubkey_gpg_path = utki::cat(dir, pubkey_gpg_filename);
 	std::cout << "create " << pubkey_gpg_path << std::endl;
@@ -138,125 +221,347 @@ struct repo_dirs {
 	std::string base;
 	std::string dist_rel; // relative to base dir
 	std::string dist;
-	std::string comp; // directory under dist dir
+	std::string comp_rel; // relative to dist dir
+	std::string comp;
 	std::string pool; // relative to base dir
-	std::string tmp;
+	std::string dist_state; // state directory of the dist
 };
 
-file_hashes get_file_hashes(const repo_dirs& dirs, std::string_view path)
+repo_dirs make_repo_dirs(std::string_view dir, std::string_view dist, std::string_view comp)
 {
-	std::filesystem::create_directories(dirs.tmp);
-	auto md5_path = utki::cat(dirs.tmp, "md5");
-	auto sha1_path = utki::cat(dirs.tmp, "sha1");
-	auto sha256_path = utki::cat(dirs.tmp, "sha256");
-	auto sha512_path = utki::cat(dirs.tmp, "sha512");
-	if (std::system(utki::cat("md5sum ", path, " | cut -d\" \" -f1 > ", md5_path).c_str()) != 0) {
-		throw std::runtime_error( //
-			utki::cat("could not calculcate md5 hash sum of ", path)
-		);
-	}
-	if (std::system(utki::cat("sha1sum ", path, " | cut -d\" \" -f1 > ", sha1_path).c_str()) != 0) {
-		throw std::runtime_error( //
-			utki::cat("could not calculcate sha1 hash sum of ", path)
-		);
-	}
-	if (std::system(utki::cat("sha256sum ", path, " | cut -d\" \" -f1 > ", sha256_path).c_str()) != 0) {
-		throw std::runtime_error( //
-			utki::cat("could not calculcate sha256 hash sum of ", path)
-		);
-	}
-	if (std::system(utki::cat("sha512sum ", path, " | cut -d\" \" -f1 > ", sha512_path).c_str()) != 0) {
-		throw std::runtime_error( //
-			utki::cat("could not calculcate sha512 hash sum of  ", path)
-		);
+	repo_dirs dirs = {
+		.base = std::string(dir),
+		.dist_rel = utki::cat(dists_subdir, fsif::as_dir(dist)),
+		.dist = utki::cat(dir, dirs.dist_rel),
+		.comp_rel = fsif::as_dir(comp),
+		.comp = utki::cat(dirs.dist, dirs.comp_rel),
+		.pool = utki::cat(pool_subdir, fsif::as_dir(dist), fsif::as_dir(comp)),
+		.dist_state = utki::cat(dir, state_subdir, dirs.dist_rel)
+	};
+	return dirs;
+}
+
+std::string get_packages_lock_path(const repo_dirs& dirs, std::string_view comp_rel)
+{
+	return utki::cat(dirs.dist_state, comp_rel, packages_lock_filename);
+}
+
+// Create temporary directory of the invocation.
+std::string make_tmp_dir(std::string_view dir)
+{
+	auto tmp_dir = utki::cat(dir, tmp_subdir);
+	std::filesystem::create_directories(tmp_dir);
+
+	auto path_template = utki::cat(tmp_dir, "XXXXXX"sv);
+	if (!mkdtemp(path_template.data())) {
+		throw std::system_error(errno, std::generic_category(), utki::cat("could not create directory in ", tmp_dir));
 	}
 
-	return file_hashes{
-		.md5 = std::string(utki::trim(utki::make_string_view(fsif::native_file(md5_path).load()))),
-		.sha1 = std::string(utki::trim(utki::make_string_view(fsif::native_file(sha1_path).load()))),
-		.sha256 = std::string(utki::trim(utki::make_string_view(fsif::native_file(sha256_path).load()))),
-		.sha512 = std::string(utki::trim(utki::make_string_view(fsif::native_file(sha512_path).load())))
-	};
+	return fsif::as_dir(path_template);
 }
 
+// package file which was read and hashed, but not yet added to any target of the repository
+struct read_package_file {
+	std::string file_path;
+	package pkg; // without pool file information
+	size_t size;
+	file_hashes hashes;
+
+	// files of the package, only in case those were requested for the Contents indices
+	std::vector<std::string> files;
+};
+
 struct unadded_package {
 	std::string file_path;
 	package pkg;
+	size_t size;
 	file_hashes hashes;
 };
 
-std::vector<unadded_package> prepare_control_info(utki::span<const std::string> package_paths, const repo_dirs& dirs)
+// The package is added anyway, only its files are missing from the Contents index.
+void warn_files_not_listed(std::string_view pkg_path)
+{
+	std::cout << "WARNING: files of package " << pkg_path
+			  << " are not listed in Contents index, compression of its data.tar is not supported" << std::endl;
+}
+
+read_package_file read_package(const std::string& pkg_path, bool list_files)
 {
-	std::vector<unadded_package> unadded_packages;
+	try {
+		auto deb = read_deb(fsif::native_file(pkg_path), list_files);
 
-	for (const auto& pkg_path : package_paths) {
-		auto filename = fsif::not_dir(pkg_path);
-		auto suffix = fsif::suffix(filename);
-		if (suffix != "deb" && suffix != "ddeb") {
-			std::cout << "unsupported package suffix: ." << suffix << std::endl;
-			std::cout << "  skipping: " << filename << std::endl;
-			continue;
+		if (list_files && !deb.files_listed) {
+			warn_files_not_listed(pkg_path);
+		}
+
+		return {
+			.file_path = pkg_path,
+			.pkg = package(utki::trim(deb.control)),
+			.size = deb.size,
+			.hashes = std::move(deb.hashes),
+			.files = std::move(deb.files)
+		};
+	} catch (std::exception& e) {
+		throw std::runtime_error(utki::cat("could not read debian package ", pkg_path, ": ", e.what()));
+	}
+}
+
+bool is_package_file(std::string_view pkg_path)
+{
+	auto filename = fsif::not_dir(pkg_path);
+	auto suffix = fsif::suffix(filename);
+	if (suffix != "deb" && suffix != "ddeb") {
+		std::cout << "unsupported package suffix: ." << suffix << std::endl;
+		std::cout << "  skipping: " << filename << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// Read package files of the requests.
+// The files of all the requests are read in parallel, so that a batch of requests
+// with one package file each is read as fast as one request with all the files.
+// In case a package file of a request cannot be read, the error is stored for the request.
+std::vector<std::vector<read_package_file>> read_package_files(
+	utki::span<const add_request> requests,
+	unsigned num_jobs,
+	bool list_files,
+	std::vector<std::exception_ptr>& errors
+)
+{
+	ASSERT(errors.size() == requests.size())
+
+	struct deb_file {
+		size_t request_index;
+		std::reference_wrapper<const std::string> path;
+
+		std::optional<read_package_file> result;
+		std::exception_ptr error;
+	};
+
+	std::vector<deb_file> debs;
+
+	for (size_t i = 0; i != requests.size(); ++i) {
+		for (const auto& pkg_path : requests[i].package_paths) {
+			if (is_package_file(pkg_path)) {
+				debs.push_back({.request_index = i, .path = pkg_path});
+			}
 		}
+	}
 
-		fsif::native_file tmp_dir_file(dirs.tmp);
-		if (tmp_dir_file.exists()) {
-			std::filesystem::remove_all(tmp_dir_file.path());
+	parallel_for(debs.size(), num_jobs, [&](size_t i) {
+		auto& deb = debs[i];
+		try {
+			deb.result.emplace(read_package(deb.path, list_files));
+		} catch (...) {
+			deb.error = std::current_exception();
 		}
-		tmp_dir_file.make_dir();
+	});
 
-		// extract control information from deb package to tmp directory
-		if (std::system(utki::cat("dpkg-deb --control ", pkg_path, " ", dirs.tmp).c_str()) != 0) {
-			throw std::runtime_error(utki::cat("could not extract control information from ", filename));
+	// the results are stored in the same order as the package paths were given
+	std::vector<std::vector<read_package_file>> ret(requests.size());
+	for (auto& deb : debs) {
+		if (errors[deb.request_index]) {
+			continue;
+		}
+		if (deb.error) {
+			errors[deb.request_index] = deb.error;
+			ret[deb.request_index].clear();
+			continue;
 		}
+		ASSERT(deb.result.has_value())
+		ret[deb.request_index].push_back(std::move(deb.result.value()));
+	}
 
-		package pkg( //
-			utki::trim( //
-				utki::make_string_view( //
-					fsif::native_file( //
-						utki::cat(dirs.tmp, control_filename)
-					)
-						.load()
-				)
-			)
-		);
+	return ret;
+}
+
+// Make control info of the packages for the component's pool.
+std::vector<unadded_package> prepare_control_info(utki::span<const read_package_file> packages, const repo_dirs& dirs)
+{
+	std::vector<unadded_package> ret;
+	ret.reserve(packages.size());
+
+	for (const auto& p : packages) {
+		auto pkg = p.pkg;
 
 		auto pkg_name = pkg.get_name();
 
 		auto pkg_pool_dir = utki::cat(dirs.pool, apt_pool_prefix(pkg_name), fsif::as_dir(pkg_name));
 
-		auto pkg_pool_path = utki::cat(pkg_pool_dir, filename);
+		auto pkg_pool_path = utki::cat(pkg_pool_dir, fsif::not_dir(p.file_path));
 
-		auto hashes = get_file_hashes(dirs, pkg_path);
+		pkg.append(pkg_pool_path, p.size, p.hashes);
 
-		pkg.append(pkg_pool_path, fsif::native_file(pkg_path).size(), hashes);
+		ret.push_back({
+			.file_path = p.file_path,
+			.pkg = std::move(pkg),
+			.size = p.size,
+			.hashes = p.hashes
+		});
+	}
 
-		unadded_packages.push_back( //
-			{//
-			 .file_path = pkg_path,
-			 .pkg = std::move(pkg),
-			 .hashes = std::move(hashes)
+	return ret;
+}
+} // namespace
+
+namespace {
+// Packages file is appended to in place, so in case appending was interrupted, e.g. the process was killed,
+// the file is left with partially written paragraphs after the data it had when its index was written.
+// The append marker file exists while appending is in progress, so the data after the indexed size is
+// known to be written by the interrupted appending and not published in the Release file, so cut it off.
+// Without the marker, the data appended to the Packages file is kept, the file is treated as changed.
+void truncate_interrupted_append(std::string_view packages_path, std::string_view index_path)
+{
+	auto marker_path = utki::cat(fsif::dir(index_path), packages_append_marker_filename);
+	if (!fsif::native_file(marker_path).exists()) {
+		return;
+	}
+
+	auto stat = get_file_stat(packages_path);
+	if (stat.has_value() && get_file_stat(index_path).has_value()) {
+		try {
+			auto indexed_stat = packages_index(index_path).get_packages_stat();
+
+			// appending in place keeps the inode, otherwise the file was replaced
+			if (stat->inode == indexed_stat.inode && stat->size > indexed_stat.size) {
+				std::filesystem::resize_file(packages_path, indexed_stat.size);
 			}
-		);
+		} catch (std::invalid_argument&) {
+			// the index is malformed, it will be rebuilt
+		}
 	}
 
-	return unadded_packages;
+	std::filesystem::remove(marker_path);
+}
+
+// Load index of the Packages file, the data left by interrupted appending is cut off from the file first.
+packages_index load_packages_index(std::string_view packages_path, std::string_view index_path)
+{
+	truncate_interrupted_append(packages_path, index_path);
+	return packages_index::load_or_build(index_path, packages_path);
 }
 } // namespace
 
 namespace {
-void add_packages_to_pool(utki::span<const unadded_package> packages, const repo_dirs& dirs)
+// Compare file contents byte by byte.
+bool is_same_contents(std::string_view path1, std::string_view path2)
+{
+	mapped_file file1(path1);
+	mapped_file file2(path2);
+
+	auto data1 = file1.span();
+	auto data2 = file2.span();
+
+	if (data1.size() != data2.size()) {
+		return false;
+	}
+
+	// compare in chunks to not fault in the pages of both files beyond the first difference
+	constexpr size_t chunk_size = 0x100000;
+	for (size_t offset = 0; offset < data1.size(); offset += chunk_size) {
+		auto size = std::min(chunk_size, data1.size() - offset);
+		if (std::memcmp(data1.data() + offset, data2.data() + offset, size) != 0) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Compare hash sums of the pool file listed in the Packages file stanza with hash sums of the package file.
+// Returns std::nullopt if the stanza does not tell.
+std::optional<bool> is_same_as_listed(const unadded_package& p, const repo_dirs& dirs)
+{
+	const auto& arch = p.pkg.fields.architecture;
+
+	auto bin_dir_rel = utki::cat(dirs.comp_rel, binary_prefix, arch, '/');
+	auto packages_path = utki::cat(dirs.dist, bin_dir_rel, packages_filename);
+
+	if (!fsif::native_file(packages_path).exists()) {
+		return std::nullopt;
+	}
+
+	auto index = load_packages_index(packages_path, utki::cat(dirs.dist_state, bin_dir_rel, packages_index_filename));
+
+	auto entry = index.find(p.pkg.fields.package, p.pkg.fields.version, arch);
+	if (!entry.has_value()) {
+		return std::nullopt;
+	}
+
+	mapped_file packages(packages_path);
+	auto data = utki::make_string_view(packages.span());
+	if (entry->offset > data.size() || entry->size > data.size() - entry->offset) {
+		return std::nullopt;
+	}
+
+	auto listed = package::parse_pool_file_fields(data.substr(entry->offset, entry->size));
+	if (listed.filename != p.pkg.fields.filename) {
+		return std::nullopt;
+	}
+
+	if (listed.size != std::to_string(p.size)) {
+		return false;
+	}
+
+	const std::array<std::pair<std::string_view, std::string_view>, 4> hashes = {
+		{
+			{listed.md5sum, p.hashes.md5},
+			{listed.sha1, p.hashes.sha1},
+			{listed.sha256, p.hashes.sha256},
+			{listed.sha512, p.hashes.sha512},
+		}
+	};
+
+	bool compared = false;
+	for (const auto& [l, h] : hashes) {
+		if (l.empty()) {
+			continue;
+		}
+		if (l != h) {
+			return false;
+		}
+		compared = true;
+	}
+
+	if (!compared) {
+		return std::nullopt;
+	}
+	return true;
+}
+
+// Check if the existing pool file is the same as the package file.
+// The pool file is not rehashed, instead the sizes are compared first, then the hash sums
+// listed in the Packages file, and only if those are not available the file contents are compared.
+bool is_same_pool_file(const unadded_package& p, const std::string& pool_path, const repo_dirs& dirs)
+{
+	if (std::filesystem::file_size(pool_path) != p.size) {
+		return false;
+	}
+
+	if (auto same = is_same_as_listed(p, dirs)) {
+		return same.value();
+	}
+
+	return is_same_contents(pool_path, p.file_path);
+}
+} // namespace
+
+namespace {
+void add_packages_to_pool(
+	utki::span<const unadded_package> packages,
+	const repo_dirs& dirs,
+	insertion_method pool_insertion
+)
 {
 	for (const auto& p : packages) {
 		const auto& filename = p.pkg.fields.filename;
 		auto path = utki::cat(dirs.base, filename);
 
 		if (fsif::native_file(path).exists()) {
-			auto hashes = get_file_hashes(dirs, path);
-
-			// TODO: compare files byte by byte instead of comparing hashes
-			if (hashes == p.hashes) {
+			if (is_same_pool_file(p, path, dirs)) {
 				std::cout << "package " << p.pkg.fields.filename
-						  << " already exists in the pool and has same hash sums, skip adding" << std::endl;
+						  << " already exists in the pool and has same contents, skip adding" << std::endl;
 				continue;
 			}
 
@@ -272,7 +577,90 @@ void add_packages_to_pool(utki::span<const unadded_package> packages, const repo
 		std::filesystem::create_directories(fsif::dir(path));
 
 		std::cout << "add " << filename << std::endl;
-		std::filesystem::copy(p.file_path, path);
+		insert_file(p.file_path, path, pool_insertion);
+	}
+}
+} // namespace
+
+namespace {
+// Check if data can be appended to existing compressed file, so that it decompresses to concatenation of the data.
+// APT decompresses concatenated gzip members and zstd frames, but only the first stream of xz file,
+// so xz compressed files have to be rewritten.
+bool can_append(compression_format format)
+{
+	return format != compression_format::xz;
+}
+} // namespace
+
+namespace {
+// Get separator to put before a paragraph appended to the control file,
+// so that the appended paragraph is separated from the last one by an empty line.
+std::string_view get_paragraph_separator(std::string_view path)
+{
+	mapped_file file(path);
+	auto data = utki::make_string_view(file.span());
+
+	if (data.empty() || data.ends_with("\n\n"sv)) {
+		return {};
+	}
+	if (data.ends_with('\n')) {
+		return "\n"sv;
+	}
+	return "\n\n"sv;
+}
+} // namespace
+
+namespace {
+// Hard link the index file to the by-hash directory under the file's SHA256 digest.
+void link_by_hash(std::string_view bin_dir, std::string_view filename, std::string_view sha256)
+{
+	auto by_hash_dir = utki::cat(bin_dir, by_hash_sha256_subdir);
+	std::filesystem::create_directories(by_hash_dir);
+
+	auto path = utki::cat(by_hash_dir, sha256);
+
+	// same digest means same contents
+	if (fsif::native_file(path).exists()) {
+		return;
+	}
+
+	insert_file(utki::cat(bin_dir, filename), path, insertion_method::hardlink);
+}
+
+// Remove the by-hash files of all but the given number of the latest index file generations.
+// Generation is the set of index files written at once, the current generation is never removed.
+void prune_by_hash(std::string_view bin_dir, utki::span<const std::string> current_digests, unsigned retention)
+{
+	ASSERT(retention != 0)
+
+	auto by_hash_dir = utki::cat(bin_dir, by_hash_sha256_subdir);
+
+	std::vector<std::pair<std::filesystem::file_time_type, std::string>> old_files;
+	for (const auto& f : fsif::native_file(by_hash_dir).list_dir()) {
+		if (fsif::is_dir(f)) {
+			continue;
+		}
+		// TODO: use std::ranges::find() when ubuntu focal support can be dropped
+		// NOLINTNEXTLINE(modernize-use-ranges, "ranges not supported in gcc from ubuntu focal")
+		if (std::find(current_digests.begin(), current_digests.end(), f) != current_digests.end()) {
+			continue;
+		}
+		auto path = utki::cat(by_hash_dir, f);
+		old_files.emplace_back(std::filesystem::last_write_time(path), std::move(path));
+	}
+
+	size_t num_to_keep = (retention - 1) * current_digests.size();
+	if (old_files.size() <= num_to_keep) {
+		return;
+	}
+
+	// newest first
+	// TODO: use std::ranges::sort() when ubuntu focal support can be dropped
+	// NOLINTNEXTLINE(modernize-use-ranges, "ranges not supported in gcc from ubuntu focal")
+	std::sort(old_files.begin(), old_files.end(), std::greater<>());
+
+	for (auto i = std::next(old_files.begin(), ptrdiff_t(num_to_keep)); i != old_files.end(); ++i) {
+		std::filesystem::remove(i->second);
 	}
 }
 } // namespace
@@ -280,23 +668,76 @@ void add_packages_to_pool(utki::span<const unadded_package> packages, const repo
 namespace {
 class architectures
 {
-	std::map<std::string, std::vector<package>, std::less<>> archs;
+	// (Package, Version) pair identifying a package, refers to the package data
+	using package_id = std::pair<std::string_view, std::string_view>;
+
+	struct package_id_hash {
+		size_t operator()(const package_id& id) const noexcept
+		{
+			auto h = std::hash<std::string_view>()(id.first);
+			// same as boost::hash_combine()
+			// NOLINTNEXTLINE(cppcoreguidelines-avoid-magic-numbers, readability-magic-numbers)
+			return h ^ (std::hash<std::string_view>()(id.second) + 0x9e3779b9 + (h << 6) + (h >> 2));
+		}
+	};
+
+	struct arch_packages {
+		// index of the existing Packages file, the Packages file is not parsed unless it needs to be rewritten
+		std::optional<packages_index> index;
+
+		// new packages
+		std::vector<package> packages;
+
+		// index for fast duplicate check of the new packages
+		// package data does not move when package objects are moved, so the ids stay valid
+		std::unordered_set<package_id, package_id_hash> ids;
+	};
+
+	std::map<std::string, arch_packages, std::less<>> archs;
 
 	std::string comp_dir;
 
+	// path of the component directory relative to the dist directory
+	std::string comp_rel;
+
+	// state directory of the dist
+	std::string dist_state;
+
+	hash_cache& cache;
+
+	const add_options& options;
+
+	const std::vector<compression_format>& compression_formats;
+
+	// number of index file generations to keep in by-hash directories, 0 means no by-hash directories
+	const unsigned by_hash_retention;
+
+	// number of Packages file patches to keep, 0 means no patches
+	const unsigned pdiff_history_size;
+
+	// whether to write Contents indices
+	const bool contents;
+
+	// base directory of the repository, the pool file paths are relative to it
+	std::string base_dir;
+
+	std::string get_index_path(std::string_view bin_dir_rel) const
+	{
+		return utki::cat(this->dist_state, bin_dir_rel, packages_index_filename);
+	}
+
 	auto& load_arch(std::string_view arch)
 	{
+		auto bin_dir_rel = utki::cat(this->comp_rel, binary_prefix, arch, '/');
 		auto packages_path = utki::cat(this->comp_dir, binary_prefix, arch, '/', packages_filename);
 
-		auto packages = [&]() {
-			fsif::native_file file(packages_path);
-			if (file.exists()) {
-				return aptian::read_packages_file(file);
-			}
-			return decltype(archs)::value_type::second_type();
-		}();
+		arch_packages ap;
 
-		auto res = this->archs.insert(decltype(archs)::value_type(arch, std::move(packages)));
+		if (fsif::native_file(packages_path).exists()) {
+			ap.index = load_packages_index(packages_path, this->get_index_path(bin_dir_rel));
+		}
+
+		auto res = this->archs.insert(decltype(archs)::value_type(arch, std::move(ap)));
 		ASSERT(res.second)
 
 		return res.first->second;
@@ -311,9 +752,372 @@ class architectures
 		return i->second;
 	}
 
+	struct written_file {
+		std::string rel_path; // relative to the dist directory
+		file_hashes hashes;
+		std::string hasher_state;
+	};
+
+	// Update PDiff patches of the Packages file after it was written.
+	// The patches are made from the packages appended to the file since each previous version,
+	// the file is never diffed as a whole.
+	// Returns the written Index file of the patches, if any.
+	std::optional<written_file> write_pdiff(
+		std::string_view bin_dir,
+		std::string_view bin_dir_rel,
+		const file_hashes& packages_hashes,
+		std::string_view old_packages_sha256
+	) const
+	{
+		auto diff_dir = utki::cat(bin_dir, packages_diff_subdir);
+		auto history_path = utki::cat(this->dist_state, bin_dir_rel, pdiff_history_filename);
+
+		if (this->pdiff_history_size == 0) {
+			// in case the patches were generated before, those must not go to the Release file anymore
+			std::filesystem::remove_all(diff_dir);
+			std::filesystem::remove(history_path);
+			return {};
+		}
+
+		mapped_file packages_file(utki::cat(bin_dir, packages_filename));
+		auto data = utki::make_string_view(packages_file.span());
+
+		ASSERT(data.ends_with('\n'))
+
+		pdiff_history history(std::move(history_path));
+
+		pdiff_history::version cur{
+			.name = make_pdiff_version_name(std::chrono::system_clock::now()),
+			.sha256 = packages_hashes.sha256,
+			.size = data.size(),
+			.num_lines = 0
+		};
+
+		// TODO: use std::ranges::count() when ubuntu focal support can be dropped
+		// NOLINTNEXTLINE(modernize-use-ranges, "ranges not supported in gcc from ubuntu focal")
+		auto count_lines = [](std::string_view str) {
+			return uint64_t(std::count(str.begin(), str.end(), '\n'));
+		};
+
+		auto versions = history.get_versions();
+
+		// the history goes on only in case the packages were appended to its current version,
+		// otherwise the clients having older versions just download the whole file
+		if (!old_packages_sha256.empty() && !versions.empty() && versions.back().sha256 == old_packages_sha256 &&
+			versions.back().size <= data.size())
+		{
+			const auto& prev = versions.back();
+			cur.num_lines = prev.num_lines + count_lines(data.substr(prev.size));
+			history.push(std::move(cur), this->pdiff_history_size);
+		} else {
+			cur.num_lines = count_lines(data);
+			history.restart(std::move(cur));
+		}
+
+		std::optional<written_file> ret;
+
+		if (history.get_versions().size() == 1) {
+			std::filesystem::remove_all(diff_dir);
+		} else {
+			auto index = write_pdiff_patches(diff_dir, history, data);
+
+			hashing_file_sink index_sink(utki::cat(diff_dir, pdiff_index_filename));
+			index_sink.write(utki::to_uint8_t(utki::make_span(index)));
+			index_sink.finish();
+
+			ret = written_file{
+				.rel_path = utki::cat(bin_dir_rel, packages_diff_subdir, pdiff_index_filename),
+				.hashes = index_sink.get_hashes(),
+				.hasher_state = index_sink.get_hasher_state()
+			};
+
+			if (this->by_hash_retention != 0) {
+				link_by_hash(diff_dir, pdiff_index_filename, ret->hashes.sha256);
+				prune_by_hash(diff_dir, utki::make_span(&ret->hashes.sha256, 1), this->by_hash_retention);
+			}
+		}
+
+		history.save();
+
+		return ret;
+	}
+
+	static std::string get_contents_filename(std::string_view arch)
+	{
+		return utki::cat(contents_prefix, arch, to_suffix(compression_format::gzip));
+	}
+
+	// Get files of the pool package from the per-package cache.
+	// The package file is read only in case its files are not cached, e.g. if it was added
+	// before the Contents indices were enabled.
+	std::vector<std::string> get_package_files(const package& pkg) const
+	{
+		const auto& filename = pkg.fields.filename;
+		auto sha256 = package::parse_pool_file_fields(pkg.get_control()).sha256;
+
+		auto cache_path = get_package_files_cache_path(this->base_dir, filename);
+		if (auto files = load_package_files(cache_path, sha256)) {
+			return std::move(files.value());
+		}
+
+		auto deb = read_deb(fsif::native_file(utki::cat(this->base_dir, filename)), true);
+		if (deb.hashes.sha256 != sha256) {
+			throw std::runtime_error(utki::cat("pool file ", filename, " does not match its Packages file entry"));
+		}
+		if (!deb.files_listed) {
+			warn_files_not_listed(filename);
+		}
+
+		save_package_files(cache_path, sha256, deb.files);
+
+		return std::move(deb.files);
+	}
+
+	// Write Contents index of the architecture.
+	// In case of incremental update the packages are merged into the existing index,
+	// otherwise the packages are all the packages of the architecture and the index is rebuilt.
+	// Does not access the hash cache, so it is safe to call for different architectures concurrently.
+	written_file write_contents(
+		std::string_view arch,
+		utki::span<const package> packages,
+		bool incremental,
+		unsigned num_jobs
+	) const
+	{
+		auto filename = get_contents_filename(arch);
+		auto path = utki::cat(this->comp_dir, filename);
+
+		contents_index index;
+		for (const auto& p : packages) {
+			index.add(get_qualified_name(p), this->get_package_files(p));
+		}
+
+		std::vector<uint8_t> existing;
+		if (incremental) {
+			mapped_file file(path);
+			auto decomp = make_decompressor(path);
+			decomp->feed(file.span(), existing);
+			decomp->finish(existing);
+		}
+
+		hashing_file_sink file_sink(path);
+		{
+			gzip_compressor gz(
+				file_sink,
+				{//
+				 .num_jobs = num_jobs,
+				 .rsyncable = this->options.rsyncable
+				}
+			);
+			index.write(utki::make_string_view(existing), gz);
+			gz.finish();
+		}
+
+		return {
+			.rel_path = utki::cat(this->comp_rel, filename),
+			.hashes = file_sink.get_hashes(),
+			.hasher_state = file_sink.get_hasher_state()
+		};
+	}
+
+	// Hard link Contents indices of the component to the by-hash directory.
+	void link_contents_by_hash()
+	{
+		ASSERT(this->by_hash_retention != 0)
+
+		std::vector<std::string> digests;
+		for (const auto& f : fsif::native_file(this->comp_dir).list_dir()) {
+			if (fsif::is_dir(f) || !f.starts_with(contents_prefix)) {
+				continue;
+			}
+			const auto& info = this->cache.get(utki::cat(this->comp_rel, f));
+			link_by_hash(this->comp_dir, f, info.hashes.sha256);
+			digests.push_back(info.hashes.sha256);
+		}
+		prune_by_hash(this->comp_dir, digests, this->by_hash_retention);
+	}
+
+	// Write index files of the architecture.
+	// In case hasher states of the existing index files are given, the packages are appended to those files,
+	// otherwise the files are replaced. The xz compressed file is always replaced, see can_append().
+	// The binary index of the Packages file is updated accordingly, the old index is needed in case of appending.
+	// Does not access the hash cache, so it is safe to call for different architectures concurrently.
+	std::vector<written_file> write_index_files(
+		std::string_view bin_dir,
+		std::string_view bin_dir_rel,
+		utki::span<const package> packages,
+		std::string_view separator,
+		const std::vector<std::string>& hasher_states,
+		std::string_view old_packages_sha256,
+		const packages_index* old_index,
+		unsigned num_jobs
+	) const
+	{
+		auto packages_rel_path = utki::cat(bin_dir_rel, packages_filename);
+		auto packages_path = utki::cat(bin_dir, packages_filename);
+
+		// the by-hash files are hard links to the index files, those must not be modified in place
+		const bool in_place = this->by_hash_retention == 0;
+
+		auto make_sink = [&](std::string path, size_t index) {
+			if (hasher_states.empty()) {
+				return std::make_unique<hashing_file_sink>(path);
+			}
+			return std::make_unique<hashing_file_sink>(path, hasher_states[index], in_place);
+		};
+
+		// the compressed files which cannot be appended to are compressed from the beginning of the Packages file,
+		// so its existing contents are read before appending to it
+		std::unique_ptr<mapped_file> old_packages;
+
+		std::vector<std::unique_ptr<hashing_file_sink>> compressed_sinks;
+		std::vector<std::unique_ptr<sink>> compressors;
+		for (auto format : this->compression_formats) {
+			auto path = utki::cat(packages_path, to_suffix(format));
+			if (hasher_states.empty() || can_append(format)) {
+				compressed_sinks.push_back(make_sink(std::move(path), compressed_sinks.size() + 1));
+			} else {
+				compressed_sinks.push_back(std::make_unique<hashing_file_sink>(path));
+			}
+			compressors.push_back(make_compressor(
+				format,
+				*compressed_sinks.back(),
+				{//
+				 .num_jobs = num_jobs,
+				 .rsyncable = this->options.rsyncable
+				}
+			));
+
+			if (!hasher_states.empty() && !can_append(format)) {
+				if (!old_packages) {
+					old_packages = std::make_unique<mapped_file>(packages_path);
+				}
+				compressors.back()->write(old_packages->span());
+			}
+		}
+
+		// the marker is removed after the index is updated, see truncate_interrupted_append()
+		auto append_marker_path = utki::cat(this->dist_state, bin_dir_rel, packages_append_marker_filename);
+		const bool appending_in_place = !hasher_states.empty() && in_place;
+		if (appending_in_place) {
+			fsif::native_file marker(append_marker_path);
+			fsif::file::guard marker_guard(marker, fsif::mode::create);
+		}
+
+		auto packages_sink = make_sink(packages_path, 0);
+
+		{
+			std::vector<std::reference_wrapper<sink>> outputs = {*packages_sink};
+			for (auto& c : compressors) {
+				outputs.emplace_back(*c);
+			}
+			tee_sink out(std::move(outputs));
+
+			if (!separator.empty()) {
+				out.write(utki::to_uint8_t(utki::make_span(separator)));
+			}
+
+			// TODO: does Packages file have to be sorted by package name?
+			aptian::write_packages(packages, out);
+
+			out.finish();
+		}
+
+		{
+			auto entries = index_packages(
+				packages,
+				(old_index ? old_index->get_packages_stat().size : 0) + separator.size()
+			);
+			if (old_index) {
+				auto old_entries = old_index->get_entries();
+				entries.insert(entries.end(), old_entries.begin(), old_entries.end());
+			}
+
+			auto packages_stat = get_file_stat(packages_path);
+			ASSERT(packages_stat.has_value())
+			packages_index::write(this->get_index_path(bin_dir_rel), packages_stat.value(), std::move(entries));
+		}
+
+		if (appending_in_place) {
+			std::filesystem::remove(append_marker_path);
+		}
+
+		std::vector<written_file> ret;
+		ret.push_back({
+			.rel_path = packages_rel_path,
+			.hashes = packages_sink->get_hashes(),
+			.hasher_state = packages_sink->get_hasher_state()
+		});
+		for (size_t i = 0; i != compressed_sinks.size(); ++i) {
+			ret.push_back({
+				.rel_path = utki::cat(packages_rel_path, to_suffix(this->compression_formats[i])),
+				.hashes = compressed_sinks[i]->get_hashes(),
+				.hasher_state = compressed_sinks[i]->get_hasher_state()
+			});
+		}
+
+		if (this->by_hash_retention != 0) {
+			std::vector<std::string> digests;
+			for (const auto& f : ret) {
+				link_by_hash(bin_dir, fsif::not_dir(f.rel_path), f.hashes.sha256);
+				digests.push_back(f.hashes.sha256);
+			}
+			prune_by_hash(bin_dir, digests, this->by_hash_retention);
+		}
+
+		if (auto index = this->write_pdiff(bin_dir, bin_dir_rel, ret.front().hashes, old_packages_sha256)) {
+			ret.push_back(std::move(index.value()));
+		}
+
+		return ret;
+	}
+
+	// Get hasher states of the existing index files of the architecture.
+	// Returns empty vector if any of the index files is missing or has changed since it was written by aptian,
+	// e.g. in case previous run was interrupted, so that appending to the files is not safe.
+	std::vector<std::string> get_index_files_hasher_states(std::string_view bin_dir_rel)
+	{
+		auto packages_rel_path = utki::cat(bin_dir_rel, packages_filename);
+
+		std::vector<std::string> paths = {packages_rel_path};
+		for (auto format : this->compression_formats) {
+			paths.push_back(utki::cat(packages_rel_path, to_suffix(format)));
+		}
+
+		std::vector<std::string> ret;
+		for (const auto& path : paths) {
+			const auto* info = this->cache.get_if_cached(path);
+			if (!info || info->hasher_state.empty()) {
+				return {};
+			}
+			ret.push_back(info->hasher_state);
+		}
+		return ret;
+	}
+
 public:
-	architectures(std::string comp_dir) :
-		comp_dir(std::move(comp_dir))
+	architectures(
+		std::string comp_dir,
+		std::string comp_rel,
+		std::string dist_state,
+		hash_cache& cache,
+		const add_options& options,
+		const std::vector<compression_format>& compression_formats,
+		unsigned by_hash_retention,
+		unsigned pdiff_history_size,
+		bool contents,
+		std::string base_dir
+	) :
+		comp_dir(std::move(comp_dir)),
+		comp_rel(std::move(comp_rel)),
+		dist_state(std::move(dist_state)),
+		cache(cache),
+		options(options),
+		compression_formats(compression_formats),
+		by_hash_retention(by_hash_retention),
+		pdiff_history_size(pdiff_history_size),
+		contents(contents),
+		base_dir(std::move(base_dir))
 	{}
 
 	void add(package pkg)
@@ -322,20 +1126,11 @@ public:
 
 		ASSERT(!arch.empty())
 
-		auto& packages = this->get_arch(arch);
+		auto& ap = this->get_arch(arch);
 
-		// TODO: use std::ranges::find_if() when ubuntu focal support can be dropped
-		// NOLINTNEXTLINE(modernize-use-ranges, "ranges not supported in gcc from ubuntu focal")
-		auto i = std::find_if( //
-			packages.begin(),
-			packages.end(),
-			[&](const auto& p) {
-				return //
-					p.fields.package == pkg.fields.package && //
-					p.fields.version == pkg.fields.version;
-			}
-		);
-		if (i != packages.end()) {
+		if ((ap.index.has_value() && ap.index->find(pkg.fields.package, pkg.fields.version, arch).has_value()) ||
+			ap.ids.contains(package_id(pkg.fields.package, pkg.fields.version)))
+		{
 			std::cout << "package " << pkg.fields.package << "(version: " << pkg.fields.version
 					  << ", arch: " << pkg.fields.architecture << ") already exists, skip adding" << std::endl;
 			return;
@@ -344,59 +1139,187 @@ public:
 		std::cout << "add " << pkg.fields.package << "(version: " << pkg.fields.version
 				  << ", arch: " << pkg.fields.architecture << ")" << std::endl;
 
-		packages.push_back(std::move(pkg));
+		ap.ids.emplace(pkg.fields.package, pkg.fields.version);
+		ap.packages.push_back(std::move(pkg));
 	}
 
 	void write_packages()
 	{
+		struct arch_job {
+			std::string_view arch;
+			const arch_packages& ap;
+			std::string bin_dir;
+			std::string bin_dir_rel;
+
+			// hasher states of the index files to append to, empty in case the index files are to be rewritten
+			std::vector<std::string> hasher_states;
+
+			// SHA256 digest of the Packages file to append to
+			std::string old_packages_sha256;
+
+			// whether the Contents index is up to date, so that the new packages can be merged into it
+			bool contents_incremental = false;
+
+			std::vector<written_file> written_files;
+		};
+
+		// prepare the jobs serially, since the hash cache is not thread safe
+		std::vector<arch_job> jobs;
 		for (const auto& arch : this->archs) {
+			const auto& ap = arch.second;
+
 			auto bin_dir = utki::cat(this->comp_dir, binary_prefix, arch.first, '/');
 
 			std::filesystem::create_directories(bin_dir);
 
 			auto packages_path = utki::cat(bin_dir, packages_filename);
 
-			{
-				fsif::native_file packages_file(packages_path);
-				fsif::file::guard packages_file_guard(packages_file, fsif::mode::create);
+			// remove compressed variants which are not configured anymore, so that they do not go to the Release file
+			for (size_t i = 0; i != size_t(compression_format::enum_size); ++i) {
+				auto format = compression_format(i);
+				// TODO: use std::ranges::find() when ubuntu focal support can be dropped
+				// NOLINTNEXTLINE(modernize-use-ranges, "ranges not supported in gcc from ubuntu focal")
+				if (std::find(this->compression_formats.begin(), this->compression_formats.end(), format) ==
+					this->compression_formats.end())
+				{
+					std::filesystem::remove(utki::cat(packages_path, to_suffix(format)));
+				}
+			}
 
-				// TODO: does Packages file have to be sorted by package name?
-				packages_file.write(to_string(arch.second));
+			arch_job job{
+				.arch = arch.first,
+				.ap = ap,
+				.bin_dir = std::move(bin_dir),
+				.bin_dir_rel = utki::cat(this->comp_rel, binary_prefix, arch.first, '/')
+			};
+
+			// in case the index files are up to date, only the new packages are appended to them,
+			// so the amount of work does not depend on the repository size
+			if (ap.index.has_value()) {
+				job.hasher_states = this->get_index_files_hasher_states(job.bin_dir_rel);
+				if (!job.hasher_states.empty() && ap.packages.empty()) {
+					// nothing to append
+					continue;
+				}
+				if (!job.hasher_states.empty()) {
+					const auto* info = this->cache.get_if_cached(utki::cat(job.bin_dir_rel, packages_filename));
+					ASSERT(info)
+					job.old_packages_sha256 = info->hashes.sha256;
+				}
 			}
 
-			if (std::system(utki::cat("gzip --keep --force ", packages_path).c_str()) != 0) {
-				throw std::runtime_error(utki::cat("could not gzip ", packages_path, " file"));
+			auto contents_filename = get_contents_filename(arch.first);
+			if (this->contents) {
+				job.contents_incremental = !job.hasher_states.empty() &&
+					this->cache.get_if_cached(utki::cat(this->comp_rel, contents_filename));
+			} else {
+				// remove Contents index in case it is not configured anymore, so that it does not go to the Release file
+				std::filesystem::remove(utki::cat(this->comp_dir, contents_filename));
 			}
+
+			jobs.push_back(std::move(job));
 		}
-	}
-};
-} // namespace
 
-namespace {
-void add_to_architectures(std::vector<unadded_package> packages, const repo_dirs& dirs)
-{
-	architectures archs(dirs.comp);
+		// the architectures are processed in parallel, the jobs left are given to the compressors
+		auto num_arch_jobs = unsigned(std::min(size_t(std::max(this->options.num_jobs, 1u)), jobs.size()));
+		auto num_compressor_jobs = num_arch_jobs == 0 ? 1 : std::max(this->options.num_jobs / num_arch_jobs, 1u);
+
+		parallel_for(jobs.size(), num_arch_jobs, [&](size_t i) {
+			auto& job = jobs[i];
+			const auto& ap = job.ap;
+
+			auto packages_path = utki::cat(job.bin_dir, packages_filename);
+
+			if (!job.hasher_states.empty()) {
+				job.written_files = this->write_index_files(
+					job.bin_dir,
+					job.bin_dir_rel,
+					ap.packages,
+					get_paragraph_separator(packages_path),
+					job.hasher_states,
+					job.old_packages_sha256,
+					&ap.index.value(),
+					num_compressor_jobs
+				);
+
+				if (this->contents) {
+					job.written_files.push_back(
+						job.contents_incremental
+							? this->write_contents(job.arch, ap.packages, true, num_compressor_jobs)
+							: this->write_contents(
+								  job.arch,
+								  aptian::read_packages_file(fsif::native_file(packages_path)),
+								  false,
+								  num_compressor_jobs
+							  )
+					);
+				}
+				return;
+			}
+
+			std::vector<package> packages;
+			if (ap.index.has_value()) {
+				packages = aptian::read_packages_file(fsif::native_file(packages_path));
+			}
+			packages.reserve(packages.size() + ap.packages.size());
+			for (const auto& p : ap.packages) {
+				packages.push_back(p);
+			}
+
+			job.written_files = this->write_index_files(
+				job.bin_dir,
+				job.bin_dir_rel,
+				packages,
+				{},
+				{},
+				{},
+				nullptr,
+				num_compressor_jobs
+			);
+
+			if (this->contents) {
+				job.written_files.push_back(this->write_contents(job.arch, packages, false, num_compressor_jobs));
+			}
+		});
+
+		// the hash sums are needed for the Release file,
+		// put them to the cache so that the files are not read back to hash them
+		for (auto& job : jobs) {
+			for (auto& f : job.written_files) {
+				this->cache.put(f.rel_path, std::move(f.hashes), std::move(f.hasher_state));
+			}
+		}
 
-	for (auto& p : packages) {
-		archs.add(std::move(p.pkg));
+		if (this->contents && this->by_hash_retention != 0 && !jobs.empty()) {
+			this->link_contents_by_hash();
+		}
+
+		// the written architectures are loaded again on demand, from the updated Packages file indices
+		for (const auto& job : jobs) {
+			this->archs.erase(this->archs.find(job.arch));
+		}
 	}
 
-	archs.write_packages();
-}
-} // namespace
+	// Drop loaded state of the architectures whose Packages files were changed since they were loaded,
+	// e.g. by another process. Those are loaded again on demand.
+	void refresh()
+	{
+		for (auto i = this->archs.begin(); i != this->archs.end();) {
+			const auto& ap = i->second;
 
-namespace {
-std::vector<std::string> list_archs(const repo_dirs& dirs)
-{
-	std::vector<std::string> ret;
-	for (const auto& f : fsif::native_file(dirs.comp).list_dir()) {
-		if (fsif::is_dir(f) && f.starts_with(binary_prefix)) {
-			auto arch = fsif::as_file(f).substr(binary_prefix.size());
-			ret.emplace_back(arch);
+			ASSERT(ap.packages.empty())
+
+			auto stat = get_file_stat(utki::cat(this->comp_dir, binary_prefix, i->first, '/', packages_filename));
+
+			bool up_to_date = ap.index.has_value() ? stat == ap.index->get_packages_stat() : !stat.has_value();
+			if (up_to_date) {
+				++i;
+			} else {
+				i = this->archs.erase(i);
+			}
 		}
 	}
-	return ret;
-}
+};
 } // namespace
 
 namespace {
@@ -413,12 +1336,26 @@ std::vector<std::string> list_components(const repo_dirs& dirs)
 } // namespace
 
 namespace {
-std::string get_cur_date(const repo_dirs& dirs)
+// List architectures of all the components of the dist.
+std::vector<std::string> list_archs(const repo_dirs& dirs, utki::span<const std::string> comps)
 {
-	constexpr std::string_view cur_date_filename = "cur_date"sv;
-	auto cur_date_path = utki::cat(dirs.tmp, cur_date_filename);
+	std::set<std::string> archs;
+	for (const auto& comp : comps) {
+		for (const auto& f : fsif::native_file(utki::cat(dirs.dist, fsif::as_dir(comp))).list_dir()) {
+			if (fsif::is_dir(f) && f.starts_with(binary_prefix)) {
+				archs.insert(fsif::as_file(f).substr(binary_prefix.size()));
+			}
+		}
+	}
+	return {archs.begin(), archs.end()};
+}
+} // namespace
 
-	std::filesystem::create_directories(dirs.tmp);
+namespace {
+std::string get_cur_date(std::string_view tmp_dir)
+{
+	constexpr std::string_view cur_date_filename = "cur_date"sv;
+	auto cur_date_path = utki::cat(tmp_dir, cur_date_filename);
 	if (std::system(utki::cat("date --rfc-email --utc > ", cur_date_path).c_str()) != 0) {
 		throw std::runtime_error("failed to invoke 'date'");
 	}
@@ -426,6 +1363,31 @@ std::string get_cur_date(const repo_dirs& dirs)
 }
 } // namespace
 
+namespace {
+// Check if the file is a temporary file of the hashing_file_sink.
+bool is_tmp_file(std::string_view filename)
+{
+	return !fsif::is_dir(filename) && filename.ends_with(hashing_file_sink_tmp_suffix);
+}
+
+// Remove temporary files left in the component directory by an aptian process which was killed
+// while writing the index files. Must be called with the component's Packages.lock locked exclusively,
+// so that temporary files of concurrent aptian processes are not removed.
+void remove_stale_tmp_files(std::string_view dir)
+{
+	if (!fsif::native_file(dir).exists()) {
+		return;
+	}
+	for (const auto& f : fsif::native_file(dir).list_dir()) {
+		if (fsif::is_dir(f)) {
+			remove_stale_tmp_files(utki::cat(dir, f));
+		} else if (is_tmp_file(f)) {
+			std::filesystem::remove(utki::cat(dir, f));
+		}
+	}
+}
+} // namespace
+
 namespace {
 struct file_hash_info {
 	std::string path; // path within dists/<dist>
@@ -433,45 +1395,61 @@ struct file_hash_info {
 	file_hashes hashes;
 };
 
-std::vector<file_hash_info> list_files_for_release(const repo_dirs& dirs)
+std::vector<file_hash_info> list_files_for_release(const repo_dirs& dirs, hash_cache& cache)
 {
-	std::filesystem::create_directories(dirs.tmp);
-
 	std::vector<file_hash_info> ret;
 
+	auto add_file = [&](std::string path) {
+		const auto& info = cache.get(path);
+
+		// on 32bit system size_t is only 32 bit, so cannot store all the file sizes
+		if constexpr (sizeof(size_t) < sizeof(uint64_t)) {
+			if (info.stat.size > uint64_t(std::numeric_limits<size_t>::max())) {
+				throw std::invalid_argument(utki::cat("file too big (", info.stat.size, "): ", path));
+			}
+		}
+
+		ret.push_back( //
+			{//
+			 .path = std::move(path),
+			 .size = size_t(info.stat.size),
+			 .hashes = info.hashes
+			}
+		);
+	};
+
 	for (const auto& comp_dir : fsif::native_file(dirs.dist).list_dir()) {
 		if (!fsif::is_dir(comp_dir)) {
 			continue;
 		}
 		auto comp_path = utki::cat(dirs.dist, comp_dir);
+
+		// the index files of the component must not be modified while those are hashed
+		file_lock packages_lock(get_packages_lock_path(dirs, comp_dir), file_lock::mode::shared);
+
 		for (const auto& arch_dir : fsif::native_file(comp_path).list_dir()) {
+			if (is_tmp_file(arch_dir)) {
+				continue;
+			}
 			if (!fsif::is_dir(arch_dir)) {
+				// component level index files, e.g. Contents indices
+				add_file(utki::cat(comp_dir, arch_dir));
 				continue;
 			}
 			auto arch_path = utki::cat(comp_path, arch_dir);
 			for (const auto& file : fsif::native_file(arch_path).list_dir()) {
-				if (fsif::is_dir(file)) {
+				if (file == packages_diff_subdir) {
+					// only the Index goes to the Release file, the patches are listed in the Index
+					auto index_path = utki::cat(comp_dir, arch_dir, packages_diff_subdir, pdiff_index_filename);
+					if (fsif::native_file(utki::cat(dirs.dist, index_path)).exists()) {
+						add_file(std::move(index_path));
+					}
 					continue;
 				}
-				auto path = utki::cat(arch_path, file);
-
-				ret.push_back( //
-					{//
-					 .path = utki::cat(comp_dir, arch_dir, file),
-					 .size =
-						 [&]() {
-							 uint64_t s = fsif::native_file(path).size();
-							 // on 32bit system size_t is only 32 bit, so cannot store all the file sizes
-							 if constexpr (sizeof(size_t) < sizeof(uint64_t)) {
-								 if (s > uint64_t(std::numeric_limits<size_t>::max())) {
-									 throw std::invalid_argument(utki::cat("file too big (", s, "): ", path));
-								 }
-							 }
-							 return size_t(s);
-						 }(),
-					 .hashes = get_file_hashes(dirs, path)
-					}
-				);
+				if (fsif::is_dir(file) || is_tmp_file(file)) {
+					continue;
+				}
+				add_file(utki::cat(comp_dir, arch_dir, file));
 			}
 		}
 	}
@@ -481,10 +1459,17 @@ std::vector<file_hash_info> list_files_for_release(const repo_dirs& dirs)
 } // namespace
 
 namespace {
-void create_release_file(const repo_dirs& dirs, std::string_view dist, std::string_view gpg)
+void create_release_file(
+	const repo_dirs& dirs,
+	std::string_view dist,
+	std::string_view gpg,
+	bool acquire_by_hash,
+	hash_cache& cache,
+	std::string_view tmp_dir
+)
 {
-	auto archs = list_archs(dirs);
 	auto comps = list_components(dirs);
+	auto archs = list_archs(dirs, comps);
 
 	std::stringstream rs;
 	rs << "Origin: aptian" << '\n';
@@ -495,9 +1480,12 @@ void create_release_file(const repo_dirs& dirs, std::string_view dist, std::stri
 	rs << "ButAutomaticUpgrades: no" << '\n';
 	rs << "Components: " << utki::join(comps, ' ') << '\n';
 	rs << "Architectures: " << utki::join(archs, ' ') << '\n';
-	rs << "Date: " << get_cur_date(dirs) << '\n';
+	rs << "Date: " << get_cur_date(tmp_dir) << '\n';
+	if (acquire_by_hash) {
+		rs << "Acquire-By-Hash: yes" << '\n';
+	}
 
-	auto files_for_release = list_files_for_release(dirs);
+	auto files_for_release = list_files_for_release(dirs, cache);
 
 	rs << "MD5Sum:" << '\n';
 	for (const auto& f : files_for_release) {
@@ -519,86 +1507,332 @@ void create_release_file(const repo_dirs& dirs, std::string_view dist, std::stri
 		rs << ' ' << f.hashes.sha512 << ' ' << f.size << ' ' << f.path << '\n';
 	}
 
-	auto release_path = utki::cat(dirs.dist, release_filename);
-	std::cout << "create " << utki::cat(dirs.dist_rel, release_filename) << std::endl;
+	auto release = rs.str();
+
+	auto write_file = [&](std::string_view filename, std::string_view content) {
+		std::cout << "create " << utki::cat(dirs.dist_rel, filename) << std::endl;
+		fsif::native_file fi(utki::cat(dirs.dist, filename));
+		fsif::file::guard file_guard(fi, fsif::mode::create);
+		fi.write(content);
+	};
+
+	write_file(release_filename, release);
+
+	// sign the Release contents once, the same signature goes to both Release.gpg and InRelease
+	auto signatures = sign_release(release, gpg, tmp_dir);
+
+	write_file(release_gpg_filename, signatures.detached);
+	write_file(inrelease_filename, signatures.clearsigned);
+}
+} // namespace
+
+class repository::impl
+{
+	struct dist_state {
+		repo_dirs dirs;
+
+		// index files mostly stay the same between additions, only the ones of the updated
+		// components and architectures change, so cache their hash sums
+		hash_cache cache;
+
+		std::map<std::string, architectures, std::less<>> comps;
+	};
+
+	std::map<std::string, dist_state, std::less<>> dists;
+
+	dist_state& get_dist(std::string_view dist)
 	{
-		fsif::native_file release_file(release_path);
-		fsif::file::guard file_guard(release_file, fsif::mode::create);
-		release_file.write(rs.str());
+		auto i = this->dists.find(dist);
+		if (i != this->dists.end()) {
+			return i->second;
+		}
+
+		auto dirs = make_repo_dirs(this->dir, dist, {});
+		auto cache_path = utki::cat(dirs.dist_state, hash_cache_filename);
+		auto base_dir = dirs.dist;
+
+		auto res = this->dists.emplace(
+			std::piecewise_construct,
+			std::forward_as_tuple(dist),
+			std::forward_as_tuple(std::move(dirs), hash_cache(std::move(cache_path), std::move(base_dir)))
+		);
+		ASSERT(res.second)
+
+		return res.first->second;
 	}
 
-	auto release_gpg_path = utki::cat(dirs.dist, release_gpg_filename);
-	std::cout << "create " << utki::cat(dirs.dist_rel, release_gpg_filename) << std::endl;
-	std::filesystem::remove(release_gpg_path);
-	if (std::system( //
-			utki::cat(
-				"gpg",
-				" --batch", // Use  batch  mode.  Never ask, do not allow interactive commands.
-				" --armor --detach-sign --sign --no-tty --use-agent --local-user=",
-				gpg,
-				" --output=",
-				release_gpg_path,
-				' ',
-				release_path
+	architectures& get_comp(dist_state& ds, std::string_view dist, std::string_view comp)
+	{
+		auto i = ds.comps.find(comp);
+		if (i != ds.comps.end()) {
+			return i->second;
+		}
+
+		auto dirs = make_repo_dirs(this->dir, dist, comp);
+
+		auto res = ds.comps.emplace(
+			std::piecewise_construct,
+			std::forward_as_tuple(comp),
+			std::forward_as_tuple(
+				std::move(dirs.comp),
+				std::move(dirs.comp_rel),
+				std::move(dirs.dist_state),
+				ds.cache,
+				this->options,
+				this->compression_formats,
+				this->by_hash_retention,
+				this->pdiff_history_size,
+				this->contents,
+				std::move(dirs.base)
 			)
-				.c_str()
-		) != 0)
+		);
+		ASSERT(res.second)
+
+		return res.first->second;
+	}
+
+	// Put package files to the pools of the request's targets.
+	// Returns the packages to add to the index files of each target.
+	std::vector<std::pair<const add_target*, std::vector<unadded_package>>> add_to_pools(
+		const add_request& request,
+		std::vector<read_package_file> packages
+	)
 	{
-		throw std::runtime_error(utki::cat("could not create gpg signature of ", release_filename, " file"));
+		auto pool_insertion = this->pool_insertion;
+
+		std::vector<std::pair<const add_target*, std::vector<unadded_package>>> ret;
+
+		for (const auto& t : request.targets) {
+			ASSERT(!t.dist.empty())
+			ASSERT(!t.comp.empty())
+
+			// TODO: use std::ranges::find_if() when ubuntu focal support can be dropped
+			// NOLINTNEXTLINE(modernize-use-ranges, "ranges not supported in gcc from ubuntu focal")
+			if (std::find_if(ret.begin(), ret.end(), [&](const auto& r) {
+					return r.first->dist == t.dist && r.first->comp == t.comp;
+				}) != ret.end())
+			{
+				continue;
+			}
+
+			auto dirs = make_repo_dirs(this->dir, t.dist, t.comp);
+
+			// the pool of the component is shared with concurrent aptian processes
+			file_lock packages_lock(get_packages_lock_path(dirs, dirs.comp_rel));
+
+			auto unadded_packages = prepare_control_info(packages, dirs);
+
+			add_packages_to_pool(unadded_packages, dirs, pool_insertion);
+
+			if (this->contents) {
+				// the package file lists are kept, so that the package files are not read again
+				// in case the Contents index needs to be rebuilt
+				ASSERT(packages.size() == unadded_packages.size())
+				for (size_t i = 0; i != packages.size(); ++i) {
+					save_package_files(
+						get_package_files_cache_path(dirs.base, unadded_packages[i].pkg.fields.filename),
+						packages[i].hashes.sha256,
+						packages[i].files
+					);
+				}
+			}
+
+			if (pool_insertion == insertion_method::move) {
+				// the package files are not at their original paths anymore,
+				// put them to the pools of the rest of the targets from the pool of this target
+				ASSERT(packages.size() == unadded_packages.size())
+				for (size_t i = 0; i != packages.size(); ++i) {
+					packages[i].file_path = utki::cat(dirs.base, unadded_packages[i].pkg.fields.filename);
+				}
+				pool_insertion = insertion_method::hardlink;
+			}
+
+			ret.emplace_back(&t, std::move(unadded_packages));
+		}
+
+		return ret;
 	}
 
-	auto inrelease_path = utki::cat(dirs.dist, inrelease_filename);
-	std::cout << "create " << utki::cat(dirs.dist_rel, inrelease_filename) << std::endl;
-	std::filesystem::remove(inrelease_path);
-	if (std::system( //
-			utki::cat(
-				"gpg --clearsign --no-tty --use-agent --local-user=",
-				gpg,
-				" --output=",
-				inrelease_path,
-				' ',
-				release_path
-			)
-				.c_str()
-		) != 0)
+	// Write index files of the components and Release file of the dist.
+	void publish(
+		std::string_view dist,
+		std::map<std::string_view, std::vector<unadded_package>>& comps,
+		std::string_view tmp_dir
+	)
 	{
-		throw std::runtime_error(utki::cat("could not create ", inrelease_filename, " file"));
+		auto& ds = this->get_dist(dist);
+
+		try {
+			for (auto& [comp, packages] : comps) {
+				// the components are locked one at a time, so that concurrent aptian processes
+				// can update other components of the dist meanwhile
+				file_lock packages_lock(get_packages_lock_path(ds.dirs, fsif::as_dir(comp)));
+
+				remove_stale_tmp_files(utki::cat(ds.dirs.dist, fsif::as_dir(comp)));
+
+				auto& archs = this->get_comp(ds, dist, comp);
+
+				archs.refresh();
+
+				for (auto& p : packages) {
+					archs.add(std::move(p.pkg));
+				}
+
+				archs.write_packages();
+			}
+
+			// the Release file reflects the index files of all the components, including the ones
+			// updated by concurrent aptian processes, so the last one to update it publishes all the updates
+			file_lock release_lock(utki::cat(ds.dirs.dist_state, release_lock_filename));
+
+			create_release_file(
+				ds.dirs,
+				dist,
+				this->config.get_gpg(),
+				this->by_hash_retention != 0,
+				ds.cache,
+				tmp_dir
+			);
+
+			ds.cache.save();
+		} catch (...) {
+			// the in-memory state of the dist is not consistent anymore, it will be loaded again on demand
+			this->dists.erase(this->dists.find(dist));
+			throw;
+		}
 	}
-}
-} // namespace
 
-void aptian::add(
-	std::string_view dir,
-	std::string_view dist,
-	std::string_view comp,
-	utki::span<const std::string> package_paths
-)
+public:
+	const std::string dir;
+	const add_options options;
+
+	configuration config;
+
+	const std::vector<compression_format> compression_formats;
+	const insertion_method pool_insertion;
+	const unsigned by_hash_retention;
+	const unsigned pdiff_history_size;
+	const bool contents;
+
+	impl(std::string_view dir, const add_options& options) :
+		dir(dir),
+		options(options),
+		config(dir),
+		compression_formats(this->config.get_compression_formats()),
+		pool_insertion(options.pool_insertion.value_or(this->config.get_pool_insertion_method())),
+		by_hash_retention(this->config.get_by_hash_retention()),
+		pdiff_history_size(this->config.get_pdiff_history_size()),
+		contents(this->config.get_contents())
+	{}
+
+	std::vector<std::exception_ptr> add(utki::span<const add_request> requests)
+	{
+		std::vector<std::exception_ptr> errors(requests.size());
+
+		// each invocation has its own temporary directory, so that concurrent aptian processes do not interfere
+		auto tmp_dir = make_tmp_dir(this->dir);
+		utki::scope_exit tmp_dir_scope_exit([&]() {
+			std::filesystem::remove_all(tmp_dir);
+		});
+
+		struct dist_batch {
+			std::map<std::string_view, std::vector<unadded_package>> comps;
+
+			// indices of the requests adding packages to the dist
+			std::vector<size_t> requests;
+		};
+
+		// group the packages by dist, since each dist has one Release file to update
+		std::map<std::string_view, dist_batch> dists;
+
+		// the package files are read and hashed only once, regardless of the number of targets
+		auto read_packages = read_package_files(requests, this->options.num_jobs, this->contents, errors);
+
+		for (size_t i = 0; i != requests.size(); ++i) {
+			if (errors[i]) {
+				continue;
+			}
+			try {
+				for (auto& [t, packages] : this->add_to_pools(requests[i], std::move(read_packages[i]))) {
+					auto& db = dists[t->dist];
+
+					auto& comp_packages = db.comps[t->comp];
+					comp_packages.insert(
+						comp_packages.end(),
+						std::make_move_iterator(packages.begin()),
+						std::make_move_iterator(packages.end())
+					);
+
+					if (db.requests.empty() || db.requests.back() != i) {
+						db.requests.push_back(i);
+					}
+				}
+			} catch (...) {
+				// failed request does not affect the other requests of the batch,
+				// its package files might be left in the pool, but those are not referred from the index files
+				errors[i] = std::current_exception();
+			}
+		}
+
+		for (auto& [dist, db] : dists) {
+			try {
+				this->publish(dist, db.comps, tmp_dir);
+			} catch (...) {
+				for (auto i : db.requests) {
+					if (!errors[i]) {
+						errors[i] = std::current_exception();
+					}
+				}
+			}
+		}
+
+		return errors;
+	}
+};
+
+repository::repository(std::string_view dir, const add_options& options) :
+	pimpl(std::make_unique<impl>(dir, options))
 {
 	ASSERT(!dir.empty())
-	ASSERT(!dist.empty())
-	ASSERT(!comp.empty())
-	ASSERT(!package_paths.empty())
+}
 
-	configuration config(dir);
+repository::~repository() = default;
 
-	repo_dirs dirs = {
-		.base = std::string(dir),
-		.dist_rel = utki::cat(dists_subdir, fsif::as_dir(dist)),
-		.dist = utki::cat(dir, dirs.dist_rel),
-		.comp = utki::cat(dirs.dist, fsif::as_dir(comp)),
-		.pool = utki::cat(pool_subdir, fsif::as_dir(dist), fsif::as_dir(comp)),
-		.tmp = utki::cat(dir, tmp_subdir)
+void repository::add(utki::span<const add_target> targets, utki::span<const std::string> package_paths)
+{
+	ASSERT(!targets.empty())
+	ASSERT(!package_paths.empty())
+
+	add_request request{
+		.targets = std::vector<add_target>(targets.begin(), targets.end()),
+		.package_paths = std::vector<std::string>(package_paths.begin(), package_paths.end())
 	};
 
-	auto unadded_packages = prepare_control_info(package_paths, dirs);
+	auto errors = this->pimpl->add(utki::make_span(&request, 1));
+	ASSERT(errors.size() == 1)
 
-	add_packages_to_pool(unadded_packages, dirs);
+	if (errors.front()) {
+		std::rethrow_exception(errors.front());
+	}
+}
 
-	add_to_architectures(std::move(unadded_packages), dirs);
+std::vector<std::exception_ptr> repository::add(utki::span<const add_request> requests)
+{
+	return this->pimpl->add(requests);
+}
+
+void aptian::add(
+	std::string_view dir,
+	utki::span<const add_target> targets,
+	utki::span<const std::string> package_paths,
+	const add_options& options
+)
+{
+	ASSERT(!dir.empty())
 
-	create_release_file(dirs, dist, config.get_gpg());
+	repository repo(dir, options);
 
-	std::filesystem::remove_all(dirs.tmp);
+	repo.add(targets, package_paths);
 
 	std::cout << "done" << std::endl;
 }
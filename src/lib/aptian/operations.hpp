@@ -20,22 +20,119 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.*/
 
 #pragma once
 
+#include <exception>
+#include <memory>
+#include <optional>
+#include <string>
 #include <string_view>
+#include <vector>
 
 #include <utki/span.hpp>
 
+#include "compressor.hpp"
+#include "configuration.hpp"
+#include "file_insertion.hpp"
+
 namespace aptian {
 
+/**
+ * @brief Initialize APT repository.
+ * @param dir - base directory of the repository.
+ * @param gpg - GPG key to use for signing.
+ * @param settings - repository settings.
+ */
 void init( //
 	std::string_view dir,
-	std::string_view gpg
+	std::string_view gpg,
+	const repository_settings& settings
 );
 
+struct add_options {
+	// number of parallel jobs to use for reading and hashing the package files and writing the index files,
+	// the index files of different architectures are written in parallel
+	unsigned num_jobs = 1;
+
+	// make compressed index files rsync friendly
+	bool rsyncable = false;
+
+	// method of putting package files to the pool, overrides the one from repository configuration,
+	// in case of 'move' the package files are moved to the pool of the first target and
+	// hard linked (or copied) from there to the pools of other targets
+	std::optional<insertion_method> pool_insertion;
+};
+
+struct add_target {
+	std::string dist; // distribution name
+	std::string comp; // component name
+};
+
+struct add_request {
+	std::vector<add_target> targets;
+	std::vector<std::string> package_paths;
+};
+
+/**
+ * @brief APT repository opened for adding packages.
+ * The repository state, i.e. configuration, cached hash sums of the index files and indices of the Packages files,
+ * is loaded on demand and kept in memory between additions of packages, so that a long-running process
+ * does not load it again for each addition. The state is checked against the repository files on each addition,
+ * so that changes made by other processes are picked up.
+ */
+class repository
+{
+	class impl;
+	std::unique_ptr<impl> pimpl;
+
+public:
+	/**
+	 * @brief Open repository.
+	 * @param dir - base directory of the repository.
+	 * @param options - options of adding packages.
+	 * @throw std::invalid_argument - in case the directory is not an aptian repository.
+	 */
+	repository(std::string_view dir, const add_options& options);
+
+	repository(const repository&) = delete;
+	repository& operator=(const repository&) = delete;
+
+	repository(repository&&) = delete;
+	repository& operator=(repository&&) = delete;
+
+	~repository();
+
+	/**
+	 * @brief Add packages.
+	 * @param targets - distribution components to add the packages to.
+	 * @param package_paths - paths to .deb files to add.
+	 */
+	void add(utki::span<const add_target> targets, utki::span<const std::string> package_paths);
+
+	/**
+	 * @brief Add packages of several requests as one batch.
+	 * Index files of each affected component are written once and Release file of each affected distribution
+	 * is updated and signed once for the whole batch.
+	 * A request whose package files cannot be read or conflict with the files already in the pool fails alone,
+	 * without affecting the other requests of the batch.
+	 * @param requests - requests to add packages.
+	 * @return Errors of the requests, in the same order as the requests. Null for succeeded requests.
+	 */
+	std::vector<std::exception_ptr> add(utki::span<const add_request> requests);
+};
+
+/**
+ * @brief Add packages to APT repository.
+ * The package files are read and hashed only once, then the packages are added to each of the targets.
+ * Release file of each affected distribution is updated once.
+ * @param dir - base directory of the repository.
+ * @param targets - distribution components to add the packages to.
+ * @param package_paths - paths to .deb files to add.
+ * @param options - additional options.
+ */
 void add( //
 	std::string_view dir,
-	std::string_view dist,
-	std::string_view comp,
-	utki::span<const std::string> package_paths
+	utki::span<const add_target> targets,
+	utki::span<const std::string> package_paths,
+	const add_options& options
 );
 
 } // namespace aptian
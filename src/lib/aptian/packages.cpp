@@ -20,10 +20,16 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.*/
 
 #include "packages.hpp"
 
+#include <algorithm>
+#include <iterator>
+#include <optional>
 #include <stdexcept>
 
+#include <fsif/native_file.hpp>
 #include <utki/string.hpp>
 
+#include "mapped_file.hpp"
+
 using namespace std::string_view_literals;
 
 using namespace aptian;
@@ -39,42 +45,87 @@ constexpr std::string_view sha256_entry = "SHA256: "sv;
 constexpr std::string_view sha512_entry = "SHA512: "sv;
 constexpr std::string_view size_entry = "Size: "sv;
 constexpr std::string_view architecture_entry = "Architecture: "sv;
+
+// new line ending the last line of a paragraph and empty line separating it from the next paragraph
+constexpr std::string_view paragraph_terminator = "\n\n"sv;
+
+// the packages are written to the output in chunks of this size
+constexpr size_t write_buffer_size = 0x10000;
+} // namespace
+
+namespace {
+// Make control paragraph normalized, i.e. without CR characters and surrounding empty lines.
+// Returns std::nullopt if the paragraph is already normalized.
+std::optional<std::string> normalize(std::string_view paragraph)
+{
+	if (paragraph.find('\r') == std::string_view::npos && //
+		!paragraph.starts_with('\n') && !paragraph.ends_with('\n'))
+	{
+		return std::nullopt;
+	}
+
+	std::string ret;
+	ret.reserve(paragraph.size());
+
+	// TODO: use std::ranges::copy_if() when ubuntu focal support can be dropped
+	// NOLINTNEXTLINE(modernize-use-ranges, "ranges not supported in gcc from ubuntu focal")
+	std::copy_if(paragraph.begin(), paragraph.end(), std::back_inserter(ret), [](char c) {
+		return c != '\r';
+	});
+
+	auto begin = ret.find_first_not_of('\n');
+	if (begin == std::string::npos) {
+		return std::string();
+	}
+	ret.erase(ret.find_last_not_of('\n') + 1);
+	ret.erase(0, begin);
+
+	return ret;
+}
 } // namespace
 
 package::package(std::string_view control) :
-	control(utki::split(control, '\n')),
-	fields(parse(this->control))
+	package(std::make_shared<const std::string>(normalize(control).value_or(std::string(control))))
+{}
+
+package::package(const std::shared_ptr<const std::string>& control) :
+	package(*control, control)
 {}
 
-package::package(const package& p) :
-	control(p.control),
-	fields(parse(this->control))
+package::package(std::string_view control, std::shared_ptr<const void> storage) :
+	storage(std::move(storage)),
+	control(control),
+	fields([this]() {
+		if (auto normalized = normalize(this->control)) {
+			// rare case, make own copy of the data
+			auto str = std::make_shared<const std::string>(std::move(normalized.value()));
+			this->control = *str;
+			this->storage = std::move(str);
+		}
+		return parse(this->control);
+	}())
 {}
 
-package::control_fields package::parse(utki::span<const std::string> control)
+package::control_fields package::parse(std::string_view control)
 {
 	control_fields ret;
 
-	for (std::string_view line : control) {
+	while (!control.empty()) {
+		// std::string_view::find() uses memchr() which is normally vectorized by the C library
+		auto line_end = control.find('\n');
+		std::string_view line = control.substr(0, line_end);
+		control = line_end == std::string_view::npos ? std::string_view() : control.substr(line_end + 1);
+
 		if (line.starts_with(package_entry)) {
 			ret.package = line.substr(package_entry.size());
-			// std::cout << "package entry found: " << ret.package << std::endl;
-		}
-		if (line.starts_with(filename_entry)) {
+		} else if (line.starts_with(filename_entry)) {
 			ret.filename = line.substr(filename_entry.size());
-			// std::cout << "filename entry found: " << ret.filename << std::endl;
-		}
-		if (line.starts_with(version_entry)) {
+		} else if (line.starts_with(version_entry)) {
 			ret.version = line.substr(version_entry.size());
-			// std::cout << "version entry found: " << ret.version << std::endl;
-		}
-		if (line.starts_with(source_entry)) {
+		} else if (line.starts_with(source_entry)) {
 			ret.source = line.substr(source_entry.size());
-			// std::cout << "source entry found: " << ret.source << std::endl;
-		}
-		if (line.starts_with(architecture_entry)) {
+		} else if (line.starts_with(architecture_entry)) {
 			ret.architecture = line.substr(architecture_entry.size());
-			// std::cout << "source entry found: " << ret.source << std::endl;
 		}
 	}
 
@@ -91,15 +142,40 @@ package::control_fields package::parse(utki::span<const std::string> control)
 	return ret;
 }
 
-std::string package::to_string() const
+package::pool_file_fields package::parse_pool_file_fields(std::string_view control)
 {
-	std::stringstream ss;
+	pool_file_fields ret;
+
+	while (!control.empty()) {
+		auto line_end = control.find('\n');
+		std::string_view line = control.substr(0, line_end);
+		control = line_end == std::string_view::npos ? std::string_view() : control.substr(line_end + 1);
 
-	for (const auto& line : this->control) {
-		ss << line << '\n';
+		if (line.ends_with('\r')) {
+			line.remove_suffix(1);
+		}
+
+		if (line.starts_with(filename_entry)) {
+			ret.filename = line.substr(filename_entry.size());
+		} else if (line.starts_with(size_entry)) {
+			ret.size = line.substr(size_entry.size());
+		} else if (line.starts_with(md5sum_entry)) {
+			ret.md5sum = line.substr(md5sum_entry.size());
+		} else if (line.starts_with(sha1_entry)) {
+			ret.sha1 = line.substr(sha1_entry.size());
+		} else if (line.starts_with(sha256_entry)) {
+			ret.sha256 = line.substr(sha256_entry.size());
+		} else if (line.starts_with(sha512_entry)) {
+			ret.sha512 = line.substr(sha512_entry.size());
+		}
 	}
 
-	return ss.str();
+	return ret;
+}
+
+std::string package::to_string() const
+{
+	return utki::cat(this->control, '\n');
 }
 
 std::string package::get_name() const
@@ -113,90 +189,131 @@ std::string package::get_name() const
 
 void package::append(std::string_view pool_path, size_t size, const file_hashes& hashes)
 {
-	this->control.push_back(utki::cat(filename_entry, pool_path));
-	this->control.push_back(utki::cat(size_entry, size));
-	this->control.push_back(utki::cat(md5sum_entry, hashes.md5));
-	this->control.push_back(utki::cat(sha1_entry, hashes.sha1));
-	this->control.push_back(utki::cat(sha256_entry, hashes.sha256));
-	this->control.push_back(utki::cat(sha512_entry, hashes.sha512));
-
-	this->fields = parse(this->control);
+	*this = package(utki::cat(
+		this->to_string(),
+		filename_entry,
+		pool_path,
+		'\n',
+		size_entry,
+		size,
+		'\n',
+		md5sum_entry,
+		hashes.md5,
+		'\n',
+		sha1_entry,
+		hashes.sha1,
+		'\n',
+		sha256_entry,
+		hashes.sha256,
+		'\n',
+		sha512_entry,
+		hashes.sha512
+	));
 }
 
-namespace {
-class parser
+std::vector<std::string_view> aptian::split_paragraphs(std::string_view data)
 {
-	bool line_start = true;
+	std::vector<std::string_view> ret;
 
-	std::vector<char> buf;
+	size_t paragraph_begin = std::string_view::npos;
+	size_t paragraph_end = 0;
 
-	void feed(utki::span<const char> span)
-	{
-		for (char c : span) {
-			if (c == '\r') {
-				continue;
+	for (size_t pos = 0; pos < data.size();) {
+		auto line_end = std::min(data.find('\n', pos), data.size());
+
+		auto line = data.substr(pos, line_end - pos);
+		if (line.ends_with('\r')) {
+			line.remove_suffix(1);
+		}
+
+		if (line.empty()) {
+			if (paragraph_begin != std::string_view::npos) {
+				ret.push_back(data.substr(paragraph_begin, paragraph_end - paragraph_begin));
+				paragraph_begin = std::string_view::npos;
 			}
-			if (c == '\n') {
-				if (this->line_start) {
-					// package parsed
-					if (!this->buf.empty()) {
-						ASSERT(this->buf.back() == '\n')
-						this->buf.pop_back();
-						this->packages.emplace_back(utki::make_string_view(this->buf));
-						this->buf.clear();
-						// std::cout << "package read:" << '\n';
-						// std::cout << this->packages.back().to_string();
-					}
-					ASSERT(this->buf.empty())
-				} else {
-					ASSERT(!this->buf.empty())
-					this->buf.push_back(c);
-				}
-				this->line_start = true;
-			} else {
-				this->line_start = false;
-				this->buf.push_back(c);
+		} else {
+			if (paragraph_begin == std::string_view::npos) {
+				paragraph_begin = pos;
 			}
+			paragraph_end = line_end;
 		}
-	}
 
-public:
-	std::vector<package> packages;
+		pos = line_end + 1;
+	}
 
-	void parse(const fsif::file& fi)
-	{
-		fsif::file::guard file_guard(fi, fsif::mode::read);
+	if (paragraph_begin != std::string_view::npos) {
+		ret.push_back(data.substr(paragraph_begin, paragraph_end - paragraph_begin));
+	}
 
-		constexpr auto read_buffer_size = 0x1000;
-		std::array<uint8_t, read_buffer_size> buf{};
+	return ret;
+}
 
-		for (;;) {
-			auto num_bytes_read = fi.read(buf);
-			if (num_bytes_read == 0) {
-				// EOF reached
-				this->feed("\n\n"sv);
-				break;
-			}
+namespace {
+std::vector<package> parse_packages(std::string_view data, const std::shared_ptr<const void>& storage)
+{
+	auto paragraphs = split_paragraphs(data);
 
-			auto span = utki::make_span(buf.data(), num_bytes_read);
-			this->feed(utki::to_char(span));
-		}
+	std::vector<package> ret;
+	ret.reserve(paragraphs.size());
+	for (auto p : paragraphs) {
+		ret.emplace_back(p, storage);
 	}
-};
+	return ret;
+}
 } // namespace
 
 std::vector<package> aptian::read_packages_file(const fsif::file& fi)
 {
-	parser p;
-	p.parse(fi);
-	return std::move(p.packages);
+	// map native files to memory, so that the packages reference the file contents in the page cache
+	if (const auto* native_file = dynamic_cast<const fsif::native_file*>(&fi)) {
+		auto mapping = std::make_shared<const mapped_file>(native_file->path());
+		return parse_packages(utki::make_string_view(mapping->span()), mapping);
+	}
+
+	auto data = std::make_shared<const std::vector<uint8_t>>(fi.load());
+	return parse_packages(utki::make_string_view(*data), data);
 }
 
 std::string aptian::to_string(utki::span<const package> packages)
 {
-	std::stringstream ss;
+	size_t size = 0;
+	for (const auto& p : packages) {
+		size += p.get_control().size() + paragraph_terminator.size();
+	}
+
+	std::string ret;
+	ret.reserve(size);
+	for (const auto& p : packages) {
+		ret.append(p.get_control());
+		ret.append(paragraph_terminator);
+	}
+	return ret;
+}
+
+void aptian::write_packages(utki::span<const package> packages, sink& out)
+{
+	std::vector<uint8_t> buffer;
+	buffer.reserve(write_buffer_size);
+
+	auto append = [&](std::string_view str) {
+		if (buffer.size() + str.size() > write_buffer_size) {
+			out.write(buffer);
+			buffer.clear();
+
+			if (str.size() > write_buffer_size) {
+				out.write(utki::to_uint8_t(utki::make_span(str)));
+				return;
+			}
+		}
+		buffer.insert(buffer.end(), str.begin(), str.end());
+	};
+
 	for (const auto& p : packages) {
-		ss << p.to_string() << "\n";
+		append(p.get_control());
+		append(paragraph_terminator);
+	}
+
+	if (!buffer.empty()) {
+		out.write(buffer);
 	}
-	return ss.str();
 }
@@ -20,31 +20,30 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.*/
 
 #pragma once
 
+#include <memory>
+
 #include <fsif/file.hpp>
 #include <utki/string.hpp>
 
-namespace aptian {
-
-struct file_hashes {
-	std::string md5;
-	std::string sha1;
-	std::string sha256;
-	std::string sha512;
+#include "hasher.hpp"
+#include "sink.hpp"
 
-	bool operator==(const file_hashes& h) const
-	{
-		return //
-			this->md5 == h.md5 && //
-			this->sha1 == h.sha1 && //
-			this->sha256 == h.sha256 && //
-			this->sha512 == h.sha512;
-	}
-};
+namespace aptian {
 
-// TODO: refactor, avoid keeping string_views, use strings
+/**
+ * @brief Binary package index entry.
+ * The package does not own its control paragraph data, instead it shares ownership
+ * of the immutable memory the data resides in, e.g. the memory mapped Packages file
+ * which holds all the packages of the file. The control fields refer to the same memory.
+ * So, copying the package is cheap and does not need to allocate memory.
+ */
 class package
 {
-	std::vector<std::string> control;
+	// owner of the memory the control paragraph resides in
+	std::shared_ptr<const void> storage;
+
+	// control paragraph without trailing new line
+	std::string_view control;
 
 public:
 	struct control_fields {
@@ -56,15 +55,53 @@ public:
 		std::string_view filename;
 	};
 
+	/**
+	 * @brief Parse control fields of a paragraph.
+	 * @param control - control paragraph.
+	 * @return Control fields referring to the paragraph data.
+	 * @throw std::invalid_argument - in case Package, Version or Architecture field is missing.
+	 */
+	static control_fields parse(std::string_view control);
+
+	struct pool_file_fields {
+		std::string_view filename;
+		std::string_view size;
+		std::string_view md5sum;
+		std::string_view sha1;
+		std::string_view sha256;
+		std::string_view sha512;
+	};
+
+	/**
+	 * @brief Parse fields describing the package file in the pool.
+	 * Missing fields are empty. Trailing CR characters are not included in the field values.
+	 * @param control - control paragraph.
+	 * @return Pool file fields referring to the paragraph data.
+	 */
+	static pool_file_fields parse_pool_file_fields(std::string_view control);
+
 private:
-	static control_fields parse(utki::span<const std::string> control);
+	package(const std::shared_ptr<const std::string>& control);
 
 public:
 	control_fields fields;
 
+	/**
+	 * @brief Construct package from control paragraph.
+	 * The control paragraph data is copied.
+	 * @param control - control paragraph.
+	 */
 	package(std::string_view control);
 
-	package(const package&);
+	/**
+	 * @brief Construct package referencing the control paragraph data.
+	 * The control paragraph data is not copied.
+	 * @param control - control paragraph, must reside in the memory owned by the storage.
+	 * @param storage - owner of the memory the control paragraph resides in.
+	 */
+	package(std::string_view control, std::shared_ptr<const void> storage);
+
+	package(const package&) = default;
 
 	// no copy assignment, just in case. Was not needed so far.
 	package& operator=(const package&) = delete;
@@ -74,6 +111,15 @@ public:
 
 	~package() = default;
 
+	/**
+	 * @brief Get control paragraph.
+	 * @return Control paragraph without trailing new line.
+	 */
+	std::string_view get_control() const noexcept
+	{
+		return this->control;
+	}
+
 	std::string to_string() const;
 
 	std::string get_name() const;
@@ -89,8 +135,28 @@ public:
 static_assert(std::is_move_constructible_v<package>, "class package must be movable");
 static_assert(std::is_move_assignable_v<package>, "class package must be movable");
 
+/**
+ * @brief Split control file data to paragraphs.
+ * Paragraphs are separated by one or more empty lines.
+ * @param data - control file data.
+ * @return Paragraphs without trailing new line, referring to the data.
+ *         In case the data has CRLF line endings, the paragraphs contain CR characters.
+ */
+std::vector<std::string_view> split_paragraphs(std::string_view data);
+
 std::vector<package> read_packages_file(const fsif::file& fi);
 
 std::string to_string(utki::span<const package> packages);
 
+/**
+ * @brief Write packages in Packages file format.
+ * The control paragraphs are passed to the output through a fixed size buffer,
+ * so that the memory usage does not depend on the number of packages
+ * and no temporary strings are created.
+ * Each paragraph is followed by an empty line.
+ * @param packages - packages to write.
+ * @param out - sink to write to. The sink is not finished.
+ */
+void write_packages(utki::span<const package> packages, sink& out);
+
 } // namespace aptian
@@ -0,0 +1,326 @@
+/*
+aptian - apt repository tool
+
+Copyright (C) 2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.*/
+
+/* ================ LICENSE END ================ */
+
+#include "packages_index.hpp"
+
+#include <algorithm>
+#include <array>
+#include <filesystem>
+#include <limits>
+#include <stdexcept>
+#include <tuple>
+
+#include <fsif/native_file.hpp>
+#include <utki/debug.hpp>
+#include <utki/string.hpp>
+
+using namespace std::string_view_literals;
+
+using namespace aptian;
+
+/*
+The index file format, all numbers are little-endian:
+
+header:
+	magic: 8 bytes "APTIDX01", the last two characters are the format version
+	Packages file size: uint64
+	Packages file modification time in ns: int64
+	Packages file inode number: uint64
+	number of records: uint64
+records, sorted by (package, version, architecture):
+	paragraph offset: uint64
+	paragraph size: uint64
+	package name offset, size: uint32, uint32
+	version offset, size: uint32, uint32
+	architecture offset, size: uint32, uint32
+strings:
+	the strings referred by the records, offsets are relative to the beginning of the strings
+*/
+
+namespace {
+constexpr std::string_view magic = "APTIDX01"sv;
+constexpr size_t header_size = magic.size() + sizeof(uint64_t) * 4;
+constexpr size_t record_size = sizeof(uint64_t) * 2 + sizeof(uint32_t) * 6;
+} // namespace
+
+namespace {
+template <typename number_type>
+number_type load_le(const uint8_t* p)
+{
+	using unsigned_type = std::make_unsigned_t<number_type>;
+	unsigned_type ret = 0;
+	for (size_t i = 0; i != sizeof(number_type); ++i) {
+		ret |= unsigned_type(p[i]) << (i * 8);
+	}
+	return number_type(ret);
+}
+
+template <typename number_type>
+void store_le(number_type n, std::vector<uint8_t>& out)
+{
+	auto u = std::make_unsigned_t<number_type>(n);
+	for (size_t i = 0; i != sizeof(number_type); ++i) {
+		out.push_back(uint8_t(u >> (i * 8)));
+	}
+}
+} // namespace
+
+namespace {
+auto to_tuple(const packages_index::entry& e)
+{
+	return std::tie(e.package, e.version, e.architecture);
+}
+} // namespace
+
+packages_index::packages_index(std::string_view path) :
+	file(std::make_unique<const mapped_file>(path))
+{
+	auto data = this->file->span();
+
+	if (data.size() < header_size || utki::make_string_view(data.subspan(0, magic.size())) != magic) {
+		throw std::invalid_argument(utki::cat("packages index file is malformed: ", path));
+	}
+
+	const auto* p = data.data() + magic.size();
+	this->packages_stat.size = load_le<uint64_t>(p);
+	p += sizeof(uint64_t);
+	this->packages_stat.mtime_ns = load_le<int64_t>(p);
+	p += sizeof(int64_t);
+	this->packages_stat.inode = load_le<uint64_t>(p);
+	p += sizeof(uint64_t);
+	auto num_records = load_le<uint64_t>(p);
+
+	data = data.subspan(header_size);
+
+	if (num_records > data.size() / record_size) {
+		throw std::invalid_argument(utki::cat("packages index file is truncated: ", path));
+	}
+
+	this->records = data.subspan(0, size_t(num_records) * record_size);
+	this->strings = data.subspan(this->records.size());
+}
+
+size_t packages_index::size() const noexcept
+{
+	return this->records.size() / record_size;
+}
+
+packages_index::entry packages_index::operator[](size_t i) const
+{
+	ASSERT(i < this->size())
+
+	const auto* p = this->records.data() + i * record_size;
+
+	auto get_string = [this](const uint8_t* p) {
+		auto offset = load_le<uint32_t>(p);
+		auto size = load_le<uint32_t>(p + sizeof(uint32_t));
+		if (uint64_t(offset) + size > this->strings.size()) {
+			throw std::invalid_argument("packages index entry is malformed");
+		}
+		return utki::make_string_view(this->strings.subspan(offset, size));
+	};
+
+	constexpr auto string_ref_size = sizeof(uint32_t) * 2;
+
+	return {
+		.package = get_string(p + sizeof(uint64_t) * 2),
+		.version = get_string(p + sizeof(uint64_t) * 2 + string_ref_size),
+		.architecture = get_string(p + sizeof(uint64_t) * 2 + string_ref_size * 2),
+		.offset = load_le<uint64_t>(p),
+		.size = load_le<uint64_t>(p + sizeof(uint64_t))
+	};
+}
+
+std::optional<packages_index::entry> packages_index::find(
+	std::string_view package, //
+	std::string_view version,
+	std::string_view architecture
+) const
+{
+	auto key = std::tie(package, version, architecture);
+
+	size_t begin = 0;
+	size_t end = this->size();
+	while (begin != end) {
+		auto middle = begin + (end - begin) / 2;
+		if (to_tuple(this->operator[](middle)) < key) {
+			begin = middle + 1;
+		} else {
+			end = middle;
+		}
+	}
+
+	if (begin == this->size()) {
+		return std::nullopt;
+	}
+
+	auto e = this->operator[](begin);
+	if (to_tuple(e) != key) {
+		return std::nullopt;
+	}
+	return e;
+}
+
+std::vector<packages_index::entry> packages_index::get_entries() const
+{
+	std::vector<entry> ret;
+	ret.reserve(this->size());
+	for (size_t i = 0; i != this->size(); ++i) {
+		ret.push_back(this->operator[](i));
+	}
+	return ret;
+}
+
+void packages_index::write(std::string_view path, const file_stat& packages_stat, std::vector<entry> entries)
+{
+	// TODO: use std::ranges::sort() when ubuntu focal support can be dropped
+	// NOLINTNEXTLINE(modernize-use-ranges, "ranges not supported in gcc from ubuntu focal")
+	std::sort(entries.begin(), entries.end(), [](const auto& a, const auto& b) {
+		return to_tuple(a) < to_tuple(b);
+	});
+
+	std::vector<uint8_t> data;
+	data.reserve(header_size + entries.size() * record_size);
+
+	data.insert(data.end(), magic.begin(), magic.end());
+	store_le(packages_stat.size, data);
+	store_le(packages_stat.mtime_ns, data);
+	store_le(packages_stat.inode, data);
+	store_le(uint64_t(entries.size()), data);
+
+	std::string strings;
+
+	auto store_string = [&](std::string_view str) {
+		store_le(uint32_t(strings.size()), data);
+		store_le(uint32_t(str.size()), data);
+		strings.append(str);
+	};
+
+	for (const auto& e : entries) {
+		store_le(e.offset, data);
+		store_le(e.size, data);
+		store_string(e.package);
+		store_string(e.version);
+		store_string(e.architecture);
+	}
+
+	if (strings.size() > std::numeric_limits<uint32_t>::max()) {
+		throw std::length_error("packages index is too big");
+	}
+
+	data.insert(data.end(), strings.begin(), strings.end());
+
+	std::filesystem::create_directories(fsif::dir(path));
+
+	// write to temporary file and then rename it to make the index update atomic
+	auto tmp_path = utki::cat(path, ".new"sv);
+	{
+		fsif::native_file fi(tmp_path);
+		fsif::file::guard file_guard(fi, fsif::mode::create);
+		fi.write(data);
+	}
+	std::filesystem::rename(tmp_path, path);
+}
+
+packages_index packages_index::load_or_build(std::string_view path, std::string_view packages_path)
+{
+	auto stat = get_file_stat(packages_path);
+	if (!stat.has_value()) {
+		throw std::invalid_argument(utki::cat("file not found: ", packages_path));
+	}
+
+	if (get_file_stat(path).has_value()) {
+		try {
+			packages_index index(path);
+			if (index.get_packages_stat() == stat.value()) {
+				return index;
+			}
+		} catch (std::invalid_argument&) {
+			// the index is malformed, rebuild it
+		}
+	}
+
+	{
+		mapped_file packages(packages_path);
+		auto entries = index_paragraphs(utki::make_string_view(packages.span()), 0);
+
+		// in case the file was changed while it was being indexed, the index is not valid
+		if (get_file_stat(packages_path) != stat) {
+			throw std::runtime_error(utki::cat("file was modified while indexing it: ", packages_path));
+		}
+
+		write(path, stat.value(), std::move(entries));
+	}
+
+	return packages_index(path);
+}
+
+std::vector<packages_index::entry> aptian::index_paragraphs(std::string_view data, uint64_t offset)
+{
+	auto paragraphs = split_paragraphs(data);
+
+	std::vector<packages_index::entry> ret;
+	ret.reserve(paragraphs.size());
+
+	for (auto p : paragraphs) {
+		auto fields = package::parse(p);
+
+		// the paragraph can have CRLF line endings
+		auto trim_cr = [](std::string_view str) {
+			if (str.ends_with('\r')) {
+				str.remove_suffix(1);
+			}
+			return str;
+		};
+
+		ret.push_back({
+			.package = trim_cr(fields.package),
+			.version = trim_cr(fields.version),
+			.architecture = trim_cr(fields.architecture),
+			.offset = offset + uint64_t(p.data() - data.data()),
+			.size = p.size()
+		});
+	}
+
+	return ret;
+}
+
+std::vector<packages_index::entry> aptian::index_packages(utki::span<const package> packages, uint64_t offset)
+{
+	std::vector<packages_index::entry> ret;
+	ret.reserve(packages.size());
+
+	for (const auto& p : packages) {
+		auto control = p.get_control();
+
+		ret.push_back({
+			.package = p.fields.package,
+			.version = p.fields.version,
+			.architecture = p.fields.architecture,
+			.offset = offset,
+			.size = control.size()
+		});
+
+		// paragraphs are separated by empty line
+		offset += control.size() + 2;
+	}
+
+	return ret;
+}
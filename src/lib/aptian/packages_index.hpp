@@ -0,0 +1,152 @@
+/*
+aptian - apt repository tool
+
+Copyright (C) 2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.*/
+
+/* ================ LICENSE END ================ */
+
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "file_stat.hpp"
+#include "mapped_file.hpp"
+#include "packages.hpp"
+
+namespace aptian {
+
+/**
+ * @brief Binary index of a Packages file.
+ * The index is a table of (package, version, architecture) keys sorted in lexicographical order,
+ * each key refers to the location of the package's control paragraph within the Packages file.
+ * The index file is mapped to memory, so that lookups neither read the whole index nor parse the Packages file.
+ * The index records size, modification time and inode number of the Packages file it was built for,
+ * so that it is possible to detect if the Packages file has changed since then.
+ */
+class packages_index
+{
+public:
+	struct entry {
+		std::string_view package;
+		std::string_view version;
+		std::string_view architecture;
+
+		// location of the control paragraph within the Packages file
+		uint64_t offset;
+		uint64_t size;
+	};
+
+private:
+	std::unique_ptr<const mapped_file> file;
+
+	file_stat packages_stat{};
+
+	utki::span<const uint8_t> records;
+	utki::span<const uint8_t> strings;
+
+public:
+	/**
+	 * @brief Load index file.
+	 * @param path - path to the index file.
+	 * @throw std::system_error - in case the file could not be opened.
+	 * @throw std::invalid_argument - in case the file is malformed.
+	 */
+	packages_index(std::string_view path);
+
+	/**
+	 * @brief Get stat of the Packages file the index was built for.
+	 */
+	const file_stat& get_packages_stat() const noexcept
+	{
+		return this->packages_stat;
+	}
+
+	size_t size() const noexcept;
+
+	/**
+	 * @brief Get index entry.
+	 * The entries are sorted by (package, version, architecture).
+	 * @param i - entry index.
+	 * @return The entry. The entry's strings refer to the index file data.
+	 * @throw std::invalid_argument - in case the entry is malformed.
+	 */
+	entry operator[](size_t i) const;
+
+	/**
+	 * @brief Find package.
+	 * Binary search, the complexity is logarithmic.
+	 * @param package - package name.
+	 * @param version - package version.
+	 * @param architecture - package architecture.
+	 * @return The found entry.
+	 * @return std::nullopt if the package is not in the index.
+	 */
+	std::optional<entry> find(
+		std::string_view package, //
+		std::string_view version,
+		std::string_view architecture
+	) const;
+
+	/**
+	 * @brief Get all entries.
+	 * @return Entries referring to the index file data.
+	 */
+	std::vector<entry> get_entries() const;
+
+	/**
+	 * @brief Write index file.
+	 * The index file is replaced atomically.
+	 * @param path - path to the index file.
+	 * @param packages_stat - stat of the Packages file the index is built for.
+	 * @param entries - index entries, in any order.
+	 */
+	static void write(std::string_view path, const file_stat& packages_stat, std::vector<entry> entries);
+
+	/**
+	 * @brief Load index of the Packages file.
+	 * If the index file is missing, malformed or was built for different Packages file contents,
+	 * then the index is rebuilt from the Packages file.
+	 * @param path - path to the index file.
+	 * @param packages_path - path to the Packages file.
+	 * @return Loaded index.
+	 * @throw std::invalid_argument - in case the Packages file does not exist.
+	 * @throw std::runtime_error - in case the Packages file was modified while building the index.
+	 */
+	static packages_index load_or_build(std::string_view path, std::string_view packages_path);
+};
+
+/**
+ * @brief Build index entries of control paragraphs.
+ * @param data - Packages file data or its part.
+ * @param offset - offset of the data within the Packages file.
+ * @return Index entries, the entries' strings refer to the data.
+ * @throw std::invalid_argument - in case a paragraph lacks Package, Version or Architecture field.
+ */
+std::vector<packages_index::entry> index_paragraphs(std::string_view data, uint64_t offset);
+
+/**
+ * @brief Build index entries of packages.
+ * The packages are assumed to be written to the Packages file with write_packages().
+ * @param packages - packages to index.
+ * @param offset - offset within the Packages file the packages are written at.
+ * @return Index entries, the entries' strings refer to the packages data.
+ */
+std::vector<packages_index::entry> index_packages(utki::span<const package> packages, uint64_t offset);
+
+} // namespace aptian
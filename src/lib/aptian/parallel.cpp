@@ -0,0 +1,93 @@
+/*
+aptian - apt repository tool
+
+Copyright (C) 2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.*/
+
+/* ================ LICENSE END ================ */
+
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+using namespace aptian;
+
+unsigned aptian::get_default_num_jobs()
+{
+	return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+void aptian::parallel_for(size_t count, unsigned num_jobs, const std::function<void(size_t)>& func)
+{
+	if (num_jobs <= 1 || count <= 1) {
+		for (size_t i = 0; i != count; ++i) {
+			func(i);
+		}
+		return;
+	}
+
+	std::atomic<size_t> next_index = 0;
+	std::atomic<bool> failed = false;
+
+	std::vector<std::exception_ptr> errors(count);
+
+	auto worker = [&]() {
+		while (!failed.load()) {
+			auto i = next_index.fetch_add(1);
+			if (i >= count) {
+				break;
+			}
+
+			try {
+				func(i);
+			} catch (...) {
+				errors[i] = std::current_exception();
+				failed.store(true);
+			}
+		}
+	};
+
+	auto num_threads = size_t(std::min(size_t(num_jobs), count));
+
+	// TODO: use std::jthread when ubuntu focal support can be dropped
+	std::vector<std::thread> threads;
+	threads.reserve(num_threads - 1);
+	for (size_t i = 1; i != num_threads; ++i) {
+		try {
+			threads.emplace_back(worker);
+		} catch (std::system_error&) {
+			// could not create more threads, proceed with those already created
+			break;
+		}
+	}
+
+	// calling thread also does the work
+	worker();
+
+	for (auto& t : threads) {
+		t.join();
+	}
+
+	for (const auto& e : errors) {
+		if (e) {
+			std::rethrow_exception(e);
+		}
+	}
+}
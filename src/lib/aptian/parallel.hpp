@@ -0,0 +1,47 @@
+/*
+aptian - apt repository tool
+
+Copyright (C) 2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.*/
+
+/* ================ LICENSE END ================ */
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+namespace aptian {
+
+/**
+ * @brief Get default number of parallel jobs.
+ * @return Number of hardware threads, at least 1.
+ */
+unsigned get_default_num_jobs();
+
+/**
+ * @brief Call function for each index in range [0, count) using a pool of worker threads.
+ * The indices are handed out to the workers in increasing order.
+ * If any of the calls throws, no new indices are handed out and, after all workers have finished,
+ * the exception thrown for the lowest index is rethrown. This way, for the same input,
+ * the same error is reported regardless of the threads scheduling.
+ * @param count - number of indices.
+ * @param num_jobs - maximum number of threads to use, including the calling thread.
+ *                   Values 0 and 1 mean that all the calls are done from the calling thread.
+ * @param func - function to call for each index.
+ */
+void parallel_for(size_t count, unsigned num_jobs, const std::function<void(size_t)>& func);
+
+} // namespace aptian
@@ -0,0 +1,310 @@
+/*
+aptian - apt repository tool
+
+Copyright (C) 2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.*/
+
+/* ================ LICENSE END ================ */
+
+#include "pdiff.hpp"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <ctime>
+#include <filesystem>
+#include <set>
+#include <sstream>
+
+#include <fsif/native_file.hpp>
+#include <tml/tree.hpp>
+#include <utki/debug.hpp>
+#include <utki/string.hpp>
+
+#include "compressor.hpp"
+#include "hasher.hpp"
+#include "sink.hpp"
+
+using namespace std::string_literals;
+using namespace std::string_view_literals;
+
+using namespace aptian;
+
+/*
+The history file format is TML:
+
+<version-name>{
+	sha256{<sha256>}
+	size{<size>}
+	lines{<number of lines>}
+}
+...
+*/
+
+namespace {
+constexpr std::string_view sha256_key = "sha256"sv;
+constexpr std::string_view size_key = "size"sv;
+constexpr std::string_view lines_key = "lines"sv;
+
+constexpr std::string_view index_filename = "Index"sv;
+constexpr std::string_view patch_suffix = ".gz"sv;
+} // namespace
+
+namespace {
+uint64_t parse_number(std::string_view str)
+{
+	uint64_t ret = 0;
+	auto res = std::from_chars(str.data(), str.data() + str.size(), ret);
+	if (res.ec != std::errc() || res.ptr != str.data() + str.size()) {
+		throw std::invalid_argument(utki::cat("malformed number: ", str));
+	}
+	return ret;
+}
+
+pdiff_history::version parse_version(const tml::tree& t)
+{
+	pdiff_history::version ret{.name = t.value.string, .size = 0, .num_lines = 0};
+
+	bool has_size = false;
+	bool has_lines = false;
+
+	for (const auto& p : t.children) {
+		if (p.children.size() != 1) {
+			throw std::invalid_argument(utki::cat("malformed version property: ", p.value.string));
+		}
+		const auto& key = p.value.string;
+		const auto& value = p.children.front().value.string;
+
+		if (key == sha256_key) {
+			ret.sha256 = value;
+		} else if (key == size_key) {
+			ret.size = parse_number(value);
+			has_size = true;
+		} else if (key == lines_key) {
+			ret.num_lines = parse_number(value);
+			has_lines = true;
+		}
+	}
+
+	if (ret.name.empty() || ret.sha256.empty() || !has_size || !has_lines) {
+		throw std::invalid_argument("incomplete version");
+	}
+
+	return ret;
+}
+} // namespace
+
+pdiff_history::pdiff_history(std::string file_path) :
+	file_path(std::move(file_path))
+{
+	fsif::native_file file(this->file_path);
+	if (!file.exists()) {
+		return;
+	}
+
+	try {
+		for (const auto& t : tml::read(file)) {
+			this->versions.push_back(parse_version(t));
+		}
+	} catch (std::exception& e) {
+		// without the history the clients just download the whole file, so start with empty history
+		this->versions.clear();
+	}
+}
+
+void pdiff_history::push(version v, size_t max_patches)
+{
+	ASSERT(!this->versions.empty())
+	ASSERT(v.size >= this->versions.back().size)
+	ASSERT(v.num_lines >= this->versions.back().num_lines)
+
+	// versions created within the same second would get same name
+	auto base_name = v.name;
+	for (unsigned i = 1;; ++i) {
+		// TODO: use std::ranges::find_if() when ubuntu focal support can be dropped
+		// NOLINTNEXTLINE(modernize-use-ranges, "ranges not supported in gcc from ubuntu focal")
+		if (std::find_if(this->versions.begin(), this->versions.end(), [&](const auto& e) {
+				return e.name == v.name;
+			}) == this->versions.end())
+		{
+			break;
+		}
+		v.name = utki::cat(base_name, '-', i);
+	}
+
+	this->versions.push_back(std::move(v));
+
+	if (this->versions.size() > max_patches + 1) {
+		this->versions.erase(
+			this->versions.begin(),
+			std::next(this->versions.begin(), ptrdiff_t(this->versions.size() - max_patches - 1))
+		);
+	}
+}
+
+void pdiff_history::restart(version v)
+{
+	this->versions.clear();
+	this->versions.push_back(std::move(v));
+}
+
+void pdiff_history::save() const
+{
+	tml::forest forest;
+
+	for (const auto& v : this->versions) {
+		forest.emplace_back(
+			v.name,
+			tml::forest{
+				tml::tree(sha256_key, {tml::tree(v.sha256)}),
+				tml::tree(size_key, {tml::tree(utki::cat(v.size))}),
+				tml::tree(lines_key, {tml::tree(utki::cat(v.num_lines))})
+			}
+		);
+	}
+
+	std::filesystem::create_directories(fsif::dir(this->file_path));
+
+	// write to temporary file and then rename it to make the history update atomic
+	auto tmp_path = utki::cat(this->file_path, ".new"sv);
+	tml::write(forest, fsif::native_file(tmp_path));
+	std::filesystem::rename(tmp_path, this->file_path);
+}
+
+std::string aptian::make_pdiff_version_name(std::chrono::system_clock::time_point time)
+{
+	auto t = std::chrono::system_clock::to_time_t(time);
+
+	std::tm tm{};
+	if (!gmtime_r(&t, &tm)) {
+		throw std::runtime_error("gmtime_r() failed");
+	}
+
+	constexpr size_t buffer_size = 32;
+	std::array<char, buffer_size> buffer{};
+	auto len = std::strftime(buffer.data(), buffer.size(), "%Y-%m-%d-%H%M.%S", &tm);
+	ASSERT(len != 0)
+
+	return {buffer.data(), len};
+}
+
+std::string aptian::make_append_ed_script(uint64_t num_lines, std::string_view appended)
+{
+	ASSERT(appended.empty() || appended.back() == '\n')
+
+	if (appended.empty()) {
+		return {};
+	}
+
+	// in ed script a line consisting of single dot ends the appended text,
+	// Packages file never has such lines, since continuation lines of control fields start with a space
+	ASSERT(!appended.starts_with(".\n"sv) && appended.find("\n.\n"sv) == std::string_view::npos)
+
+	return utki::cat(num_lines, "a\n"sv, appended, ".\n"sv);
+}
+
+std::string aptian::write_pdiff_patches(
+	std::string_view diff_dir,
+	const pdiff_history& history,
+	std::string_view current
+)
+{
+	auto versions = history.get_versions();
+	ASSERT(!versions.empty())
+
+	const auto& cur = versions.back();
+	if (current.size() != cur.size) {
+		throw std::invalid_argument(
+			utki::cat("file size (", current.size(), ") does not match current pdiff version size (", cur.size, ")")
+		);
+	}
+
+	std::filesystem::create_directories(diff_dir);
+
+	struct patch_info {
+		const pdiff_history::version& from;
+		std::string name;
+		file_hashes hashes;
+		uint64_t size;
+		file_hashes gz_hashes;
+		uint64_t gz_size;
+	};
+
+	std::vector<patch_info> patches;
+
+	for (const auto& v : versions.subspan(0, versions.size() - 1)) {
+		ASSERT(v.size <= current.size())
+
+		auto patch = make_append_ed_script(v.num_lines, current.substr(v.size));
+		auto patch_data = utki::to_uint8_t(utki::make_span(patch));
+
+		hasher h;
+		h.update(patch_data);
+		auto size = h.get_size();
+
+		auto name = utki::cat("T-"sv, cur.name, "-F-"sv, v.name);
+		auto gz_path = utki::cat(diff_dir, name, patch_suffix);
+
+		hashing_file_sink gz_sink(gz_path);
+		gzip_compressor gz(gz_sink, {});
+		gz.write(patch_data);
+		gz.finish();
+
+		patches.push_back({
+			.from = v,
+			.name = std::move(name),
+			.hashes = h.finish(),
+			.size = size,
+			.gz_hashes = gz_sink.get_hashes(),
+			.gz_size = std::filesystem::file_size(gz_path)
+		});
+	}
+
+	// remove the patches which are not referred anymore
+	std::set<std::string, std::less<>> patch_files;
+	for (const auto& p : patches) {
+		patch_files.insert(utki::cat(p.name, patch_suffix));
+	}
+	for (const auto& f : fsif::native_file(diff_dir).list_dir()) {
+		if (fsif::is_dir(f) || f == index_filename || patch_files.contains(f)) {
+			continue;
+		}
+		std::filesystem::remove(utki::cat(diff_dir, f));
+	}
+
+	std::stringstream ss;
+
+	// tell APT that each patch brings the file to the current version
+	ss << "X-Patch-Precedence: merged" << '\n';
+
+	ss << "SHA256-Current: " << cur.sha256 << ' ' << cur.size << '\n';
+
+	ss << "SHA256-History:" << '\n';
+	for (const auto& p : patches) {
+		ss << ' ' << p.from.sha256 << ' ' << p.from.size << ' ' << p.name << '\n';
+	}
+
+	ss << "SHA256-Patches:" << '\n';
+	for (const auto& p : patches) {
+		ss << ' ' << p.hashes.sha256 << ' ' << p.size << ' ' << p.name << '\n';
+	}
+
+	ss << "SHA256-Download:" << '\n';
+	for (const auto& p : patches) {
+		ss << ' ' << p.gz_hashes.sha256 << ' ' << p.gz_size << ' ' << p.name << patch_suffix << '\n';
+	}
+
+	return ss.str();
+}
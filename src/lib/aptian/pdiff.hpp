@@ -0,0 +1,122 @@
+/*
+aptian - apt repository tool
+
+Copyright (C) 2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.*/
+
+/* ================ LICENSE END ================ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <utki/span.hpp>
+
+namespace aptian {
+
+/**
+ * @brief History of the Packages file versions for generating PDiff patches.
+ * APT clients which have one of the previous versions of the Packages file can download
+ * a small patch instead of the whole file. The patches are ed scripts, as described in
+ * https://wiki.debian.org/DebianRepository/Format#diffs.
+ * Since the packages are only ever appended to the Packages file, each previous version is
+ * a prefix of the current one, so the patch from any previous version is just appending
+ * the rest of the current file. Hence, the patches are always "merged" ones, i.e. each
+ * patch brings the file from a previous version directly to the current version.
+ * The history is stored in a file, it is loaded on construction and stored with save().
+ */
+class pdiff_history
+{
+public:
+	struct version {
+		// version name, used in the patch file names, see make_pdiff_version_name()
+		std::string name;
+		std::string sha256;
+		uint64_t size;
+		uint64_t num_lines;
+	};
+
+private:
+	std::string file_path;
+
+	// oldest version goes first, the last one is the current version
+	std::vector<version> versions;
+
+public:
+	/**
+	 * @brief Constructor.
+	 * @param file_path - path to the history file. If the file does not exist or cannot be read,
+	 *                    the history starts empty.
+	 */
+	pdiff_history(std::string file_path);
+
+	/**
+	 * @brief Get versions of the file.
+	 * @return Versions, oldest first, the last one is the current version.
+	 */
+	utki::span<const version> get_versions() const noexcept
+	{
+		return this->versions;
+	}
+
+	/**
+	 * @brief Add new current version.
+	 * @param v - new version which was produced by appending data to the current version.
+	 * @param max_patches - maximum number of previous versions to keep.
+	 */
+	void push(version v, size_t max_patches);
+
+	/**
+	 * @brief Start history anew.
+	 * Used when the file was rewritten or its previous version is unknown.
+	 * @param v - new current version.
+	 */
+	void restart(version v);
+
+	void save() const;
+};
+
+/**
+ * @brief Make version name for the PDiff patch file names.
+ * @param time - time of the version creation.
+ * @return Version name in format used by Debian archive, e.g. 2024-05-01-1234.56.
+ */
+std::string make_pdiff_version_name(std::chrono::system_clock::time_point time);
+
+/**
+ * @brief Make ed script which appends text to a text file.
+ * @param num_lines - number of lines in the original file, the file must end with new line.
+ * @param appended - text to append, must end with new line.
+ * @return The ed script.
+ */
+std::string make_append_ed_script(uint64_t num_lines, std::string_view appended);
+
+/**
+ * @brief Write PDiff patches for the current version of the file.
+ * Writes gzipped patches from each previous version of the history to the current one and
+ * removes the patches which are not referred by the history anymore.
+ * @param diff_dir - directory of the patches, i.e. Packages.diff.
+ * @param history - version history of the file.
+ * @param current - contents of the current version of the file.
+ * @return Contents of the Index file for the written patches.
+ * @throw std::invalid_argument - if current contents do not match the current version of the history.
+ */
+std::string write_pdiff_patches(std::string_view diff_dir, const pdiff_history& history, std::string_view current);
+
+} // namespace aptian
@@ -0,0 +1,532 @@
+/*
+aptian - apt repository tool
+
+Copyright (C) 2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.*/
+
+/* ================ LICENSE END ================ */
+
+#include "server.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <utki/debug.hpp>
+#include <utki/string.hpp>
+
+#include "file_descriptor.hpp"
+#include "stop_signals.hpp"
+
+using namespace std::string_view_literals;
+
+using namespace aptian;
+
+namespace {
+constexpr std::string_view target_item = "target "sv;
+constexpr std::string_view package_item = "package "sv;
+
+constexpr std::string_view ok_response = "ok\n"sv;
+constexpr std::string_view error_response_prefix = "error: "sv;
+
+// requests are small, bigger one is likely not an aptian client
+constexpr size_t max_request_size = 0x100000;
+} // namespace
+
+std::string aptian::to_string(const add_request& request)
+{
+	std::string ret;
+
+	auto check = [](std::string_view str) {
+		if (str.empty() || str.find('\n') != std::string_view::npos) {
+			throw std::invalid_argument(utki::cat("empty or multiline value in request: ", str));
+		}
+	};
+
+	for (const auto& t : request.targets) {
+		check(t.dist);
+		check(t.comp);
+		if (t.dist.find(' ') != std::string::npos || t.comp.find(' ') != std::string::npos) {
+			throw std::invalid_argument(utki::cat("dist or comp name contains space: ", t.dist, ' ', t.comp));
+		}
+		ret.append(utki::cat(target_item, t.dist, ' ', t.comp, '\n'));
+	}
+
+	for (const auto& p : request.package_paths) {
+		check(p);
+		ret.append(utki::cat(package_item, p, '\n'));
+	}
+
+	return ret;
+}
+
+add_request aptian::parse_add_request(std::string_view str)
+{
+	add_request ret;
+
+	while (!str.empty()) {
+		auto line_end = str.find('\n');
+		if (line_end == std::string_view::npos) {
+			throw std::invalid_argument("request line is not terminated");
+		}
+		auto line = str.substr(0, line_end);
+		str = str.substr(line_end + 1);
+
+		if (line.starts_with(target_item)) {
+			auto target = line.substr(target_item.size());
+			auto space = target.find(' ');
+			if (space == std::string_view::npos || space == 0 || space == target.size() - 1 ||
+				target.find(' ', space + 1) != std::string_view::npos)
+			{
+				throw std::invalid_argument(utki::cat("malformed target in request: ", target));
+			}
+			ret.targets.push_back({.dist = std::string(target.substr(0, space)),
+								   .comp = std::string(target.substr(space + 1))});
+		} else if (line.starts_with(package_item)) {
+			auto path = line.substr(package_item.size());
+			if (!path.starts_with('/')) {
+				throw std::invalid_argument(utki::cat("package file path is not absolute: ", path));
+			}
+			ret.package_paths.emplace_back(path);
+		} else {
+			throw std::invalid_argument(utki::cat("unknown request line: ", line));
+		}
+	}
+
+	if (ret.targets.empty()) {
+		throw std::invalid_argument("no targets in request");
+	}
+	if (ret.package_paths.empty()) {
+		throw std::invalid_argument("no package files in request");
+	}
+
+	return ret;
+}
+
+namespace {
+sockaddr_un make_address(std::string_view socket_path)
+{
+	sockaddr_un addr{};
+	addr.sun_family = AF_UNIX;
+
+	// leave space for null terminator
+	if (socket_path.empty() || socket_path.size() >= sizeof(addr.sun_path)) {
+		throw std::invalid_argument(utki::cat("invalid socket path length: ", socket_path));
+	}
+
+	// TODO: use std::ranges::copy() when ubuntu focal support can be dropped
+	// NOLINTNEXTLINE(modernize-use-ranges, "ranges not supported in gcc from ubuntu focal")
+	std::copy(socket_path.begin(), socket_path.end(), std::begin(addr.sun_path));
+
+	return addr;
+}
+
+bool try_connect(const file_descriptor& s, const sockaddr_un& addr)
+{
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast, "POSIX API")
+	return connect(s.fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == 0;
+}
+
+void send_all(const file_descriptor& s, std::string_view data)
+{
+	while (!data.empty()) {
+		auto res = send(s.fd, data.data(), data.size(), MSG_NOSIGNAL);
+		if (res < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			throw std::system_error(errno, std::generic_category(), "could not send data to socket");
+		}
+		data = data.substr(size_t(res));
+	}
+}
+} // namespace
+
+void aptian::send_add_request(std::string_view socket_path, const add_request& request)
+{
+	add_request req = request;
+	for (auto& p : req.package_paths) {
+		p = std::filesystem::absolute(p).string();
+	}
+
+	auto data = to_string(req);
+
+	file_descriptor s(socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0), "could not create socket");
+
+	if (!try_connect(s, make_address(socket_path))) {
+		throw std::system_error(errno, std::generic_category(), utki::cat("could not connect to ", socket_path));
+	}
+
+	// the server can respond with error without reading the whole request, e.g. if the client is not allowed,
+	// so the response is received anyway
+	std::exception_ptr send_error;
+	try {
+		send_all(s, data);
+
+		// signal end of the request
+		shutdown(s.fd, SHUT_WR);
+	} catch (const std::system_error&) {
+		send_error = std::current_exception();
+	}
+
+	std::string response;
+	std::array<char, 0x1000> buffer{};
+	for (;;) {
+		auto res = recv(s.fd, buffer.data(), buffer.size(), 0);
+		if (res < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			// the server which has not read the whole request resets the connection after responding
+			if (errno == ECONNRESET && !response.empty()) {
+				break;
+			}
+			throw std::system_error(errno, std::generic_category(), "could not receive response from server");
+		}
+		if (res == 0) {
+			break;
+		}
+		response.append(buffer.data(), size_t(res));
+	}
+
+	if (response == ok_response) {
+		return;
+	}
+
+	if (response.starts_with(error_response_prefix) && response.ends_with('\n')) {
+		throw std::runtime_error(
+			response.substr(error_response_prefix.size(), response.size() - error_response_prefix.size() - 1)
+		);
+	}
+
+	if (send_error) {
+		std::rethrow_exception(send_error);
+	}
+
+	throw std::runtime_error("no response from server, the server was probably stopped");
+}
+
+namespace {
+void bind_and_listen(const file_descriptor& s, std::string_view socket_path)
+{
+	auto addr = make_address(socket_path);
+
+	if (std::filesystem::exists(socket_path)) {
+		file_descriptor probe(socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0), "could not create socket");
+		if (try_connect(probe, addr)) {
+			throw std::runtime_error(utki::cat("another server is listening on ", socket_path));
+		}
+
+		// stale socket file of a server which has exited
+		std::filesystem::remove(socket_path);
+	}
+
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast, "POSIX API")
+	if (bind(s.fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0) {
+		throw std::system_error(errno, std::generic_category(), utki::cat("could not bind socket ", socket_path));
+	}
+
+	// only the owner can connect, the connections are not accepted until listen() is called
+	if (chmod(std::string(socket_path).c_str(), S_IRUSR | S_IWUSR) != 0) {
+		throw std::system_error(errno, std::generic_category(), utki::cat("could not chmod socket ", socket_path));
+	}
+
+	if (listen(s.fd, SOMAXCONN) != 0) {
+		throw std::system_error(errno, std::generic_category(), utki::cat("could not listen on ", socket_path));
+	}
+}
+} // namespace
+
+namespace {
+// The server adds package files at any paths given by the clients and, in case of 'move' pool insertion method,
+// removes those, so only the clients running as the same user as the server are served,
+// even if the socket file permissions allow others to connect.
+bool is_peer_allowed(const file_descriptor& s)
+{
+	ucred cred{};
+	socklen_t len = sizeof(cred);
+	if (getsockopt(s.fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0) {
+		return false;
+	}
+	return cred.uid == geteuid();
+}
+} // namespace
+
+namespace {
+std::string get_message(const std::exception_ptr& error)
+{
+	try {
+		std::rethrow_exception(error);
+	} catch (const std::exception& e) {
+		return e.what();
+	} catch (...) {
+		return "unknown error";
+	}
+}
+} // namespace
+
+namespace {
+class server
+{
+	struct connection {
+		std::unique_ptr<file_descriptor> socket;
+
+		// received part of the request
+		std::string data;
+	};
+
+	struct queued_request {
+		std::unique_ptr<file_descriptor> socket;
+		add_request request;
+	};
+
+	repository repo;
+
+	const serve_options& opts;
+
+	file_descriptor listening_socket;
+
+	const file_descriptor& stop_fd;
+
+	std::vector<connection> connections;
+
+	std::vector<queued_request> queue;
+
+	// time when the queued requests are published
+	std::chrono::steady_clock::time_point deadline;
+
+	bool stop = false;
+
+	static void respond(const file_descriptor& s, std::string_view response)
+	{
+		try {
+			send_all(s, response);
+		} catch (const std::system_error& e) {
+			// the client has gone, nothing to do about it
+			std::cout << "could not send response to client: " << e.what() << std::endl;
+		}
+	}
+
+	void accept_connections()
+	{
+		for (;;) {
+			int fd = accept4(this->listening_socket.fd, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+			if (fd < 0) {
+				if (errno == EINTR || errno == ECONNABORTED) {
+					continue;
+				}
+				if (errno == EAGAIN || errno == EWOULDBLOCK) {
+					return;
+				}
+				throw std::system_error(errno, std::generic_category(), "could not accept connection");
+			}
+			auto socket = std::make_unique<file_descriptor>(fd, "");
+			if (!is_peer_allowed(*socket)) {
+				respond(*socket, utki::cat(error_response_prefix, "permission denied\n"));
+				continue;
+			}
+			this->connections.push_back({.socket = std::move(socket)});
+		}
+	}
+
+	// Returns true if the connection is done with, i.e. the request is queued or rejected.
+	bool receive(connection& c)
+	{
+		std::array<char, 0x1000> buffer{};
+		for (;;) {
+			auto res = recv(c.socket->fd, buffer.data(), buffer.size(), 0);
+			if (res < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				if (errno == EAGAIN || errno == EWOULDBLOCK) {
+					return false;
+				}
+				// the client has gone
+				return true;
+			}
+
+			if (res == 0) {
+				break;
+			}
+
+			c.data.append(buffer.data(), size_t(res));
+			if (c.data.size() > max_request_size) {
+				respond(*c.socket, utki::cat(error_response_prefix, "request is too big\n"));
+				return true;
+			}
+		}
+
+		// the client has finished sending the request
+		try {
+			auto request = parse_add_request(c.data);
+
+			if (this->queue.empty()) {
+				this->deadline = std::chrono::steady_clock::now() + this->opts.debounce;
+			}
+			this->queue.push_back({.socket = std::move(c.socket), .request = std::move(request)});
+		} catch (const std::invalid_argument& e) {
+			respond(*c.socket, utki::cat(error_response_prefix, e.what(), '\n'));
+		}
+
+		return true;
+	}
+
+	void publish()
+	{
+		std::vector<add_request> requests;
+		requests.reserve(this->queue.size());
+		for (auto& q : this->queue) {
+			requests.push_back(std::move(q.request));
+		}
+
+		std::cout << "publish " << requests.size() << " request(s)" << std::endl;
+
+		std::vector<std::exception_ptr> errors;
+		try {
+			errors = this->repo.add(requests);
+		} catch (...) {
+			errors.assign(requests.size(), std::current_exception());
+		}
+		ASSERT(errors.size() == this->queue.size())
+
+		for (size_t i = 0; i != errors.size(); ++i) {
+			if (!errors[i]) {
+				respond(*this->queue[i].socket, ok_response);
+				continue;
+			}
+
+			auto message = get_message(errors[i]);
+			std::cout << "ERROR: " << message << std::endl;
+
+			// TODO: use std::ranges::replace() when ubuntu focal support can be dropped
+			// NOLINTNEXTLINE(modernize-use-ranges, "ranges not supported in gcc from ubuntu focal")
+			std::replace(message.begin(), message.end(), '\n', ' ');
+			respond(*this->queue[i].socket, utki::cat(error_response_prefix, message, '\n'));
+		}
+
+		this->queue.clear();
+
+		std::cout << "done" << std::endl;
+	}
+
+	int get_poll_timeout() const
+	{
+		if (this->queue.empty()) {
+			return -1;
+		}
+		auto left = std::chrono::ceil<std::chrono::milliseconds>(this->deadline - std::chrono::steady_clock::now());
+		return int(std::max(left.count(), decltype(left.count())(0)));
+	}
+
+public:
+	server(std::string_view dir, const add_options& options, const serve_options& opts, const file_descriptor& stop_fd) :
+		repo(dir, options),
+		opts(opts),
+		listening_socket(
+			socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0), //
+			"could not create socket"
+		),
+		stop_fd(stop_fd)
+	{
+		bind_and_listen(this->listening_socket, opts.socket_path);
+	}
+
+	server(const server&) = delete;
+	server& operator=(const server&) = delete;
+
+	server(server&&) = delete;
+	server& operator=(server&&) = delete;
+
+	~server()
+	{
+		std::filesystem::remove(this->opts.socket_path);
+	}
+
+	void run()
+	{
+		std::cout << "listening on " << this->opts.socket_path << std::endl;
+
+		while (!this->stop || !this->queue.empty()) {
+			if (!this->queue.empty() && (this->stop || std::chrono::steady_clock::now() >= this->deadline)) {
+				this->publish();
+				continue;
+			}
+
+			std::vector<pollfd> fds;
+			fds.reserve(this->connections.size() + 2);
+			fds.push_back({.fd = this->stop_fd.fd, .events = POLLIN, .revents = 0});
+			fds.push_back({.fd = this->listening_socket.fd, .events = POLLIN, .revents = 0});
+			for (const auto& c : this->connections) {
+				fds.push_back({.fd = c.socket->fd, .events = POLLIN, .revents = 0});
+			}
+
+			if (poll(fds.data(), fds.size(), this->get_poll_timeout()) < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				throw std::system_error(errno, std::generic_category(), "poll() failed");
+			}
+
+			if (fds[0].revents != 0) {
+				std::cout << "stop requested" << std::endl;
+				this->stop = true;
+			}
+
+			// the new connections are accepted after the existing ones are processed,
+			// so that the poll results stay in sync with the connections list
+			for (size_t i = 0; i != this->connections.size();) {
+				// the new connections accepted during this iteration are not polled yet
+				if (i + 2 >= fds.size() || fds[i + 2].revents == 0) {
+					++i;
+					continue;
+				}
+				if (this->receive(this->connections[i])) {
+					this->connections.erase(this->connections.begin() + ptrdiff_t(i));
+					fds.erase(fds.begin() + ptrdiff_t(i + 2));
+					continue;
+				}
+				++i;
+			}
+
+			if (fds[1].revents != 0 && !this->stop) {
+				this->accept_connections();
+			}
+		}
+	}
+};
+} // namespace
+
+void aptian::serve(std::string_view dir, const add_options& options, const serve_options& serve_opts)
+{
+	// block the stop signals before any worker threads are started, so that the threads inherit the signal mask
+	stop_signals signals;
+
+	server s(dir, options, serve_opts, signals.fd);
+
+	s.run();
+}
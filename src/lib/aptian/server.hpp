@@ -0,0 +1,85 @@
+/*
+aptian - apt repository tool
+
+Copyright (C) 2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.*/
+
+/* ================ LICENSE END ================ */
+
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <string_view>
+
+#include "operations.hpp"
+
+namespace aptian {
+
+struct serve_options {
+	// path of the Unix domain socket to listen on
+	std::string socket_path;
+
+	// the requests received within this time after the first queued request are published as one batch
+	std::chrono::milliseconds debounce = std::chrono::seconds(1);
+};
+
+/**
+ * @brief Serve requests to add packages to APT repository.
+ * Listens on Unix domain socket for requests sent with send_add_request(). The queued requests are published
+ * in batches, i.e. for each batch the index files of each affected component are written once and the Release file
+ * of each affected distribution is signed once. Each client gets its response after its batch is published.
+ * The repository state is kept in memory between the batches, see aptian::repository.
+ * The socket file is created with read and write permissions for its owner only. Since the clients make the server
+ * read and, in case of 'move' pool insertion method, remove files at arbitrary paths, the requests are accepted
+ * only from the clients running as the same user as the server, see SO_PEERCRED, even if the socket file
+ * permissions are changed to let others connect.
+ * The function returns after SIGINT or SIGTERM is received and the queued requests are published.
+ * @param dir - base directory of the repository.
+ * @param options - options of adding packages.
+ * @param serve_opts - server options.
+ * @throw std::runtime_error - in case another server is already listening on the socket.
+ * @throw std::system_error - in case of socket errors.
+ */
+void serve(std::string_view dir, const add_options& options, const serve_options& serve_opts);
+
+/**
+ * @brief Send request to add packages to the server.
+ * Waits until the packages are published by the server.
+ * @param socket_path - path of the server's socket.
+ * @param request - request to send. The package file paths are made absolute before sending.
+ * @throw std::runtime_error - in case the server failed to add the packages.
+ * @throw std::system_error - in case of socket errors.
+ */
+void send_add_request(std::string_view socket_path, const add_request& request);
+
+/**
+ * @brief Encode request to add packages.
+ * One line per target or package file path, each line starts with the item type.
+ * @param request - request to encode.
+ * @return Encoded request.
+ * @throw std::invalid_argument - in case the request cannot be encoded, e.g. a path contains new line character.
+ */
+std::string to_string(const add_request& request);
+
+/**
+ * @brief Decode request to add packages.
+ * @param str - encoded request.
+ * @return Decoded request.
+ * @throw std::invalid_argument - in case the request is malformed.
+ */
+add_request parse_add_request(std::string_view str);
+
+} // namespace aptian
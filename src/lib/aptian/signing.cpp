@@ -0,0 +1,100 @@
+/*
+aptian - apt repository tool
+
+Copyright (C) 2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.*/
+
+/* ================ LICENSE END ================ */
+
+#include "signing.hpp"
+
+#include <cstdlib>
+#include <filesystem>
+#include <stdexcept>
+
+#include <fsif/native_file.hpp>
+#include <utki/string.hpp>
+
+using namespace std::string_view_literals;
+
+using namespace aptian;
+
+namespace {
+constexpr std::string_view signature_begin = "-----BEGIN PGP SIGNATURE-----"sv;
+} // namespace
+
+std::string_view aptian::get_clearsigned_signature(std::string_view clearsigned)
+{
+	auto pos = clearsigned.find(utki::cat('\n', signature_begin, '\n'));
+	if (pos == std::string_view::npos) {
+		throw std::invalid_argument("clearsigned message does not have signature");
+	}
+	return clearsigned.substr(pos + 1);
+}
+
+release_signatures aptian::sign_release(std::string_view release, std::string_view gpg_key, std::string_view tmp_dir)
+{
+	// trailing whitespace is not part of the signed text of clearsigned message,
+	// so the signature would not be valid as detached one
+	for (const auto& line : utki::split(release, '\n')) {
+		if (line.ends_with(' ') || line.ends_with('\t')) {
+			throw std::invalid_argument(utki::cat("Release file line has trailing whitespace: ", line));
+		}
+	}
+
+	// The line ending before the signature block of a clearsigned message is not part of the signed text.
+	// So, in case the Release file ends with new line, add one more, so that the signed text
+	// is exactly the Release file contents and the signature can be used as detached one.
+	auto message = utki::cat(release, release.ends_with('\n') ? "\n"sv : ""sv);
+
+	std::filesystem::create_directories(tmp_dir);
+	auto message_path = utki::cat(tmp_dir, "release_message"sv);
+	auto clearsigned_path = utki::cat(tmp_dir, "clearsigned"sv);
+	{
+		fsif::native_file fi(message_path);
+		fsif::file::guard file_guard(fi, fsif::mode::create);
+		fi.write(message);
+	}
+	std::filesystem::remove(clearsigned_path);
+
+	if (std::system( //
+			utki::cat(
+				"gpg",
+				" --batch", // Use  batch  mode.  Never ask, do not allow interactive commands.
+				" --clearsign --no-tty --use-agent --local-user=",
+				gpg_key,
+				" --output=",
+				clearsigned_path,
+				' ',
+				message_path
+			)
+				.c_str()
+		) != 0)
+	{
+		throw std::runtime_error("gpg failed to sign");
+	}
+
+	release_signatures ret;
+	{
+		auto data = fsif::native_file(clearsigned_path).load();
+		ret.clearsigned = std::string(utki::make_string_view(data));
+	}
+	std::filesystem::remove(clearsigned_path);
+	std::filesystem::remove(message_path);
+
+	ret.detached = get_clearsigned_signature(ret.clearsigned);
+
+	return ret;
+}
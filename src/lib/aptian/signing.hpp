@@ -0,0 +1,61 @@
+/*
+aptian - apt repository tool
+
+Copyright (C) 2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.*/
+
+/* ================ LICENSE END ================ */
+
+#pragma once
+
+#include <string>
+#include <string_view>
+
+namespace aptian {
+
+/**
+ * @brief OpenPGP signatures of a Release file.
+ */
+struct release_signatures {
+	// ASCII armored detached signature, contents of the Release.gpg file
+	std::string detached;
+
+	// clearsigned Release file, contents of the InRelease file
+	std::string clearsigned;
+};
+
+/**
+ * @brief Sign Release file contents.
+ * The contents are signed only once, with a text mode signature. The same signature is valid for both
+ * the clearsigned message and, as detached signature, for the Release file. So, gpg is invoked only once
+ * and the Release file contents are hashed only once.
+ * @param release - Release file contents. The lines must not have trailing whitespace.
+ * @param gpg_key - user id of the key to sign with.
+ * @param tmp_dir - directory for temporary files.
+ * @return Signatures.
+ * @throw std::invalid_argument - in case the Release file contents have lines with trailing whitespace.
+ * @throw std::runtime_error - in case signing fails.
+ */
+release_signatures sign_release(std::string_view release, std::string_view gpg_key, std::string_view tmp_dir);
+
+/**
+ * @brief Get signature of clearsigned message.
+ * @param clearsigned - clearsigned message.
+ * @return ASCII armored signature block of the message.
+ * @throw std::invalid_argument - in case the message has no signature block.
+ */
+std::string_view get_clearsigned_signature(std::string_view clearsigned);
+
+} // namespace aptian
@@ -0,0 +1,201 @@
+/*
+aptian - apt repository tool
+
+Copyright (C) 2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.*/
+
+/* ================ LICENSE END ================ */
+
+#include "sink.hpp"
+
+#include <cerrno>
+#include <filesystem>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utki/debug.hpp>
+#include <utki/string.hpp>
+
+#include "file_insertion.hpp"
+
+using namespace aptian;
+
+namespace {
+// the writes to the file are done in chunks of this size
+constexpr size_t write_buffer_size = 0x40000;
+} // namespace
+
+void tee_sink::write(utki::span<const uint8_t> data)
+{
+	for (auto& o : this->outputs) {
+		o.get().write(data);
+	}
+}
+
+void tee_sink::finish()
+{
+	for (auto& o : this->outputs) {
+		o.get().finish();
+	}
+}
+
+namespace {
+int open_file(const std::string& path, int flags)
+{
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg, "POSIX API")
+	int fd = open(path.c_str(), flags | O_WRONLY | O_CLOEXEC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+	if (fd < 0) {
+		throw std::system_error(errno, std::generic_category(), utki::cat("could not open file ", path));
+	}
+	return fd;
+}
+} // namespace
+
+hashing_file_sink::hashing_file_sink(std::string_view path) :
+	path(path),
+	write_path(utki::cat(path, hashing_file_sink_tmp_suffix)),
+	fd(open_file(this->write_path, O_CREAT | O_TRUNC))
+{
+	this->buffer.reserve(write_buffer_size);
+}
+
+hashing_file_sink::hashing_file_sink(std::string_view path, std::string_view hasher_state, bool in_place) :
+	path(path),
+	write_path(in_place ? std::string(path) : utki::cat(path, hashing_file_sink_tmp_suffix)),
+	fd(-1)
+{
+	this->hash.load_state(hasher_state);
+
+	if (!in_place) {
+		std::filesystem::remove(this->write_path);
+		insert_file(this->path, this->write_path, insertion_method::copy);
+	}
+
+	this->fd = open_file(this->write_path, O_APPEND);
+
+	struct stat st {};
+	if (fstat(this->fd, &st) != 0) {
+		auto error = errno;
+		close(this->fd);
+		if (this->write_path != this->path) {
+			std::filesystem::remove(this->write_path);
+		}
+		throw std::system_error(error, std::generic_category(), utki::cat("fstat() failed for ", path));
+	}
+
+	if (uint64_t(st.st_size) != this->hash.get_size()) {
+		close(this->fd);
+		if (this->write_path != this->path) {
+			std::filesystem::remove(this->write_path);
+		}
+		throw std::invalid_argument(utki::cat("hasher state does not match size of the file ", path));
+	}
+
+	this->append_offset = uint64_t(st.st_size);
+
+	this->buffer.reserve(write_buffer_size);
+}
+
+hashing_file_sink::~hashing_file_sink()
+{
+	if (this->fd < 0) {
+		return;
+	}
+
+	// the sink was not finished, undo the changes
+	if (this->write_path == this->path) {
+		ASSERT(this->append_offset.has_value())
+		if (ftruncate(this->fd, off_t(this->append_offset.value())) != 0) {
+			// nothing can be done about it
+		}
+		close(this->fd);
+	} else {
+		close(this->fd);
+		std::error_code ec;
+		std::filesystem::remove(this->write_path, ec);
+	}
+}
+
+void hashing_file_sink::write_through(utki::span<const uint8_t> data)
+{
+	while (!data.empty()) {
+		auto res = ::write(this->fd, data.data(), data.size());
+		if (res < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			throw std::system_error(errno, std::generic_category(), utki::cat("could not write file ", this->write_path));
+		}
+		data = data.subspan(size_t(res));
+	}
+}
+
+void hashing_file_sink::write(utki::span<const uint8_t> data)
+{
+	ASSERT(this->fd >= 0)
+
+	this->hash.update(data);
+
+	if (this->buffer.size() + data.size() > write_buffer_size) {
+		this->write_through(this->buffer);
+		this->buffer.clear();
+
+		if (data.size() >= write_buffer_size) {
+			this->write_through(data);
+			return;
+		}
+	}
+
+	this->buffer.insert(this->buffer.end(), data.begin(), data.end());
+}
+
+void hashing_file_sink::finish()
+{
+	ASSERT(this->fd >= 0)
+
+	this->write_through(this->buffer);
+	this->buffer.clear();
+
+	if (close(this->fd) != 0) {
+		this->fd = -1;
+		throw std::system_error(errno, std::generic_category(), utki::cat("could not close file ", this->write_path));
+	}
+	this->fd = -1;
+
+	if (this->write_path != this->path) {
+		std::filesystem::rename(this->write_path, this->path);
+	}
+
+	this->hasher_state = this->hash.save_state();
+	this->hashes = this->hash.finish();
+}
+
+const file_hashes& hashing_file_sink::get_hashes() const
+{
+	if (!this->hashes.has_value()) {
+		throw std::logic_error("hashing_file_sink::get_hashes(): called before finish()");
+	}
+	return this->hashes.value();
+}
+
+const std::string& hashing_file_sink::get_hasher_state() const
+{
+	if (!this->hashes.has_value()) {
+		throw std::logic_error("hashing_file_sink::get_hasher_state(): called before finish()");
+	}
+	return this->hasher_state;
+}
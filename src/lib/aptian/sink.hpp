@@ -0,0 +1,171 @@
+/*
+aptian - apt repository tool
+
+Copyright (C) 2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.*/
+
+/* ================ LICENSE END ================ */
+
+#pragma once
+
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <utki/span.hpp>
+
+#include "hasher.hpp"
+
+namespace aptian {
+
+/**
+ * @brief Output data sink.
+ * Data is written to the sink in arbitrary portions. After all the data is written
+ * the finish() is called to flush the remaining data to its final destination.
+ */
+class sink
+{
+public:
+	sink() = default;
+
+	sink(const sink&) = delete;
+	sink& operator=(const sink&) = delete;
+
+	sink(sink&&) = delete;
+	sink& operator=(sink&&) = delete;
+
+	virtual ~sink() = default;
+
+	/**
+	 * @brief Write next portion of data.
+	 * @param data - data to write.
+	 */
+	virtual void write(utki::span<const uint8_t> data) = 0;
+
+	/**
+	 * @brief Signal end of data.
+	 * No more data can be written to the sink after this call.
+	 */
+	virtual void finish() = 0;
+};
+
+/**
+ * @brief Sink passing same data to several sinks.
+ */
+class tee_sink : public sink
+{
+	std::vector<std::reference_wrapper<sink>> outputs;
+
+public:
+	tee_sink(std::vector<std::reference_wrapper<sink>> outputs) :
+		outputs(std::move(outputs))
+	{}
+
+	void write(utki::span<const uint8_t> data) override;
+
+	/**
+	 * @brief Signal end of data.
+	 * Finishes all the output sinks.
+	 */
+	void finish() override;
+};
+
+/**
+ * @brief Suffix of the temporary file the hashing_file_sink writes to before replacing the destination file.
+ * The temporary file is left behind if the process is killed while writing.
+ */
+constexpr std::string_view hashing_file_sink_tmp_suffix = ".new";
+
+/**
+ * @brief Sink writing data to a file.
+ * The hash sums of the written data are calculated on the way,
+ * so there is no need to read the file back to hash it.
+ */
+class hashing_file_sink : public sink
+{
+	std::string path;
+
+	// path of the file the data is actually written to
+	std::string write_path;
+
+	int fd;
+
+	// size of the file before appending, in append mode
+	std::optional<uint64_t> append_offset;
+
+	std::vector<uint8_t> buffer;
+
+	hasher hash;
+
+	std::optional<file_hashes> hashes;
+	std::string hasher_state;
+
+	void write_through(utki::span<const uint8_t> data);
+
+public:
+	/**
+	 * @brief Constructor.
+	 * The destination file is replaced atomically on finish(), so the readers, including
+	 * the ones which have the old file mapped to memory, never see a partially written file.
+	 * If the sink is destroyed without calling finish(), the destination file is left intact.
+	 * @param path - path to the destination file.
+	 */
+	hashing_file_sink(std::string_view path);
+
+	/**
+	 * @brief Constructor for appending to existing file.
+	 * In case of appending in place, the data is appended directly to the file. If the sink is destroyed
+	 * without calling finish(), the file is truncated back to its original size.
+	 * Otherwise, the file is copied (reflinked, if the file system supports it) to a temporary file,
+	 * the data is appended to the copy and the copy replaces the file atomically on finish(), so that
+	 * the hard links to the file keep the original contents.
+	 * @param path - path to the existing file.
+	 * @param hasher_state - hasher state after hashing the current file contents, see get_hasher_state().
+	 * @param in_place - whether to append to the file in place.
+	 * @throw std::invalid_argument - if the hasher state is malformed or does not match the file size.
+	 */
+	hashing_file_sink(std::string_view path, std::string_view hasher_state, bool in_place = true);
+
+	hashing_file_sink(const hashing_file_sink&) = delete;
+	hashing_file_sink& operator=(const hashing_file_sink&) = delete;
+
+	hashing_file_sink(hashing_file_sink&&) = delete;
+	hashing_file_sink& operator=(hashing_file_sink&&) = delete;
+
+	~hashing_file_sink() override;
+
+	void write(utki::span<const uint8_t> data) override;
+
+	void finish() override;
+
+	/**
+	 * @brief Get hash sums of the written data.
+	 * @return Hash sums of the file.
+	 * @throw std::logic_error - if called before finish().
+	 */
+	const file_hashes& get_hashes() const;
+
+	/**
+	 * @brief Get hasher state after hashing the whole file.
+	 * The state can be used later to append more data to the file.
+	 * @return Hasher state.
+	 * @throw std::logic_error - if called before finish().
+	 */
+	const std::string& get_hasher_state() const;
+};
+
+} // namespace aptian
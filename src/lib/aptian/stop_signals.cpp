@@ -0,0 +1,62 @@
+/*
+aptian - apt repository tool
+
+Copyright (C) 2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.*/
+
+/* ================ LICENSE END ================ */
+
+#include "stop_signals.hpp"
+
+#include <system_error>
+
+#include <sys/signalfd.h>
+#include <unistd.h>
+
+using namespace aptian;
+
+namespace {
+sigset_t make_stop_signal_set()
+{
+	sigset_t ret;
+	sigemptyset(&ret);
+	sigaddset(&ret, SIGINT);
+	sigaddset(&ret, SIGTERM);
+	return ret;
+}
+} // namespace
+
+namespace {
+const sigset_t stop_signal_set = make_stop_signal_set();
+} // namespace
+
+stop_signals::stop_signals() :
+	fd(signalfd(-1, &stop_signal_set, SFD_CLOEXEC | SFD_NONBLOCK), "could not create signal file descriptor")
+{
+	if (int error = pthread_sigmask(SIG_BLOCK, &stop_signal_set, &this->old_mask); error != 0) {
+		throw std::system_error(error, std::generic_category(), "could not block stop signals");
+	}
+}
+
+stop_signals::~stop_signals()
+{
+	// the received stop signals are consumed, otherwise those would be delivered when unblocked
+	// and terminate the process instead of letting it finish normally
+	signalfd_siginfo info{};
+	while (read(this->fd.fd, &info, sizeof(info)) == sizeof(info)) {
+	}
+
+	pthread_sigmask(SIG_SETMASK, &this->old_mask, nullptr);
+}
@@ -0,0 +1,55 @@
+/*
+aptian - apt repository tool
+
+Copyright (C) 2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.*/
+
+/* ================ LICENSE END ================ */
+
+#pragma once
+
+#include <csignal>
+
+#include "file_descriptor.hpp"
+
+namespace aptian {
+
+/**
+ * @brief Stop signals receiver.
+ * While the object exists, SIGINT and SIGTERM are blocked for the calling thread and can be waited for
+ * with poll() on the file descriptor instead. Threads started meanwhile from the calling thread inherit
+ * the blocked signals, so those are not delivered to the threads either.
+ * The stop signals received while the object exists are discarded when it is destroyed.
+ */
+class stop_signals
+{
+	sigset_t old_mask{};
+
+public:
+	// becomes readable when a stop signal is received
+	const file_descriptor fd;
+
+	stop_signals();
+
+	stop_signals(const stop_signals&) = delete;
+	stop_signals& operator=(const stop_signals&) = delete;
+
+	stop_signals(stop_signals&&) = delete;
+	stop_signals& operator=(stop_signals&&) = delete;
+
+	~stop_signals();
+};
+
+} // namespace aptian
@@ -0,0 +1,318 @@
+/*
+aptian - apt repository tool
+
+Copyright (C) 2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.*/
+
+/* ================ LICENSE END ================ */
+
+#include "watcher.hpp"
+
+#include <array>
+#include <cerrno>
+#include <filesystem>
+#include <iostream>
+#include <optional>
+#include <set>
+#include <system_error>
+
+#include <fsif/native_file.hpp>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <utki/debug.hpp>
+#include <utki/string.hpp>
+
+#include "file_descriptor.hpp"
+#include "stop_signals.hpp"
+
+using namespace std::string_view_literals;
+
+using namespace aptian;
+
+namespace {
+constexpr std::string_view failed_subdir = "failed/"sv;
+} // namespace
+
+namespace {
+bool is_package_file_name(std::string_view name)
+{
+	auto suffix = fsif::suffix(name);
+	return suffix == "deb" || suffix == "ddeb";
+}
+} // namespace
+
+namespace {
+class watcher
+{
+	repository repo;
+
+	const watch_options& opts;
+
+	const std::string incoming_dir;
+
+	file_descriptor inotify_fd;
+
+	const file_descriptor& stop_fd;
+
+	// names of the detected package files
+	std::set<std::string> detected;
+
+	// time when the detected package files are added
+	std::chrono::steady_clock::time_point deadline;
+
+	// names of the package files found by scanning the incoming directory which might be still being written
+	std::set<std::string> unsettled;
+
+	// time when the unsettled package files are checked again
+	std::chrono::steady_clock::time_point unsettled_deadline;
+
+	bool stop = false;
+
+	void detect(std::string_view name)
+	{
+		if (!is_package_file_name(name)) {
+			return;
+		}
+		if (this->detected.empty()) {
+			this->deadline = std::chrono::steady_clock::now() + this->opts.debounce;
+		}
+		this->detected.emplace(name);
+		this->unsettled.erase(std::string(name));
+	}
+
+	// The scanned package file which was modified within the debounce time might be still being written,
+	// it is not detected until it is closed, see IN_CLOSE_WRITE, or stays unmodified for the debounce time.
+	void detect_scanned(const std::string& name, std::filesystem::file_time_type now)
+	{
+		if (!is_package_file_name(name)) {
+			return;
+		}
+
+		std::error_code ec;
+		auto mtime = std::filesystem::last_write_time(utki::cat(this->incoming_dir, name), ec);
+		if (ec) {
+			// the file was removed meanwhile
+			this->unsettled.erase(name);
+			return;
+		}
+
+		// the file with modification time in the future is not waited for, it could be waited for too long
+		auto age = now - mtime;
+		if (age >= decltype(age)::zero() && age < this->opts.debounce) {
+			if (this->unsettled.empty()) {
+				this->unsettled_deadline = std::chrono::steady_clock::now() + this->opts.debounce;
+			}
+			this->unsettled.insert(name);
+			return;
+		}
+
+		this->detect(name);
+	}
+
+	void scan_incoming_dir()
+	{
+		auto now = std::filesystem::file_time_type::clock::now();
+		for (const auto& f : fsif::native_file(this->incoming_dir).list_dir()) {
+			if (!fsif::is_dir(f)) {
+				this->detect_scanned(f, now);
+			}
+		}
+	}
+
+	void check_unsettled()
+	{
+		auto now = std::filesystem::file_time_type::clock::now();
+		auto names = std::move(this->unsettled);
+		this->unsettled.clear();
+		for (const auto& name : names) {
+			this->detect_scanned(name, now);
+		}
+	}
+
+	void read_events()
+	{
+		alignas(inotify_event) std::array<char, 0x1000> buffer{};
+		for (;;) {
+			auto res = read(this->inotify_fd.fd, buffer.data(), buffer.size());
+			if (res < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				if (errno == EAGAIN || errno == EWOULDBLOCK) {
+					return;
+				}
+				throw std::system_error(errno, std::generic_category(), "could not read inotify events");
+			}
+
+			for (auto p = buffer.data(); p < buffer.data() + res;) {
+				// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast, "inotify API")
+				const auto& event = *reinterpret_cast<const inotify_event*>(p);
+
+				if (event.mask & IN_Q_OVERFLOW) {
+					// some events were lost
+					this->scan_incoming_dir();
+				} else if (event.len != 0 && !(event.mask & IN_ISDIR)) {
+					// the name is null terminated and padded with nulls
+					// NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-array-to-pointer-decay)
+					this->detect(std::string_view(event.name));
+				}
+
+				p += sizeof(inotify_event) + event.len;
+			}
+		}
+	}
+
+	void add_detected()
+	{
+		std::vector<add_request> requests;
+		requests.reserve(this->detected.size());
+		for (const auto& name : this->detected) {
+			// one request per package file, so that a bad file does not prevent adding the other ones
+			requests.push_back({
+				.targets = this->opts.targets,
+				.package_paths = {utki::cat(this->incoming_dir, name)}
+			});
+		}
+		this->detected.clear();
+
+		std::cout << "add " << requests.size() << " package file(s) from " << this->incoming_dir << std::endl;
+
+		std::vector<std::exception_ptr> errors;
+		try {
+			errors = this->repo.add(requests);
+		} catch (...) {
+			errors.assign(requests.size(), std::current_exception());
+		}
+		ASSERT(errors.size() == requests.size())
+
+		for (size_t i = 0; i != requests.size(); ++i) {
+			const auto& path = requests[i].package_paths.front();
+
+			std::error_code ec;
+
+			if (!errors[i]) {
+				// the file might be already moved to the pool
+				std::filesystem::remove(path, ec);
+				continue;
+			}
+
+			try {
+				std::rethrow_exception(errors[i]);
+			} catch (const std::exception& e) {
+				std::cout << "ERROR: " << e.what() << std::endl;
+			}
+
+			if (!std::filesystem::exists(path, ec)) {
+				continue;
+			}
+
+			auto failed_dir = utki::cat(this->incoming_dir, failed_subdir);
+			std::filesystem::create_directories(failed_dir);
+			std::filesystem::rename(path, utki::cat(failed_dir, fsif::not_dir(path)));
+		}
+
+		std::cout << "done" << std::endl;
+	}
+
+	int get_poll_timeout() const
+	{
+		std::optional<std::chrono::steady_clock::time_point> wake_up;
+		if (!this->detected.empty()) {
+			wake_up = this->deadline;
+		}
+		if (!this->unsettled.empty()) {
+			wake_up = wake_up.has_value() ? std::min(wake_up.value(), this->unsettled_deadline) : this->unsettled_deadline;
+		}
+		if (!wake_up.has_value()) {
+			return -1;
+		}
+		auto left = std::chrono::ceil<std::chrono::milliseconds>(wake_up.value() - std::chrono::steady_clock::now());
+		return int(std::max(left.count(), decltype(left.count())(0)));
+	}
+
+public:
+	watcher(std::string_view dir, const add_options& options, const watch_options& opts, const file_descriptor& stop_fd) :
+		repo(dir, options),
+		opts(opts),
+		incoming_dir(fsif::as_dir(opts.incoming_dir)),
+		inotify_fd(inotify_init1(IN_NONBLOCK | IN_CLOEXEC), "could not create inotify instance"),
+		stop_fd(stop_fd)
+	{
+		// IN_CLOSE_WRITE means the file is completely written, unlike IN_CREATE or IN_MODIFY
+		if (inotify_add_watch(this->inotify_fd.fd, this->incoming_dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+			throw std::system_error(errno, std::generic_category(), utki::cat("could not watch ", this->incoming_dir));
+		}
+	}
+
+	void run()
+	{
+		std::cout << "watching " << this->incoming_dir << std::endl;
+
+		// the watch is already set up, so no file is missed between the scan and the events
+		this->scan_incoming_dir();
+
+		while (!this->stop || !this->detected.empty()) {
+			if (!this->detected.empty() && (this->stop || std::chrono::steady_clock::now() >= this->deadline)) {
+				this->add_detected();
+				continue;
+			}
+
+			// the unsettled files are left for the next run in case of stop
+			if (!this->unsettled.empty() && !this->stop &&
+				std::chrono::steady_clock::now() >= this->unsettled_deadline)
+			{
+				this->check_unsettled();
+				continue;
+			}
+
+			std::array<pollfd, 2> fds = {
+				{
+					{.fd = this->stop_fd.fd, .events = POLLIN, .revents = 0},
+					{.fd = this->inotify_fd.fd, .events = POLLIN, .revents = 0},
+				}
+			};
+
+			if (poll(fds.data(), fds.size(), this->get_poll_timeout()) < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				throw std::system_error(errno, std::generic_category(), "poll() failed");
+			}
+
+			if (fds[0].revents != 0) {
+				std::cout << "stop requested" << std::endl;
+				this->stop = true;
+			}
+
+			if (fds[1].revents != 0) {
+				this->read_events();
+			}
+		}
+	}
+};
+} // namespace
+
+void aptian::watch(std::string_view dir, const add_options& options, const watch_options& watch_opts)
+{
+	ASSERT(!watch_opts.targets.empty())
+
+	// block the stop signals before any worker threads are started, so that the threads inherit the signal mask
+	stop_signals signals;
+
+	watcher w(dir, options, watch_opts, signals.fd);
+
+	w.run();
+}
@@ -0,0 +1,62 @@
+/*
+aptian - apt repository tool
+
+Copyright (C) 2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.*/
+
+/* ================ LICENSE END ================ */
+
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "operations.hpp"
+
+namespace aptian {
+
+struct watch_options {
+	// directory where the uploaded package files appear
+	std::string incoming_dir;
+
+	// distribution components to add the packages to
+	std::vector<add_target> targets;
+
+	// the package files appearing within this time after the first one are added as one batch
+	std::chrono::milliseconds debounce = std::chrono::seconds(1);
+};
+
+/**
+ * @brief Add package files appearing in incoming directory to APT repository.
+ * The package files are detected when those are closed after writing or moved to the incoming directory.
+ * The uploaders must write the files under a temporary name without .deb or .ddeb suffix and rename those
+ * when done, otherwise a file whose upload is interrupted, or is closed and reopened, can be added incomplete.
+ * The files detected within the debounce time are added as one batch, see aptian::repository.
+ * The package files already present in the incoming directory are added first, except the ones modified
+ * within the debounce time, those might be still being written, so those are added once closed or
+ * not modified for the debounce time.
+ * The added package files are removed from the incoming directory, the ones which failed to be added
+ * are moved to the 'failed' subdirectory of the incoming directory.
+ * The function returns after SIGINT or SIGTERM is received and the detected files are added.
+ * @param dir - base directory of the repository.
+ * @param options - options of adding packages.
+ * @param watch_opts - watch options.
+ * @throw std::system_error - in case the incoming directory cannot be watched.
+ */
+void watch(std::string_view dir, const add_options& options, const watch_options& watch_opts);
+
+} // namespace aptian
@@ -0,0 +1,77 @@
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <aptian/digest.hpp>
+#include <aptian/hasher.hpp>
+
+namespace{
+// size of data to hash in one measurement
+constexpr size_t data_size = 0x4000000; // 64 MiB
+
+// size of chunks the data is fed to the digest with, same as used by aptian::get_file_hashes()
+constexpr size_t chunk_size = 0x40000;
+
+constexpr unsigned num_iterations = 4;
+
+template <typename digest_type>
+void measure(std::string_view name, utki::span<const uint8_t> data, digest_type& d){
+    // warm up
+    d.update(data.subspan(0, chunk_size));
+    d.finish();
+
+    double best_seconds = std::numeric_limits<double>::max();
+
+    for(unsigned i = 0; i != num_iterations; ++i){
+        auto start = std::chrono::steady_clock::now();
+
+        for(size_t offset = 0; offset < data.size(); offset += chunk_size){
+            d.update(data.subspan(offset, std::min(chunk_size, data.size() - offset)));
+        }
+        d.finish();
+
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        best_seconds = std::min(best_seconds, elapsed.count());
+    }
+
+    constexpr double mega = 1000000;
+
+    std::cout << std::setw(32) << std::left << name << std::fixed << std::setprecision(1)
+              << double(data.size()) / mega / best_seconds << " MB/s" << '\n';
+}
+}
+
+int main(){
+    std::vector<uint8_t> data(data_size);
+    for(size_t i = 0; i != data.size(); ++i){
+        data[i] = uint8_t(i * 131 + (i >> 7));
+    }
+
+    {
+        aptian::md5 d;
+        measure("md5", data, d);
+    }
+    {
+        aptian::sha1 d;
+        measure("sha1", data, d);
+    }
+    for(const auto& k : aptian::sha256::get_kernels()){
+        aptian::sha256 d(k);
+        measure(std::string("sha256 (") + std::string(k.name) + ")", data, d);
+    }
+    for(const auto& k : aptian::sha512::get_kernels()){
+        aptian::sha512 d(k);
+        measure(std::string("sha512 (") + std::string(k.name) + ")", data, d);
+    }
+    {
+        aptian::hasher d;
+        measure("all hashes (aptian::hasher)", data, d);
+    }
+
+    std::cout << std::flush;
+
+    return 0;
+}
@@ -0,0 +1,35 @@
+#!/bin/bash
+
+# New packages are appended to the index files, unless the files were changed since aptian wrote them.
+
+source ../common.sh
+
+repo=$work_dir/repo
+debs=$work_dir/debs
+bin_dir=$repo/dists/bookworm/main/binary-amd64
+
+init_repo "$repo" --compression=gz,xz,zst
+
+make_deb "$debs" a 1.0 amd64
+make_deb "$debs" b 1.0 amd64
+make_deb "$debs" c 1.0 amd64
+
+run_aptian add --dir="$repo" --dist=bookworm --comp=main "$debs/a_1.0_amd64.deb"
+inode=$(stat -c %i "$bin_dir/Packages")
+
+echo "append to unchanged index files"
+run_aptian add --dir="$repo" --dist=bookworm --comp=main "$debs/b_1.0_amd64.deb"
+[ "$(stat -c %i "$bin_dir/Packages")" = "$inode" ] || fail "Packages file was rewritten instead of appending to it"
+[ -e "$repo/.aptian/dists/bookworm/main/binary-amd64/Packages.appending" ] && fail "append marker was not removed"
+[ "$(count_packages "$bin_dir/Packages")" = 2 ] || fail "wrong number of packages"
+check_compressed "$bin_dir/Packages"
+check_release "$repo/dists/bookworm"
+
+echo "rewrite changed index files"
+gzip -dc "$bin_dir/Packages.gz" | gzip -9 > "$work_dir/Packages.gz"
+mv "$work_dir/Packages.gz" "$bin_dir/Packages.gz"
+run_aptian add --dir="$repo" --dist=bookworm --comp=main "$debs/c_1.0_amd64.deb"
+[ "$(stat -c %i "$bin_dir/Packages")" != "$inode" ] || fail "Packages file was appended to instead of rewriting it"
+[ "$(count_packages "$bin_dir/Packages")" = 3 ] || fail "wrong number of packages"
+check_compressed "$bin_dir/Packages"
+check_release "$repo/dists/bookworm"
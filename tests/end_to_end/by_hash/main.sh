@@ -0,0 +1,53 @@
+#!/bin/bash
+
+# Index files are hard linked to by-hash directory and by-hash files of old generations are pruned.
+
+source ../common.sh
+
+repo=$work_dir/repo
+debs=$work_dir/debs
+bin_dir=$repo/dists/bookworm/main/binary-amd64
+by_hash_dir=$bin_dir/by-hash/SHA256
+
+# two index files per generation: Packages and Packages.gz
+init_repo "$repo" --compression=gz --acquire-by-hash=2
+
+sha256(){
+	sha256sum "$1" | cut -d ' ' -f 1
+}
+
+for pkg in a b c d; do
+	echo "add package $pkg"
+
+	if [ -f "$bin_dir/Packages" ]; then
+		cp "$bin_dir/Packages" "$work_dir/Packages.prev"
+		cp "$bin_dir/Packages.gz" "$work_dir/Packages.gz.prev"
+	fi
+
+	make_deb "$debs" $pkg 1.0 amd64
+	run_aptian add --dir="$repo" --dist=bookworm --comp=main "$debs/${pkg}_1.0_amd64.deb"
+
+	grep -q '^Acquire-By-Hash: yes$' "$repo/dists/bookworm/Release" || fail "Release does not enable by-hash"
+	check_compressed "$bin_dir/Packages"
+	check_release "$repo/dists/bookworm"
+
+	for f in Packages Packages.gz; do
+		by_hash_file=$by_hash_dir/$(sha256 "$bin_dir/$f")
+		[ -f "$by_hash_file" ] || fail "$f is not in by-hash directory"
+		[ "$(stat -c %i "$by_hash_file")" = "$(stat -c %i "$bin_dir/$f")" ] || fail "by-hash $f is not a hard link"
+	done
+
+	# previous generation is retained unmodified
+	for f in Packages Packages.gz; do
+		if [ -f "$work_dir/$f.prev" ]; then
+			by_hash_file=$by_hash_dir/$(sha256 "$work_dir/$f.prev")
+			[ -f "$by_hash_file" ] || fail "previous $f was pruned"
+			cmp -s "$by_hash_file" "$work_dir/$f.prev" || fail "previous $f was modified"
+		fi
+	done
+
+	num_files=$(find "$by_hash_dir" -type f | wc -l)
+	[ "$num_files" -le 4 ] || fail "old generations were not pruned, $num_files files in by-hash directory"
+done
+
+[ "$(find "$by_hash_dir" -type f | wc -l)" = 4 ] || fail "wrong number of files in by-hash directory"
@@ -0,0 +1,105 @@
+# Common functions of end-to-end tests.
+# The test script is run from its directory with path to aptian executable as the first argument.
+
+set -eu
+
+aptian=$(realpath "$1")
+
+fail(){
+	echo "FAILED: $*"
+	exit 1
+}
+
+work_dir=$(mktemp -d)
+
+# throwaway keyring for signing the repository
+export GNUPGHOME=$work_dir/gnupg
+mkdir -m 700 "$GNUPGHOME"
+
+# set KEEP environment variable to keep the test files for debugging
+cleanup(){
+	gpgconf --kill gpg-agent || true
+	if [ -n "${KEEP:-}" ]; then
+		echo "test files are kept in $work_dir"
+	else
+		rm -rf "$work_dir"
+	fi
+}
+trap cleanup EXIT
+
+gpg --batch --quiet --passphrase '' --quick-gen-key 'aptian test <test@aptian.test>' default default never
+
+gpg_key=test@aptian.test
+
+# Run aptian, its output is shown only in case it fails.
+run_aptian(){
+	local log
+	log=$(mktemp -p "$work_dir")
+	"$aptian" "$@" > "$log" 2>&1 || {
+		cat "$log"
+		fail "aptian $*"
+	}
+	rm "$log"
+}
+
+# Create repository in the given directory, the rest of the arguments are passed to 'aptian init'.
+init_repo(){
+	local repo_dir=$1
+	shift
+	mkdir -p "$repo_dir"
+	run_aptian init --dir="$repo_dir" --gpg=$gpg_key "$@"
+}
+
+# Create package file.
+# Usage: make_deb <output-dir> <package> <version> <arch> [<file-contents>]
+make_deb(){
+	local pkg_dir
+	pkg_dir=$(mktemp -d -p "$work_dir")
+	mkdir -p "$pkg_dir/DEBIAN" "$pkg_dir/usr/share/$2"
+	echo "${5:-$2 $3}" > "$pkg_dir/usr/share/$2/file.txt"
+	cat > "$pkg_dir/DEBIAN/control" <<EOC
+Package: $2
+Version: $3
+Architecture: $4
+Maintainer: Test <test@aptian.test>
+Description: test package $2
+EOC
+	mkdir -p "$1"
+	dpkg-deb -Zgzip --build "$pkg_dir" "$1/${2}_${3}_${4}.deb" > /dev/null
+	rm -rf "$pkg_dir"
+}
+
+# Print number of packages in Packages file.
+count_packages(){
+	grep -c '^Package: ' "$1" || true
+}
+
+# Check that compressed variants of the Packages file decompress to it.
+# Decompression is done like APT does, i.e. only the first stream of xz file is decompressed.
+check_compressed(){
+	local packages=$1
+	if [ -f "$packages.gz" ]; then
+		gzip -dc "$packages.gz" | cmp -s - "$packages" || fail "$packages.gz does not match $packages"
+	fi
+	if [ -f "$packages.xz" ]; then
+		xz --single-stream -dc "$packages.xz" | cmp -s - "$packages" || fail "$packages.xz does not match $packages"
+	fi
+	if [ -f "$packages.zst" ]; then
+		zstd -qdc "$packages.zst" | cmp -s - "$packages" || fail "$packages.zst does not match $packages"
+	fi
+}
+
+# Check signatures of the Release file and that SHA256 sums of the files listed in it match the files.
+check_release(){
+	local dist_dir=$1
+	gpg --quiet --verify "$dist_dir/InRelease" 2> /dev/null || fail "bad signature of $dist_dir/InRelease"
+	gpg --quiet --verify "$dist_dir/Release.gpg" "$dist_dir/Release" 2> /dev/null ||
+		fail "bad signature of $dist_dir/Release"
+
+	local sha256 size path
+	sed -n '/^SHA256:$/,/^[^ ]/p' "$dist_dir/Release" | grep '^ ' | while read -r sha256 size path; do
+		[ -f "$dist_dir/$path" ] || fail "$path listed in Release does not exist"
+		[ "$(stat -c %s "$dist_dir/$path")" = "$size" ] || fail "size of $path does not match Release"
+		[ "$(sha256sum "$dist_dir/$path" | cut -d ' ' -f 1)" = "$sha256" ] || fail "SHA256 of $path does not match Release"
+	done
+}
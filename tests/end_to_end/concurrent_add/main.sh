@@ -0,0 +1,44 @@
+#!/bin/bash
+
+# Several 'aptian add' runs on the same repository at once do not lose packages or corrupt index files.
+
+source ../common.sh
+
+repo=$work_dir/repo
+debs=$work_dir/debs
+num_pkgs=8
+
+init_repo "$repo" --compression=gz,xz,zst
+
+for i in $(seq $num_pkgs); do
+	make_deb "$debs" main$i 1.0 amd64
+	make_deb "$debs" extra$i 1.0 amd64
+done
+
+echo "run adds concurrently"
+pids=()
+for i in $(seq $num_pkgs); do
+	for comp in main extra; do
+		"$aptian" add --dir="$repo" --dist=bookworm --comp=$comp "$debs/$comp${i}_1.0_amd64.deb" \
+			> "$work_dir/add_$comp$i.log" 2>&1 &
+		pids+=($!)
+	done
+done
+
+for pid in "${pids[@]}"; do
+	wait "$pid" || {
+		cat "$work_dir"/add_*.log
+		fail "one of the adds failed"
+	}
+done
+
+for comp in main extra; do
+	bin_dir=$repo/dists/bookworm/$comp/binary-amd64
+	[ "$(count_packages "$bin_dir/Packages")" = $num_pkgs ] || fail "wrong number of packages in $comp"
+	for i in $(seq $num_pkgs); do
+		grep -q "^Package: $comp$i$" "$bin_dir/Packages" || fail "package $comp$i is missing"
+	done
+	check_compressed "$bin_dir/Packages"
+done
+grep -q '^Components: extra main$' "$repo/dists/bookworm/Release" || fail "wrong components in Release"
+check_release "$repo/dists/bookworm"
@@ -0,0 +1,45 @@
+#!/bin/bash
+
+# Data left in the index files by interrupted appending is not published by the next addition,
+# while the data appended to the Packages file by other means is kept.
+
+source ../common.sh
+
+repo=$work_dir/repo
+debs=$work_dir/debs
+bin_dir=$repo/dists/bookworm/main/binary-amd64
+state_dir=$repo/.aptian/dists/bookworm/main/binary-amd64
+
+init_repo "$repo" --compression=gz,zst
+
+make_deb "$debs" a 1.0 amd64
+make_deb "$debs" b 1.0 amd64
+make_deb "$debs" c 1.0 amd64
+
+run_aptian add --dir="$repo" --dist=bookworm --comp=main "$debs/a_1.0_amd64.deb"
+
+echo "cut off interrupted append"
+# simulate aptian killed while appending to the index files
+[ -f "$state_dir/Packages.idx" ] || fail "Packages.idx is not in $state_dir"
+touch "$state_dir/Packages.appending"
+printf 'Package: broken\nVers' >> "$bin_dir/Packages"
+printf 'garbage' >> "$bin_dir/Packages.gz"
+
+# the already added package is checked against its Packages file entry
+run_aptian add --dir="$repo" --dist=bookworm --comp=main "$debs/a_1.0_amd64.deb" "$debs/b_1.0_amd64.deb"
+
+[ "$(count_packages "$bin_dir/Packages")" = 2 ] || fail "wrong number of packages"
+! grep -q broken "$bin_dir/Packages" || fail "partially appended paragraph is published"
+[ -e "$state_dir/Packages.appending" ] && fail "append marker was not removed"
+check_compressed "$bin_dir/Packages"
+check_release "$repo/dists/bookworm"
+
+echo "keep data appended by other means"
+printf '\nPackage: manual\nVersion: 1.0\nArchitecture: amd64\n' >> "$bin_dir/Packages"
+
+run_aptian add --dir="$repo" --dist=bookworm --comp=main "$debs/c_1.0_amd64.deb"
+
+[ "$(count_packages "$bin_dir/Packages")" = 4 ] || fail "wrong number of packages"
+grep -q '^Package: manual$' "$bin_dir/Packages" || fail "manually appended paragraph is lost"
+check_compressed "$bin_dir/Packages"
+check_release "$repo/dists/bookworm"
@@ -0,0 +1,37 @@
+#!/bin/bash
+
+# Packages are added to each combination of the given distributions and components.
+
+source ../common.sh
+
+repo=$work_dir/repo
+debs=$work_dir/debs
+
+init_repo "$repo"
+
+make_deb "$debs" a 1.0 amd64
+make_deb "$debs" b 1.0 all
+
+run_aptian add --dir="$repo" --dist=bookworm,noble --comp=main --comp=extra --pool-insertion=move \
+	"$debs/a_1.0_amd64.deb" "$debs/b_1.0_all.deb"
+
+[ ! -e "$debs/a_1.0_amd64.deb" ] || fail "moved package file is still in place"
+
+for dist in bookworm noble; do
+	for comp in main extra; do
+		for arch_pkg in "amd64 a a_1.0_amd64.deb" "all b b_1.0_all.deb"; do
+			read -r arch pkg filename <<< "$arch_pkg"
+			packages=$repo/dists/$dist/$comp/binary-$arch/Packages
+			pool_path=pool/$dist/$comp/${pkg:0:1}/$pkg/$filename
+
+			[ "$(count_packages "$packages")" = 1 ] || fail "wrong number of packages in $packages"
+			check_compressed "$packages"
+
+			[ -f "$repo/$pool_path" ] || fail "$pool_path does not exist"
+			grep -q "^Filename: $pool_path$" "$packages" || fail "$pool_path is not listed in $packages"
+		done
+	done
+
+	grep -q '^Components: extra main$' "$repo/dists/$dist/Release" || fail "wrong components in $dist Release"
+	check_release "$repo/dists/$dist"
+done
@@ -0,0 +1,38 @@
+#!/bin/bash
+
+# Package which already exists in the pool is compared to the one being added
+# using the sizes and hash sums listed in the Packages file.
+
+source ../common.sh
+
+repo=$work_dir/repo
+bin_dir=$repo/dists/bookworm/main/binary-amd64
+pool_file=$repo/pool/bookworm/main/a/a/a_1.0_amd64.deb
+
+init_repo "$repo"
+
+make_deb "$work_dir/debs" a 1.0 amd64 "contents 1"
+make_deb "$work_dir/other" a 1.0 amd64 "contents 2"
+
+run_aptian add --dir="$repo" --dist=bookworm --comp=main "$work_dir/debs/a_1.0_amd64.deb"
+cp "$bin_dir/Packages" "$work_dir/Packages.orig"
+
+echo "add same package again"
+output=$("$aptian" add --dir="$repo" --dist=bookworm --comp=main "$work_dir/debs/a_1.0_amd64.deb" 2>&1) ||
+	fail "adding same package again failed: $output"
+echo "$output" | grep -q "already exists in the pool and has same contents" || fail "same package was not detected"
+cmp -s "$bin_dir/Packages" "$work_dir/Packages.orig" || fail "Packages file changed"
+
+echo "add different package with same file name"
+# same size makes the check go past the size comparison down to the hash sums
+[ "$(stat -c %s "$work_dir/other/a_1.0_amd64.deb")" = "$(stat -c %s "$pool_file")" ] ||
+	fail "test packages differ in size"
+cmp -s "$work_dir/other/a_1.0_amd64.deb" "$pool_file" && fail "test packages are identical"
+if output=$("$aptian" add --dir="$repo" --dist=bookworm --comp=main "$work_dir/other/a_1.0_amd64.deb" 2>&1); then
+	fail "adding different package with same file name succeeded"
+fi
+echo "$output" | grep -q "already exists in the pool and is different" || fail "unexpected error: $output"
+cmp -s "$work_dir/debs/a_1.0_amd64.deb" "$pool_file" || fail "pool file changed"
+cmp -s "$bin_dir/Packages" "$work_dir/Packages.orig" || fail "Packages file changed"
+check_compressed "$bin_dir/Packages"
+check_release "$repo/dists/bookworm"
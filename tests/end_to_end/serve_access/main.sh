@@ -0,0 +1,65 @@
+#!/bin/bash
+
+# Server accepts requests only from the clients running as the same user,
+# the options of adding packages cannot be given to the client.
+
+source ../common.sh
+
+repo=$work_dir/repo
+debs=$work_dir/debs
+socket=$work_dir/aptian.sock
+bin_dir=$repo/dists/bookworm/main/binary-amd64
+
+init_repo "$repo"
+
+make_deb "$debs" a 1.0 amd64
+make_deb "$debs" b 1.0 amd64
+
+"$aptian" serve --dir="$repo" --socket="$socket" --pool-insertion=move > "$work_dir/serve.log" 2>&1 &
+serve_pid=$!
+
+for i in $(seq 50); do
+	[ -S "$socket" ] && break
+	sleep 0.1
+done
+[ -S "$socket" ] || fail "server did not start"
+
+[ "$(stat -c %a "$socket")" = 600 ] || fail "socket is accessible to others"
+
+echo "reject options of adding packages"
+if output=$("$aptian" add --socket="$socket" --dist=bookworm --comp=main --jobs=2 "$debs/a_1.0_amd64.deb" 2>&1); then
+	fail "--jobs is accepted with --socket"
+fi
+echo "$output" | grep -q "cannot be given with --socket" || fail "unexpected error: $output"
+
+echo "add from same user"
+run_aptian add --socket="$socket" --dist=bookworm --comp=main "$debs/a_1.0_amd64.deb"
+[ -e "$debs/a_1.0_amd64.deb" ] && fail "package file was not moved to the pool"
+grep -q '^Package: a$' "$bin_dir/Packages" || fail "package a is not added"
+
+if [ "$(id -u)" = 0 ] && command -v setpriv > /dev/null; then
+	echo "reject other user"
+	# let the other user run the client and connect to the socket
+	chmod 755 "$work_dir" "$debs"
+	cp "$aptian" "$work_dir/aptian"
+	chmod 666 "$socket"
+
+	if output=$(setpriv --reuid=65534 --regid=65534 --clear-groups \
+		"$work_dir/aptian" add --socket="$socket" --dist=bookworm --comp=main "$debs/b_1.0_amd64.deb" 2>&1)
+	then
+		fail "request of other user is accepted"
+	fi
+	echo "$output" | grep -q "permission denied" || fail "unexpected error: $output"
+	[ -e "$debs/b_1.0_amd64.deb" ] || fail "package file of other user was moved"
+	grep -q '^Package: b$' "$bin_dir/Packages" && fail "package of other user is added"
+else
+	echo "not root, skip checking requests of other user"
+fi
+
+kill -TERM $serve_pid
+wait $serve_pid || {
+	cat "$work_dir/serve.log"
+	fail "server failed"
+}
+[ -e "$socket" ] && fail "socket file is not removed"
+check_release "$repo/dists/bookworm"
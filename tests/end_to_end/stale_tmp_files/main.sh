@@ -0,0 +1,36 @@
+#!/bin/bash
+
+# Temporary index files left by a killed aptian process are not listed in Release and are removed by the next run.
+
+source ../common.sh
+
+repo=$work_dir/repo
+debs=$work_dir/debs
+dist_dir=$repo/dists/bookworm
+bin_dir=$dist_dir/main/binary-amd64
+
+init_repo "$repo" --compression=gz
+
+make_deb "$debs" a 1.0 amd64
+make_deb "$debs" b 1.0 amd64
+make_deb "$debs" c 1.0 amd64
+
+run_aptian add --dir="$repo" --dist=bookworm --comp=main "$debs/a_1.0_amd64.deb"
+
+# leftovers of a killed run
+echo "Package: partial" > "$bin_dir/Packages.new"
+echo "partial" > "$bin_dir/Packages.gz.new"
+
+echo "temporary files of other component are not listed in Release"
+run_aptian add --dir="$repo" --dist=bookworm --comp=extra "$debs/b_1.0_amd64.deb"
+grep -q '\.new$' "$dist_dir/Release" && fail "temporary files are listed in Release"
+check_release "$dist_dir"
+
+echo "temporary files are removed when component is updated"
+run_aptian add --dir="$repo" --dist=bookworm --comp=main "$debs/c_1.0_amd64.deb"
+[ -e "$bin_dir/Packages.new" ] && fail "Packages.new was not removed"
+[ -e "$bin_dir/Packages.gz.new" ] && fail "Packages.gz.new was not removed"
+grep -q '\.new$' "$dist_dir/Release" && fail "temporary files are listed in Release"
+[ "$(count_packages "$bin_dir/Packages")" = 2 ] || fail "wrong number of packages"
+check_compressed "$bin_dir/Packages"
+check_release "$dist_dir"
@@ -0,0 +1,58 @@
+#!/bin/bash
+
+# Package file which is still being uploaded when 'watch' starts is added only after its upload completes.
+
+source ../common.sh
+
+repo=$work_dir/repo
+incoming=$work_dir/incoming
+bin_dir=$repo/dists/bookworm/main/binary-amd64
+
+init_repo "$repo"
+
+make_deb "$work_dir/debs" a 1.0 amd64 "$(head -c 100000 /dev/urandom | base64)"
+deb=$work_dir/debs/a_1.0_amd64.deb
+deb_size=$(stat -c %s "$deb")
+chunk_size=$((deb_size / 8 + 1))
+
+mkdir -p "$incoming"
+
+# the upload writes a chunk every 0.25 s, i.e. more often than the debounce time,
+# and keeps the file open till the end, so that the only close after writing is when the upload completes
+(
+	for i in $(seq 0 7); do
+		dd if="$deb" bs=$chunk_size skip=$i count=1 status=none
+		sleep 0.25
+	done
+) > "$incoming/a_1.0_amd64.deb" &
+upload_pid=$!
+
+# let the upload start before the watch
+sleep 0.3
+
+"$aptian" watch --dir="$repo" --incoming="$incoming" --dist=bookworm --comp=main --debounce=1000 \
+	> "$work_dir/watch.log" 2>&1 &
+watch_pid=$!
+
+wait $upload_pid
+[ -e "$incoming/a_1.0_amd64.deb" ] || fail "package file was picked up before its upload completed"
+cmp -s "$deb" "$incoming/a_1.0_amd64.deb" || fail "upload is not complete"
+
+for i in $(seq 50); do
+	[ -e "$incoming/a_1.0_amd64.deb" ] || break
+	sleep 0.1
+done
+
+kill -TERM $watch_pid
+wait $watch_pid || {
+	cat "$work_dir/watch.log"
+	fail "watch failed"
+}
+
+[ -e "$incoming/failed/a_1.0_amd64.deb" ] && {
+	cat "$work_dir/watch.log"
+	fail "incompletely uploaded package file was added"
+}
+[ -e "$incoming/a_1.0_amd64.deb" ] && fail "package file was not added"
+[ "$(count_packages "$bin_dir/Packages")" = 1 ] || fail "wrong number of packages"
+check_release "$repo/dists/bookworm"
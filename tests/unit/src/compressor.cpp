@@ -0,0 +1,160 @@
+#include <tst/set.hpp>
+#include <tst/check.hpp>
+
+#include <aptian/compressor.hpp>
+#include <aptian/decompressor.hpp>
+
+using namespace std::string_literals;
+using namespace std::string_view_literals;
+
+namespace{
+class vector_sink : public aptian::sink{
+public:
+    std::vector<uint8_t> data;
+    bool finished = false;
+
+    void write(utki::span<const uint8_t> d)override{
+        this->data.insert(this->data.end(), d.begin(), d.end());
+    }
+
+    void finish()override{
+        this->finished = true;
+    }
+};
+
+// text-like data which compresses reasonably well
+std::vector<uint8_t> make_test_data(size_t size){
+    std::vector<uint8_t> ret;
+    ret.reserve(size);
+    for(size_t i = 0; ret.size() < size; ++i){
+        auto line = "Package: package-"s + std::to_string(i * 7919 % 1000) + "\nVersion: 1.0."s + std::to_string(i) + "\n\n"s;
+        ret.insert(ret.end(), line.begin(), line.end());
+    }
+    ret.resize(size);
+    return ret;
+}
+
+std::vector<uint8_t> compress(utki::span<const uint8_t> data, const aptian::gzip_compressor::parameters& params){
+    vector_sink out;
+    aptian::gzip_compressor c(out, params);
+
+    // write in portions of different sizes
+    for(size_t chunk_size = 1; !data.empty(); chunk_size = chunk_size * 3 + 1){
+        auto n = std::min(chunk_size, data.size());
+        c.write(data.subspan(0, n));
+        data = data.subspan(n);
+    }
+    c.finish();
+
+    tst::check(out.finished, SL);
+    return std::move(out.data);
+}
+
+std::vector<uint8_t> compress(utki::span<const uint8_t> data, aptian::compression_format format, unsigned num_jobs){
+    vector_sink out;
+    auto c = aptian::make_compressor(format, out, {.num_jobs = num_jobs, .rsyncable = false});
+    c->write(data);
+    c->finish();
+
+    tst::check(out.finished, SL);
+    return std::move(out.data);
+}
+
+std::vector<uint8_t> decompress(utki::span<const uint8_t> data, std::string_view file_name = "Packages.gz"sv){
+    auto d = aptian::make_decompressor(file_name);
+    std::vector<uint8_t> ret;
+    d->feed(data, ret);
+    d->finish(ret);
+    return ret;
+}
+}
+
+namespace{
+const tst::set set("compressor", [](tst::suite& suite){ // NOLINT
+    suite.add("gzip_compressed_data_decompresses_to_original", [](){
+        const std::vector<std::pair<size_t, aptian::gzip_compressor::parameters>> cases = {
+            {0, {}},
+            {1, {}},
+            {1000, {}},
+            {1000000, {}},
+            {1000000, {.level = 9, .num_jobs = 4, .rsyncable = false}},
+            {1000000, {.level = 1, .num_jobs = 3, .rsyncable = true}},
+            {0, {.level = 6, .num_jobs = 1, .rsyncable = true}}
+        };
+
+        for(const auto& c : cases){
+            auto data = make_test_data(c.first);
+            auto compressed = compress(data, c.second);
+
+            tst::check(compressed.size() >= 18, SL);
+            tst::check(compressed[0] == 0x1f && compressed[1] == 0x8b, SL);
+
+            tst::check(decompress(compressed) == data, SL) << "size = " << c.first;
+        }
+    });
+
+    suite.add("gzip_output_does_not_depend_on_number_of_jobs", [](){
+        auto data = make_test_data(1000000);
+
+        for(bool rsyncable : {false, true}){
+            auto expected = compress(data, {.level = 6, .num_jobs = 1, .rsyncable = rsyncable});
+            auto actual = compress(data, {.level = 6, .num_jobs = 5, .rsyncable = rsyncable});
+            tst::check(actual == expected, SL);
+        }
+    });
+
+    suite.add("gzip_rsyncable_output_changes_locally", [](){
+        auto data = make_test_data(1000000);
+        auto changed_data = data;
+        changed_data.insert(changed_data.begin() + 1000, 'x');
+
+        auto compressed = compress(data, {.level = 6, .num_jobs = 1, .rsyncable = true});
+        auto changed_compressed = compress(changed_data, {.level = 6, .num_jobs = 1, .rsyncable = true});
+
+        // the tail of the compressed stream before the trailer is expected to be the same
+        constexpr size_t trailer_size = 8;
+        constexpr size_t tail_size = 10000;
+        tst::check(compressed.size() > tail_size + trailer_size, SL);
+        tst::check(changed_compressed.size() > tail_size + trailer_size, SL);
+        tst::check(
+            std::equal(
+                compressed.end() - tail_size - trailer_size,
+                compressed.end() - trailer_size,
+                changed_compressed.end() - tail_size - trailer_size
+            ),
+            SL
+        );
+    });
+
+    suite.add("compressed_data_decompresses_to_original", [](){
+        using aptian::compression_format;
+
+        for(auto format : {compression_format::gzip, compression_format::xz, compression_format::zstd}){
+            for(size_t size : {size_t(0), size_t(1000), size_t(3000000)}){
+                auto data = make_test_data(size);
+                auto file_name = "Packages"s + std::string(aptian::to_suffix(format));
+
+                auto compressed = compress(data, format, 1);
+                tst::check(decompress(compressed, file_name) == data, SL) << file_name << ", size = " << size;
+
+                auto compressed_mt = compress(data, format, 4);
+                tst::check(compressed_mt == compressed, SL) << file_name << ", size = " << size;
+            }
+        }
+    });
+
+    suite.add("compression_format_names", [](){
+        tst::check(aptian::to_compression_format("gz"sv) == aptian::compression_format::gzip, SL);
+        tst::check(aptian::to_compression_format("xz"sv) == aptian::compression_format::xz, SL);
+        tst::check(aptian::to_compression_format("zst"sv) == aptian::compression_format::zstd, SL);
+
+        bool thrown = false;
+        try{
+            aptian::to_compression_format("bz2"sv);
+        }catch(std::invalid_argument&){
+            thrown = true;
+        }
+        tst::check(thrown, SL);
+    });
+});
+}
@@ -0,0 +1,87 @@
+#include <tst/set.hpp>
+#include <tst/check.hpp>
+
+#include <aptian/contents.hpp>
+
+#include "util.hpp"
+
+using namespace std::string_literals;
+using namespace std::string_view_literals;
+
+namespace{
+class string_sink : public aptian::sink{
+public:
+    std::string data;
+
+    void write(utki::span<const uint8_t> d)override{
+        this->data.append(utki::make_string_view(d));
+    }
+
+    void finish()override{}
+};
+}
+
+namespace{
+const tst::set set("contents", [](tst::suite& suite){ // NOLINT
+    suite.add("new_index_is_sorted_by_path", [](){
+        aptian::contents_index index;
+        index.add("utils/b"sv, std::vector<std::string>{"usr/bin/b"s, "usr/share/doc/b/copyright"s});
+        index.add("a"sv, std::vector<std::string>{"usr/bin/a"s, "usr/share/doc/b/copyright"s});
+
+        string_sink out;
+        index.write({}, out);
+
+        tst::check_eq(
+            out.data,
+            "usr/bin/a\ta\n"
+            "usr/bin/b\tutils/b\n"
+            "usr/share/doc/b/copyright\ta,utils/b\n"s
+        );
+    });
+
+    suite.add("added_files_are_merged_into_existing_index", [](){
+        aptian::contents_index index;
+        index.add("c"sv, std::vector<std::string>{"usr/bin/c"s, "usr/share/with space"s, "usr/zzz"s});
+
+        auto existing =
+            "usr/bin/a    a\n"
+            "usr/bin/d\td\n"
+            "usr/share/with space\tutils/b\n"sv;
+
+        string_sink out;
+        index.write(existing, out);
+
+        tst::check_eq(
+            out.data,
+            "usr/bin/a\ta\n"
+            "usr/bin/c\tc\n"
+            "usr/bin/d\td\n"
+            "usr/share/with space\tc,utils/b\n"
+            "usr/zzz\tc\n"s
+        );
+    });
+
+    suite.add("qualified_name_includes_section", [](){
+        aptian::package with_section("Package: hello\nVersion: 1.0\nArchitecture: amd64\nSection: utils\nDescription: test"sv);
+        tst::check_eq(aptian::get_qualified_name(with_section), "utils/hello"s);
+
+        aptian::package without_section("Package: hello\nVersion: 1.0\nArchitecture: amd64"sv);
+        tst::check_eq(aptian::get_qualified_name(without_section), "hello"s);
+    });
+
+    suite.add("package_files_cache_is_valid_only_for_same_package_file", [](){
+        auto dir = make_test_dir("contents_package_files");
+        auto path = dir + "pool/main/h/hello/hello_1.0_amd64.deb";
+
+        std::vector<std::string> files = {"usr/bin/hello"s, "usr/share/doc/hello/copyright"s};
+        aptian::save_package_files(path, "sha256_1"sv, files);
+
+        auto loaded = aptian::load_package_files(path, "sha256_1"sv);
+        tst::check(loaded.has_value(), SL);
+        tst::check(loaded.value() == files, SL);
+
+        tst::check(!aptian::load_package_files(path, "sha256_2"sv).has_value(), SL);
+        tst::check(!aptian::load_package_files(dir + "nonexistent"s, "sha256_1"sv).has_value(), SL);
+    });
+});
+}
@@ -0,0 +1,250 @@
+#include <tst/set.hpp>
+#include <tst/check.hpp>
+
+#include <fsif/span_file.hpp>
+
+#include <aptian/deb.hpp>
+
+using namespace std::string_literals;
+using namespace std::string_view_literals;
+
+namespace{
+void append(std::vector<uint8_t>& buf, std::string_view str){
+    buf.insert(buf.end(), str.begin(), str.end());
+}
+
+// make header field of given size, padded with the given character
+std::string field(std::string_view value, size_t size, char pad){
+    std::string ret(value);
+    ret.resize(size, pad);
+    return ret;
+}
+
+std::vector<uint8_t> make_tar_entry(std::string_view file_name, std::string_view contents, char type){
+    std::vector<uint8_t> tar;
+
+    std::stringstream size;
+    size << std::oct << contents.size();
+
+    std::string header;
+    header += field(file_name, 100, '\0');
+    header += field("0000644", 8, '\0'); // mode
+    header += field("0000000", 8, '\0'); // uid
+    header += field("0000000", 8, '\0'); // gid
+    header += field(field(size.str(), 11, ' '), 12, '\0'); // size
+    header += field("00000000000", 12, '\0'); // mtime
+    header += field("", 8, ' '); // checksum, not verified by aptian
+    header += type;
+    header += field("", 512 - header.size(), '\0');
+
+    append(tar, header);
+    append(tar, contents);
+    tar.resize(tar.size() + (512 - contents.size() % 512) % 512);
+
+    return tar;
+}
+
+// overwrite bytes of the tar entry header
+void set_header_bytes(std::vector<uint8_t>& entry, size_t offset, std::string_view bytes){
+    std::copy(bytes.begin(), bytes.end(), std::next(entry.begin(), ptrdiff_t(offset)));
+}
+
+std::vector<uint8_t> make_tar(std::string_view file_name, std::string_view contents){
+    auto tar = make_tar_entry(file_name, contents, '0');
+
+    // end of archive
+    tar.resize(tar.size() + 1024);
+
+    return tar;
+}
+
+void append_ar_member(std::vector<uint8_t>& ar, std::string_view name, const std::vector<uint8_t>& data){
+    append(ar, field(name, 16, ' '));
+    append(ar, field("0", 12, ' ')); // mtime
+    append(ar, field("0", 6, ' ')); // uid
+    append(ar, field("0", 6, ' ')); // gid
+    append(ar, field("100644", 8, ' ')); // mode
+    append(ar, field(std::to_string(data.size()), 10, ' '));
+    append(ar, "`\n"sv);
+    ar.insert(ar.end(), data.begin(), data.end());
+    if(data.size() % 2 != 0){
+        ar.push_back('\n');
+    }
+}
+
+const auto control =
+    "Package: hello" "\n"
+    "Version: 1.0.0" "\n"
+    "Architecture: amd64" "\n"
+    "Description: test package" "\n"sv;
+}
+
+namespace{
+const tst::set set("deb", [](tst::suite& suite){ // NOLINT
+    suite.add("read_deb_with_uncompressed_control_tar", [](){
+        std::vector<uint8_t> deb;
+        append(deb, "!<arch>\n"sv);
+        append_ar_member(deb, "debian-binary", {'2', '.', '0', '\n'});
+        append_ar_member(deb, "control.tar", make_tar("./control", control));
+        append_ar_member(deb, "data.tar", make_tar("./usr/bin/hello", "some binary data"));
+
+        fsif::span_file fi(deb);
+
+        auto info = aptian::read_deb(fi);
+
+        tst::check_eq(info.control, std::string(control));
+        tst::check_eq(info.size, uint64_t(deb.size()));
+
+        aptian::hasher h;
+        h.update(deb);
+        tst::check_eq(info.hashes.sha256, h.finish().sha256);
+    });
+
+    suite.add("read_deb_lists_data_tar_files", [](){
+        auto long_name = "usr/share/doc/hello/"s + std::string(120, 'x');
+
+        std::vector<uint8_t> data_tar;
+        for(const auto& e : {
+            make_tar_entry("./", "", '5'),
+            make_tar_entry("./usr/bin/", "", '5'),
+            make_tar_entry("./usr/bin/hello", "some binary data", '0'),
+            make_tar_entry("././@LongLink", long_name + '\0', 'L'),
+            make_tar_entry("./usr/share/doc/hello/xxx", "", '0'),
+            make_tar_entry("./usr/bin/hi", "", '2')
+        }){
+            data_tar.insert(data_tar.end(), e.begin(), e.end());
+        }
+        data_tar.resize(data_tar.size() + 1024);
+
+        std::vector<uint8_t> deb;
+        append(deb, "!<arch>\n"sv);
+        append_ar_member(deb, "debian-binary", {'2', '.', '0', '\n'});
+        append_ar_member(deb, "control.tar", make_tar("./control", control));
+        append_ar_member(deb, "data.tar", data_tar);
+
+        fsif::span_file fi(deb);
+
+        auto info = aptian::read_deb(fi, true);
+
+        tst::check_eq(info.control, std::string(control));
+        tst::check_eq(info.files.size(), size_t(3), SL);
+        tst::check_eq(info.files[0], "usr/bin/hello"s);
+        tst::check_eq(info.files[1], long_name);
+        tst::check_eq(info.files[2], "usr/bin/hi"s);
+    });
+
+    suite.add("read_deb_lists_files_of_ustar_and_old_gnu_tar_entries", [](){
+        auto ustar_entry = make_tar_entry("hello", "", '0');
+        set_header_bytes(ustar_entry, 257, "ustar\0" "00"sv);
+        set_header_bytes(ustar_entry, 345, "./usr/share/doc"sv);
+
+        // old GNU tar stores access and change times where ustar has the name prefix
+        auto gnu_entry = make_tar_entry("./usr/bin/hello", "", '0');
+        set_header_bytes(gnu_entry, 257, "ustar  \0"sv);
+        set_header_bytes(gnu_entry, 345, "14712345670\0" "14712345670\0"sv);
+
+        std::vector<uint8_t> data_tar;
+        data_tar.insert(data_tar.end(), ustar_entry.begin(), ustar_entry.end());
+        data_tar.insert(data_tar.end(), gnu_entry.begin(), gnu_entry.end());
+        data_tar.resize(data_tar.size() + 1024);
+
+        std::vector<uint8_t> deb;
+        append(deb, "!<arch>\n"sv);
+        append_ar_member(deb, "debian-binary", {'2', '.', '0', '\n'});
+        append_ar_member(deb, "control.tar", make_tar("./control", control));
+        append_ar_member(deb, "data.tar", data_tar);
+
+        fsif::span_file fi(deb);
+
+        auto info = aptian::read_deb(fi, true);
+
+        tst::check(info.files_listed, SL);
+        tst::check_eq(info.files.size(), size_t(2), SL);
+        tst::check_eq(info.files[0], "usr/share/doc/hello"s);
+        tst::check_eq(info.files[1], "usr/bin/hello"s);
+    });
+
+    suite.add("read_deb_lists_files_of_tar_entries_with_base256_size", [](){
+        auto contents = "some binary data"sv;
+
+        auto big_entry = make_tar_entry("./usr/bin/big", contents, '0');
+        std::string size(12, '\0');
+        size.front() = char(0x80);
+        size.back() = char(contents.size());
+        set_header_bytes(big_entry, 124, size);
+
+        std::vector<uint8_t> data_tar;
+        for(const auto& e : {
+            big_entry,
+            make_tar_entry("./usr/bin/small", contents, '0')
+        }){
+            data_tar.insert(data_tar.end(), e.begin(), e.end());
+        }
+        data_tar.resize(data_tar.size() + 1024);
+
+        std::vector<uint8_t> deb;
+        append(deb, "!<arch>\n"sv);
+        append_ar_member(deb, "debian-binary", {'2', '.', '0', '\n'});
+        append_ar_member(deb, "control.tar", make_tar("./control", control));
+        append_ar_member(deb, "data.tar", data_tar);
+
+        fsif::span_file fi(deb);
+
+        auto info = aptian::read_deb(fi, true);
+
+        tst::check_eq(info.files.size(), size_t(2), SL);
+        tst::check_eq(info.files[0], "usr/bin/big"s);
+        tst::check_eq(info.files[1], "usr/bin/small"s);
+    });
+
+    suite.add("read_deb_does_not_list_files_of_unsupported_data_tar_compression", [](){
+        std::vector<uint8_t> deb;
+        append(deb, "!<arch>\n"sv);
+        append_ar_member(deb, "debian-binary", {'2', '.', '0', '\n'});
+        append_ar_member(deb, "control.tar", make_tar("./control", control));
+        append_ar_member(deb, "data.tar.bz2", {'B', 'Z', 'h', '9'});
+
+        fsif::span_file fi(deb);
+
+        auto info = aptian::read_deb(fi, true);
+
+        tst::check_eq(info.control, std::string(control));
+        tst::check(!info.files_listed, SL);
+        tst::check(info.files.empty(), SL);
+
+        aptian::hasher h;
+        h.update(deb);
+        tst::check_eq(info.hashes.sha256, h.finish().sha256);
+    });
+
+    suite.add("read_deb_throws_on_non_ar_file", [](){
+        auto data = "Package: hello\n"sv;
+        fsif::span_file fi(utki::to_uint8_t(utki::make_span(data)));
+
+        bool thrown = false;
+        try{
+            aptian::read_deb(fi);
+        }catch(std::invalid_argument&){
+            thrown = true;
+        }
+        tst::check(thrown, SL);
+    });
+
+    suite.add("read_deb_throws_if_no_control_tar", [](){
+        std::vector<uint8_t> deb;
+        append(deb, "!<arch>\n"sv);
+        append_ar_member(deb, "debian-binary", {'2', '.', '0', '\n'});
+        append_ar_member(deb, "data.tar", make_tar("./usr/bin/hello", "some binary data"));
+
+        fsif::span_file fi(deb);
+
+        bool thrown = false;
+        try{
+            aptian::read_deb(fi);
+        }catch(std::invalid_argument&){
+            thrown = true;
+        }
+        tst::check(thrown, SL);
+    });
+});
+}
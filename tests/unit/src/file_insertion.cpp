@@ -0,0 +1,142 @@
+#include <tst/set.hpp>
+#include <tst/check.hpp>
+
+#include <fsif/native_file.hpp>
+
+#include <sys/stat.h>
+
+#include <aptian/file_insertion.hpp>
+
+#include "util.hpp"
+
+using namespace std::string_literals;
+using namespace std::string_view_literals;
+
+namespace{
+ino_t get_inode(const std::string& path){
+    struct stat st{};
+    if(stat(path.c_str(), &st) != 0){
+        throw std::runtime_error("stat() failed");
+    }
+    return st.st_ino;
+}
+}
+
+namespace{
+const tst::set set("file_insertion", [](tst::suite& suite){ // NOLINT
+    suite.add("insertion_method_names", [](){
+        for(size_t i = 0; i != size_t(aptian::insertion_method::enum_size); ++i){
+            auto m = aptian::insertion_method(i);
+            tst::check(aptian::to_insertion_method(aptian::to_string(m)) == m, SL);
+        }
+
+        bool thrown = false;
+        try{
+            aptian::to_insertion_method("symlink"sv);
+        }catch(std::invalid_argument&){
+            thrown = true;
+        }
+        tst::check(thrown, SL);
+    });
+
+    suite.add("copy_creates_independent_file", [](){
+        auto dir = make_test_dir("file_insertion_copy");
+
+        // bigger than one copy buffer
+        std::string data;
+        for(size_t i = 0; i != 100000; ++i){
+            data.append("0123456789");
+        }
+        write_file(dir + "src", data);
+
+        aptian::insert_file(dir + "src", dir + "dst", aptian::insertion_method::copy);
+
+        tst::check(read_file(dir + "dst") == data, SL);
+        tst::check(get_inode(dir + "src") != get_inode(dir + "dst"), SL);
+        tst::check(!fsif::native_file(dir + "dst.new").exists(), SL);
+    });
+
+    suite.add("copy_empty_file", [](){
+        auto dir = make_test_dir("file_insertion_copy_empty");
+
+        write_file(dir + "src", ""sv);
+
+        aptian::insert_file(dir + "src", dir + "dst", aptian::insertion_method::copy);
+
+        tst::check_eq(read_file(dir + "dst"), ""s);
+    });
+
+    suite.add("copy_of_nonexistent_file_throws", [](){
+        auto dir = make_test_dir("file_insertion_copy_nonexistent");
+
+        bool thrown = false;
+        try{
+            aptian::insert_file(dir + "src", dir + "dst", aptian::insertion_method::copy);
+        }catch(std::system_error&){
+            thrown = true;
+        }
+        tst::check(thrown, SL);
+        tst::check(!fsif::native_file(dir + "dst").exists(), SL);
+        tst::check(!fsif::native_file(dir + "dst.new").exists(), SL);
+    });
+
+    suite.add("hardlink_shares_inode", [](){
+        auto dir = make_test_dir("file_insertion_hardlink");
+
+        write_file(dir + "src", "hello"sv);
+
+        aptian::insert_file(dir + "src", dir + "dst", aptian::insertion_method::hardlink);
+
+        tst::check_eq(read_file(dir + "dst"), "hello"s);
+        tst::check(get_inode(dir + "src") == get_inode(dir + "dst"), SL);
+    });
+
+    suite.add("move_removes_source", [](){
+        auto dir = make_test_dir("file_insertion_move");
+
+        write_file(dir + "src", "hello"sv);
+        auto inode = get_inode(dir + "src");
+
+        aptian::insert_file(dir + "src", dir + "dst", aptian::insertion_method::move);
+
+        tst::check_eq(read_file(dir + "dst"), "hello"s);
+        tst::check(get_inode(dir + "dst") == inode, SL);
+        tst::check(!fsif::native_file(dir + "src").exists(), SL);
+    });
+
+    suite.add("move_does_not_overwrite_existing_destination", [](){
+        auto dir = make_test_dir("file_insertion_move_existing");
+
+        write_file(dir + "src", "hello"sv);
+        write_file(dir + "dst", "world"sv);
+
+        bool thrown = false;
+        try{
+            aptian::insert_file(dir + "src", dir + "dst", aptian::insertion_method::move);
+        }catch(std::system_error&){
+            thrown = true;
+        }
+        tst::check(thrown, SL);
+        tst::check_eq(read_file(dir + "dst"), "world"s);
+        tst::check_eq(read_file(dir + "src"), "hello"s);
+    });
+
+    suite.add("copy_does_not_overwrite_existing_destination", [](){
+        auto dir = make_test_dir("file_insertion_copy_existing");
+
+        write_file(dir + "src", "hello"sv);
+        write_file(dir + "dst", "world"sv);
+
+        bool thrown = false;
+        try{
+            aptian::insert_file(dir + "src", dir + "dst", aptian::insertion_method::copy);
+        }catch(std::system_error&){
+            thrown = true;
+        }
+        tst::check(thrown, SL);
+        tst::check_eq(read_file(dir + "dst"), "world"s);
+        tst::check_eq(read_file(dir + "src"), "hello"s);
+        tst::check(!fsif::native_file(dir + "dst.new").exists(), SL);
+    });
+});
+}
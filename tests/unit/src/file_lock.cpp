@@ -0,0 +1,56 @@
+#include <filesystem>
+
+#include <tst/set.hpp>
+#include <tst/check.hpp>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#include <aptian/file_lock.hpp>
+
+#include "util.hpp"
+
+using namespace std::string_literals;
+using namespace std::string_view_literals;
+
+namespace{
+// try to lock the file through another open file description, without blocking
+bool can_lock(const std::string& path, int operation){
+    int fd = open(path.c_str(), O_RDWR | O_CLOEXEC); // NOLINT
+    tst::check(fd >= 0, SL);
+    bool ret = flock(fd, operation | LOCK_NB) == 0;
+    close(fd);
+    return ret;
+}
+}
+
+namespace{
+const tst::set set("file_lock", [](tst::suite& suite){ // NOLINT
+    suite.add("exclusive_lock_excludes_other_locks_until_released", [](){
+        auto dir = make_test_dir("file_lock_exclusive");
+        auto path = dir + "subdir/test.lock";
+
+        {
+            aptian::file_lock lock(path);
+
+            tst::check(std::filesystem::exists(path), SL);
+            tst::check(!can_lock(path, LOCK_SH), SL);
+            tst::check(!can_lock(path, LOCK_EX), SL);
+        }
+
+        tst::check(can_lock(path, LOCK_EX), SL);
+    });
+
+    suite.add("shared_lock_excludes_only_exclusive_lock", [](){
+        auto dir = make_test_dir("file_lock_shared");
+        auto path = dir + "test.lock";
+
+        aptian::file_lock lock1(path, aptian::file_lock::mode::shared);
+        aptian::file_lock lock2(path, aptian::file_lock::mode::shared);
+
+        tst::check(can_lock(path, LOCK_SH), SL);
+        tst::check(!can_lock(path, LOCK_EX), SL);
+    });
+});
+}
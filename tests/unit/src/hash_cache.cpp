@@ -0,0 +1,140 @@
+#include <tst/set.hpp>
+#include <tst/check.hpp>
+
+#include <fsif/native_file.hpp>
+#include <tml/tree.hpp>
+#include <utki/string.hpp>
+
+#include <aptian/hash_cache.hpp>
+
+#include "util.hpp"
+
+using namespace std::string_literals;
+using namespace std::string_view_literals;
+
+namespace{
+const tst::set set("hash_cache", [](tst::suite& suite){ // NOLINT
+    suite.add("hash_sums_are_calculated_for_uncached_file", [](){
+        auto dir = make_test_dir("hash_cache_uncached");
+        write_file(dir + "file", "abc"sv);
+
+        aptian::hash_cache cache(dir + "cache", dir);
+        const auto& info = cache.get("file"sv);
+
+        tst::check_eq(info.stat.size, uint64_t(3));
+        tst::check_eq(info.hashes.sha256, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"s);
+    });
+
+    suite.add("cached_hash_sums_are_used_for_unchanged_file", [](){
+        auto dir = make_test_dir("hash_cache_unchanged");
+        write_file(dir + "file", "abc"sv);
+
+        auto stat = aptian::get_file_stat(dir + "file");
+        tst::check(stat.has_value(), SL);
+
+        // prepare cache file with fake hash sums to make sure those are not recalculated
+        tml::write(
+            tml::forest{tml::tree("file"s, {
+                tml::tree("size"s, {tml::tree(utki::cat(stat.value().size))}),
+                tml::tree("mtime"s, {tml::tree(utki::cat(stat.value().mtime_ns))}),
+                tml::tree("inode"s, {tml::tree(utki::cat(stat.value().inode))}),
+                tml::tree("md5"s, {tml::tree("fake_md5"sv)}),
+                tml::tree("sha1"s, {tml::tree("fake_sha1"sv)}),
+                tml::tree("sha256"s, {tml::tree("fake_sha256"sv)}),
+                tml::tree("sha512"s, {tml::tree("fake_sha512"sv)})
+            })},
+            fsif::native_file(dir + "cache")
+        );
+
+        aptian::hash_cache cache(dir + "cache", dir);
+        const auto& info = cache.get("file"sv);
+
+        tst::check_eq(info.hashes.md5, "fake_md5"s);
+        tst::check_eq(info.hashes.sha1, "fake_sha1"s);
+        tst::check_eq(info.hashes.sha256, "fake_sha256"s);
+        tst::check_eq(info.hashes.sha512, "fake_sha512"s);
+    });
+
+    suite.add("hash_sums_are_recalculated_for_changed_file", [](){
+        auto dir = make_test_dir("hash_cache_changed");
+        write_file(dir + "file", "abc"sv);
+
+        {
+            aptian::hash_cache cache(dir + "cache", dir);
+            cache.get("file"sv);
+            cache.save();
+        }
+
+        write_file(dir + "file", "abcd"sv);
+
+        aptian::hash_cache cache(dir + "cache", dir);
+        const auto& info = cache.get("file"sv);
+
+        tst::check_eq(info.stat.size, uint64_t(4));
+        tst::check_eq(info.hashes.sha256, "88d4266fd4e6338d13b845fcf289579d209c897823b9217da3e161936f031589"s);
+    });
+
+    suite.add("put_hash_sums_are_returned_by_get", [](){
+        auto dir = make_test_dir("hash_cache_put");
+        write_file(dir + "file", "abc"sv);
+
+        aptian::hash_cache cache(dir + "cache", dir);
+        cache.put("file"sv, {.md5 = "a", .sha1 = "b", .sha256 = "c", .sha512 = "d"}, "state"s);
+
+        const auto& info = cache.get("file"sv);
+
+        tst::check_eq(info.stat.size, uint64_t(3));
+        tst::check_eq(info.hashes.md5, "a"s);
+        tst::check_eq(info.hashes.sha512, "d"s);
+        tst::check_eq(info.hasher_state, "state"s);
+    });
+
+    suite.add("get_if_cached_does_not_calculate_hash_sums", [](){
+        auto dir = make_test_dir("hash_cache_get_if_cached");
+        write_file(dir + "file", "abc"sv);
+
+        aptian::hash_cache cache(dir + "cache", dir);
+        tst::check(cache.get_if_cached("file"sv) == nullptr, SL);
+
+        cache.get("file"sv);
+        tst::check(cache.get_if_cached("file"sv) != nullptr, SL);
+
+        write_file(dir + "file", "abcd"sv);
+        tst::check(cache.get_if_cached("file"sv) == nullptr, SL);
+    });
+
+    suite.add("corrupted_cache_file_is_ignored", [](){
+        auto dir = make_test_dir("hash_cache_corrupted");
+        write_file(dir + "file", "abc"sv);
+        write_file(dir + "cache", "file{size{"sv);
+
+        aptian::hash_cache cache(dir + "cache", dir);
+        const auto& info = cache.get("file"sv);
+
+        tst::check_eq(info.hashes.sha256, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"s);
+    });
+
+    suite.add("save_drops_unused_entries", [](){
+        auto dir = make_test_dir("hash_cache_unused");
+        write_file(dir + "file1", "abc"sv);
+        write_file(dir + "file2", "abcd"sv);
+
+        {
+            aptian::hash_cache cache(dir + "cache", dir);
+            cache.get("file1"sv);
+            cache.get("file2"sv);
+            cache.save();
+        }
+
+        {
+            aptian::hash_cache cache(dir + "cache", dir);
+            cache.get("file2"sv);
+            cache.save();
+        }
+
+        auto forest = tml::read(fsif::native_file(dir + "cache"));
+        tst::check_eq(forest.size(), size_t(1));
+        tst::check_eq(forest.front().value.string, "file2"s);
+    });
+});
+}
@@ -0,0 +1,130 @@
+#include <tst/set.hpp>
+#include <tst/check.hpp>
+
+#include <fsif/span_file.hpp>
+
+#include <aptian/hasher.hpp>
+
+using namespace std::string_literals;
+using namespace std::string_view_literals;
+
+namespace{
+const tst::set set("hasher", [](tst::suite& suite){ // NOLINT
+    suite.add("empty_data", [](){
+        aptian::hasher h;
+        auto hashes = h.finish();
+
+        tst::check_eq(hashes.md5, "d41d8cd98f00b204e9800998ecf8427e"s);
+        tst::check_eq(hashes.sha1, "da39a3ee5e6b4b0d3255bfef95601890afd80709"s);
+        tst::check_eq(hashes.sha256, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"s);
+        tst::check_eq(hashes.sha512, "cf83e1357eefb8bdf1542850d66d8007d620e4050b5715dc83f4a921d36ce9ce47d0d13c5d85f2b0ff8318d2877eec2f63b931bd47417a81a538327af927da3e"s);
+    });
+
+    suite.add("abc", [](){
+        aptian::hasher h;
+        h.update(utki::to_uint8_t(utki::make_span("abc"sv)));
+        auto hashes = h.finish();
+
+        tst::check_eq(hashes.md5, "900150983cd24fb0d6963f7d28e17f72"s);
+        tst::check_eq(hashes.sha1, "a9993e364706816aba3e25717850c26c9cd0d89d"s);
+        tst::check_eq(hashes.sha256, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"s);
+        tst::check_eq(hashes.sha512, "ddaf35a193617abacc417349ae20413112e6fa4e89a97ea20a9eeee64b55d39a2192992a274fc1a836ba3c23a3feebbd454d4423643ce80e2a9ac94fa54ca49f"s);
+    });
+
+    // the data is fed in chunks which do not align with digest block boundaries
+    suite.add("chunked_data_gives_same_hashes_as_whole_data", [](){
+        std::vector<uint8_t> data(1000);
+        for(size_t i = 0; i != data.size(); ++i){
+            data[i] = uint8_t(i * 7 + 3);
+        }
+
+        aptian::hasher whole;
+        whole.update(data);
+        auto expected = whole.finish();
+
+        aptian::hasher chunked;
+        auto span = utki::make_span(data);
+        for(size_t chunk_size = 1; !span.empty(); chunk_size += 13){
+            auto n = std::min(chunk_size, span.size());
+            chunked.update(span.subspan(0, n));
+            span = span.subspan(n);
+        }
+
+        tst::check_eq(chunked.get_size(), uint64_t(data.size()));
+
+        auto hashes = chunked.finish();
+        tst::check_eq(hashes.md5, expected.md5);
+        tst::check_eq(hashes.sha1, expected.sha1);
+        tst::check_eq(hashes.sha256, expected.sha256);
+        tst::check_eq(hashes.sha512, expected.sha512);
+    });
+
+    // check that CPU specific kernels supported by the CPU running the test give same results as generic ones
+    suite.add("all_sha256_kernels_give_same_digest", [](){
+        std::vector<uint8_t> data(1000);
+        for(size_t i = 0; i != data.size(); ++i){
+            data[i] = uint8_t(i * 13 + 1);
+        }
+
+        aptian::sha256 generic(aptian::sha256::get_kernels().back());
+        generic.update(data);
+        auto expected = generic.finish();
+
+        for(const auto& k : aptian::sha256::get_kernels()){
+            aptian::sha256 d(k);
+            d.update(data);
+            tst::check(d.finish() == expected, SL) << "kernel: " << k.name;
+        }
+    });
+
+    suite.add("continuation_from_saved_state_gives_same_hashes_as_whole_data", [](){
+        std::vector<uint8_t> data(1000);
+        for(size_t i = 0; i != data.size(); ++i){
+            data[i] = uint8_t(i * 7 + 3);
+        }
+
+        aptian::hasher whole;
+        whole.update(data);
+        auto expected = whole.finish();
+
+        for(size_t split : {0, 1, 63, 64, 65, 127, 128, 129, 999, 1000}){
+            aptian::hasher first;
+            first.update(utki::make_span(data).subspan(0, split));
+            auto state = first.save_state();
+
+            aptian::hasher second;
+            second.load_state(state);
+            tst::check_eq(second.get_size(), uint64_t(split));
+            second.update(utki::make_span(data).subspan(split));
+
+            tst::check(second.finish() == expected, SL) << "split = " << split;
+        }
+    });
+
+    suite.add("load_state_throws_on_malformed_state", [](){
+        for(auto state : {""sv, "abc"sv, "00:00:00:00"sv, "zz"sv}){
+            aptian::hasher h;
+            bool thrown = false;
+            try{
+                h.load_state(state);
+            }catch(std::invalid_argument&){
+                thrown = true;
+            }
+            tst::check(thrown, SL) << "state = " << state;
+        }
+    });
+
+    suite.add("get_file_hashes", [](){
+        auto data = "The quick brown fox jumps over the lazy dog"sv;
+
+        fsif::span_file fi(utki::to_uint8_t(utki::make_span(data)));
+
+        auto hashes = aptian::get_file_hashes(fi);
+
+        tst::check_eq(hashes.md5, "9e107d9d372bb6826bd81d3542a419d6"s);
+        tst::check_eq(hashes.sha1, "2fd4e1c67a2d28fced849ee1bb76e7391b93eb12"s);
+        tst::check_eq(hashes.sha256, "d7a8fbb307d7809469ca9abcb0082e4f8d5651e46d3cdb762d02d0bf37c9e592"s);
+        tst::check_eq(hashes.sha512, "07e547d9586f6a73f73fbac0435ed76951218fb7d0c8d788a309d785436bbb642e93a252a954f23912547d1e8a3b5ed6e1bfd7097821233fa0538f3db854fee6"s);
+    });
+});
+}
@@ -1,13 +1,34 @@
 #include <tst/set.hpp>
 #include <tst/check.hpp>
 
+#include <filesystem>
+#include <optional>
+
+#include <fsif/native_file.hpp>
 #include <fsif/span_file.hpp>
 
 #include <aptian/packages.hpp>
 
+#include "util.hpp"
+
 using namespace std::string_literals;
 using namespace std::string_view_literals;
 
+namespace{
+class string_sink : public aptian::sink{
+public:
+    std::string data;
+    size_t num_writes = 0;
+
+    void write(utki::span<const uint8_t> d)override{
+        this->data.append(utki::make_string_view(d));
+        ++this->num_writes;
+    }
+
+    void finish()override{}
+};
+}
+
 namespace{
 const tst::set set("packages", [](tst::suite& suite){ // NOLINT
     suite.add("parse_2_packages", [](){
@@ -103,11 +124,12 @@ const tst::set set("packages", [](tst::suite& suite){ // NOLINT
         tst::check_eq(p1.fields.source, p2.fields.source);
         tst::check_eq(p1.fields.filename, p2.fields.filename);
 
-        tst::check_ne(p1.fields.package.data(), p2.fields.package.data());
-        tst::check_ne(p1.fields.version.data(), p2.fields.version.data());
-        tst::check_ne(p1.fields.architecture.data(), p2.fields.architecture.data());
-        tst::check_ne(p1.fields.source.data(), p2.fields.source.data());
-        tst::check_ne(p1.fields.filename.data(), p2.fields.filename.data());
+        // copy shares the control data with the original
+        tst::check_eq(p1.fields.package.data(), p2.fields.package.data());
+        tst::check_eq(p1.fields.version.data(), p2.fields.version.data());
+        tst::check_eq(p1.fields.architecture.data(), p2.fields.architecture.data());
+        tst::check_eq(p1.fields.source.data(), p2.fields.source.data());
+        tst::check_eq(p1.fields.filename.data(), p2.fields.filename.data());
 
         tst::check_eq(p1.fields.package, "libantigrain0-dbg"sv);
         tst::check_eq(p1.fields.version, "2.8.7"sv);
@@ -148,5 +170,159 @@ const tst::set set("packages", [](tst::suite& suite){ // NOLINT
         tst::check_eq(p2.fields.source, "libantigrain"sv);
         tst::check_eq(p2.fields.filename, "pool/focal/main/liba/libantigrain/libantigrain0-dbg_2.8.7_amd64.deb"sv);
     });
+
+    suite.add("parse_packages_with_crlf_and_extra_empty_lines", [](){
+        auto data =
+            "\n"
+            "\r\n"
+            "Package: a\r\n"
+            "Version: 1.0\r\n"
+            "Architecture: amd64\r\n"
+            "\r\n"
+            "\n"
+            "\n"
+            "Package: b\n"
+            "Version: 2.0\n"
+            "Architecture: all"sv;
+
+        fsif::span_file fi(data);
+        auto packages = aptian::read_packages_file(fi);
+
+        tst::check_eq(packages.size(), size_t(2));
+
+        tst::check_eq(packages[0].fields.package, "a"sv);
+        tst::check_eq(packages[0].fields.version, "1.0"sv);
+        tst::check_eq(packages[0].fields.architecture, "amd64"sv);
+        tst::check_eq(packages[0].to_string(), "Package: a\nVersion: 1.0\nArchitecture: amd64\n"s);
+
+        tst::check_eq(packages[1].fields.package, "b"sv);
+        tst::check_eq(packages[1].fields.version, "2.0"sv);
+        tst::check_eq(packages[1].fields.architecture, "all"sv);
+    });
+
+    suite.add("read_packages_file_from_native_file", [](){
+        auto dir = make_test_dir("read_packages_file");
+        auto path = dir + "Packages";
+
+        write_file(
+            path,
+            "Package: a\n"
+            "Version: 1.0\n"
+            "Architecture: amd64\n"
+            "\n"
+            "Package: b\n"
+            "Version: 2.0\n"
+            "Architecture: all\n"
+            "\n"sv
+        );
+
+        auto packages = aptian::read_packages_file(fsif::native_file(path));
+
+        // the packages keep the file contents alive after the file is removed
+        std::filesystem::remove(path);
+
+        tst::check_eq(packages.size(), size_t(2));
+        tst::check_eq(packages[0].fields.package, "a"sv);
+        tst::check_eq(packages[1].fields.package, "b"sv);
+        tst::check_eq(packages[1].fields.architecture, "all"sv);
+    });
+
+    suite.add("read_empty_packages_file", [](){
+        auto dir = make_test_dir("read_empty_packages_file");
+        auto path = dir + "empty_Packages";
+
+        write_file(path, ""sv);
+
+        auto packages = aptian::read_packages_file(fsif::native_file(path));
+        tst::check(packages.empty(), SL);
+    });
+
+    suite.add("package_copy_outlives_original", [](){
+        std::optional<aptian::package> p1;
+        p1.emplace(
+            "Package: libantigrain0-dbg" "\n"
+            "Version: 2.8.7" "\n"
+            "Architecture: amd64"sv
+        );
+
+        aptian::package p2(p1.value());
+        p1.reset();
+
+        tst::check_eq(p2.fields.package, "libantigrain0-dbg"sv);
+        tst::check_eq(p2.fields.version, "2.8.7"sv);
+        tst::check_eq(p2.to_string(), "Package: libantigrain0-dbg\nVersion: 2.8.7\nArchitecture: amd64\n"s);
+    });
+
+    suite.add("package_append", [](){
+        aptian::package p(
+            "Package: a" "\n"
+            "Version: 1.0" "\n"
+            "Architecture: amd64" "\n"sv
+        );
+
+        p.append("pool/a.deb"sv, 123, {.md5 = "m", .sha1 = "s1", .sha256 = "s256", .sha512 = "s512"});
+
+        tst::check_eq(p.fields.package, "a"sv);
+        tst::check_eq(p.fields.filename, "pool/a.deb"sv);
+        tst::check_eq(
+            p.to_string(),
+            "Package: a\n"
+            "Version: 1.0\n"
+            "Architecture: amd64\n"
+            "Filename: pool/a.deb\n"
+            "Size: 123\n"
+            "MD5sum: m\n"
+            "SHA1: s1\n"
+            "SHA256: s256\n"
+            "SHA512: s512\n"s
+        );
+    });
+
+    suite.add("split_paragraphs", [](){
+        auto paragraphs = aptian::split_paragraphs("\n\nA: 1\nB: 2\n\n\n\nC: 3\r\n\r\nD: 4"sv);
+
+        tst::check_eq(paragraphs.size(), size_t(3));
+        tst::check_eq(paragraphs[0], "A: 1\nB: 2"sv);
+        tst::check_eq(paragraphs[1], "C: 3\r"sv);
+        tst::check_eq(paragraphs[2], "D: 4"sv);
+    });
+
+    suite.add("write_packages_gives_same_data_as_to_string", [](){
+        std::vector<aptian::package> packages;
+        for(size_t i = 0; i != 3000; ++i){
+            packages.emplace_back(
+                "Package: package-"s + std::to_string(i) + "\n"
+                "Version: 1.0\n"
+                "Architecture: amd64\n"
+                "Description: " + std::string(i % 100, 'd')
+            );
+        }
+
+        string_sink out;
+        aptian::write_packages(packages, out);
+
+        tst::check_eq(out.data, aptian::to_string(packages));
+
+        // the data is written in chunks, not per package
+        tst::check(out.num_writes < packages.size() / 10, SL) << "num_writes = " << out.num_writes;
+    });
+
+    suite.add("parse_pool_file_fields", [](){
+        auto fields = aptian::package::parse_pool_file_fields(
+            "Package: pkg\r\n"
+            "Version: 1.0\r\n"
+            "Filename: pool/main/p/pkg/pkg_1.0_amd64.deb\r\n"
+            "Size: 123\r\n"
+            "SHA256: abcd\r\n"
+            "SHA1: ef01"sv
+        );
+
+        tst::check_eq(fields.filename, "pool/main/p/pkg/pkg_1.0_amd64.deb"sv);
+        tst::check_eq(fields.size, "123"sv);
+        tst::check_eq(fields.sha256, "abcd"sv);
+        tst::check_eq(fields.sha1, "ef01"sv);
+        tst::check(fields.md5sum.empty(), SL);
+        tst::check(fields.sha512.empty(), SL);
+    });
 });
 }
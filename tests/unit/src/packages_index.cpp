@@ -0,0 +1,112 @@
+#include <tst/set.hpp>
+#include <tst/check.hpp>
+
+#include <aptian/packages_index.hpp>
+
+#include "util.hpp"
+
+using namespace std::string_literals;
+using namespace std::string_view_literals;
+
+namespace{
+const auto packages_data = "Package: b\nVersion: 1.0\nArchitecture: amd64\n\n"
+    "Package: a\nVersion: 2.0\nArchitecture: amd64\nDescription: a\n\n"
+    "Package: a\nVersion: 1.0\nArchitecture: amd64\n"sv;
+}
+
+namespace{
+const tst::set set("packages_index", [](tst::suite& suite){ // NOLINT
+    suite.add("index_paragraphs_gives_paragraph_locations", [](){
+        auto entries = aptian::index_paragraphs(packages_data, 10);
+
+        tst::check_eq(entries.size(), size_t(3));
+        tst::check_eq(entries[1].package, "a"sv);
+        tst::check_eq(entries[1].version, "2.0"sv);
+        tst::check_eq(entries[1].architecture, "amd64"sv);
+        tst::check_eq(
+            packages_data.substr(size_t(entries[1].offset - 10), size_t(entries[1].size)),
+            "Package: a\nVersion: 2.0\nArchitecture: amd64\nDescription: a"sv
+        );
+    });
+
+    suite.add("index_paragraphs_handles_crlf", [](){
+        auto data = "Package: a\r\nVersion: 1.0\r\nArchitecture: all\r\n\r\n"sv;
+        auto entries = aptian::index_paragraphs(data, 0);
+
+        tst::check_eq(entries.size(), size_t(1));
+        tst::check_eq(entries[0].package, "a"sv);
+        tst::check_eq(entries[0].version, "1.0"sv);
+        tst::check_eq(entries[0].architecture, "all"sv);
+    });
+
+    suite.add("written_index_is_sorted_and_searchable", [](){
+        auto dir = make_test_dir("packages_index_write");
+
+        aptian::file_stat stat{.size = 1, .mtime_ns = 2, .inode = 3};
+        aptian::packages_index::write(dir + "index", stat, aptian::index_paragraphs(packages_data, 0));
+
+        aptian::packages_index index(dir + "index");
+
+        tst::check(index.get_packages_stat() == stat, SL);
+        tst::check_eq(index.size(), size_t(3));
+        tst::check_eq(index[0].version, "1.0"sv);
+        tst::check_eq(index[1].version, "2.0"sv);
+        tst::check_eq(index[2].package, "b"sv);
+
+        auto found = index.find("a"sv, "2.0"sv, "amd64"sv);
+        tst::check(found.has_value(), SL);
+        tst::check_eq(
+            packages_data.substr(size_t(found.value().offset), size_t(found.value().size)),
+            "Package: a\nVersion: 2.0\nArchitecture: amd64\nDescription: a"sv
+        );
+
+        tst::check(!index.find("a"sv, "3.0"sv, "amd64"sv).has_value(), SL);
+        tst::check(!index.find("a"sv, "1.0"sv, "arm64"sv).has_value(), SL);
+        tst::check(!index.find("c"sv, "1.0"sv, "amd64"sv).has_value(), SL);
+    });
+
+    suite.add("load_or_build_rebuilds_index_when_packages_file_changes", [](){
+        auto dir = make_test_dir("packages_index_rebuild");
+        write_file(dir + "Packages", packages_data);
+
+        {
+            auto index = aptian::packages_index::load_or_build(dir + "index", dir + "Packages");
+            tst::check_eq(index.size(), size_t(3));
+        }
+
+        write_file(dir + "Packages", "Package: c\nVersion: 1.0\nArchitecture: all\n"sv);
+
+        auto index = aptian::packages_index::load_or_build(dir + "index", dir + "Packages");
+        tst::check_eq(index.size(), size_t(1));
+        tst::check(index.find("c"sv, "1.0"sv, "all"sv).has_value(), SL);
+    });
+
+    suite.add("load_or_build_rebuilds_malformed_index", [](){
+        auto dir = make_test_dir("packages_index_malformed");
+        write_file(dir + "Packages", packages_data);
+        write_file(dir + "index", "APTIDX01 garbage"sv);
+
+        auto index = aptian::packages_index::load_or_build(dir + "index", dir + "Packages");
+        tst::check_eq(index.size(), size_t(3));
+    });
+
+    suite.add("index_packages_gives_same_entries_as_index_paragraphs", [](){
+        std::vector<aptian::package> packages;
+        for(auto p : aptian::split_paragraphs(packages_data)){
+            packages.emplace_back(p);
+        }
+
+        auto data = aptian::to_string(packages);
+        auto expected = aptian::index_paragraphs(data, 5);
+        auto entries = aptian::index_packages(packages, 5);
+
+        tst::check_eq(entries.size(), expected.size());
+        for(size_t i = 0; i != entries.size(); ++i){
+            tst::check_eq(entries[i].package, expected[i].package);
+            tst::check_eq(entries[i].version, expected[i].version);
+            tst::check_eq(entries[i].offset, expected[i].offset);
+            tst::check_eq(entries[i].size, expected[i].size);
+        }
+    });
+});
+}
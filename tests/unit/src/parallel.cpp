@@ -0,0 +1,41 @@
+#include <tst/set.hpp>
+#include <tst/check.hpp>
+
+#include <aptian/parallel.hpp>
+
+namespace{
+const tst::set set("parallel", [](tst::suite& suite){ // NOLINT
+    suite.add("parallel_for_calls_function_for_each_index", [](){
+        constexpr size_t count = 1000;
+
+        for(unsigned num_jobs : {0, 1, 4}){
+            std::vector<size_t> results(count);
+
+            aptian::parallel_for(count, num_jobs, [&](size_t i){
+                results[i] = i * 2;
+            });
+
+            for(size_t i = 0; i != count; ++i){
+                tst::check_eq(results[i], i * 2);
+            }
+        }
+    });
+
+    suite.add("parallel_for_rethrows_exception_of_lowest_index", [](){
+        constexpr size_t count = 100;
+
+        std::string message;
+        try{
+            aptian::parallel_for(count, 4, [&](size_t i){
+                if(i % 10 == 3){
+                    throw std::runtime_error(std::to_string(i));
+                }
+            });
+        }catch(std::runtime_error& e){
+            message = e.what();
+        }
+
+        tst::check_eq(message, std::string("3"));
+    });
+});
+}
@@ -0,0 +1,103 @@
+#include <filesystem>
+
+#include <tst/set.hpp>
+#include <tst/check.hpp>
+
+#include <utki/string.hpp>
+
+#include <aptian/pdiff.hpp>
+
+#include "util.hpp"
+
+using namespace std::string_literals;
+using namespace std::string_view_literals;
+
+namespace{
+aptian::pdiff_history::version make_version(std::string_view name, uint64_t size, uint64_t num_lines){
+    return {
+        .name = std::string(name),
+        .sha256 = utki::cat("sha256_", name),
+        .size = size,
+        .num_lines = num_lines
+    };
+}
+}
+
+namespace{
+const tst::set set("pdiff", [](tst::suite& suite){ // NOLINT
+    suite.add("append_ed_script", [](){
+        auto script = aptian::make_append_ed_script(3, "Package: b\nVersion: 1\n\n"sv);
+        tst::check_eq(script, "3a\nPackage: b\nVersion: 1\n\n.\n"s);
+    });
+
+    suite.add("version_name_has_debian_archive_format", [](){
+        // 2024-05-01 12:34:56 UTC
+        auto time = std::chrono::system_clock::from_time_t(1714566896);
+        tst::check_eq(aptian::make_pdiff_version_name(time), "2024-05-01-1234.56"s);
+    });
+
+    suite.add("history_is_bounded_and_survives_reload", [](){
+        auto dir = make_test_dir("pdiff_history_bounded");
+
+        {
+            aptian::pdiff_history h(dir + "history");
+            h.restart(make_version("v1", 10, 2));
+            h.push(make_version("v2", 20, 4), 2);
+            h.push(make_version("v3", 30, 6), 2);
+            h.push(make_version("v4", 40, 8), 2);
+            h.save();
+        }
+
+        aptian::pdiff_history h(dir + "history");
+        auto versions = h.get_versions();
+        tst::check_eq(versions.size(), size_t(3), SL);
+        tst::check_eq(versions[0].name, "v2"s);
+        tst::check_eq(versions[2].name, "v4"s);
+        tst::check_eq(versions[2].sha256, "sha256_v4"s);
+        tst::check_eq(versions[2].size, uint64_t(40));
+        tst::check_eq(versions[2].num_lines, uint64_t(8));
+    });
+
+    suite.add("versions_with_same_name_get_unique_names", [](){
+        auto dir = make_test_dir("pdiff_history_same_name");
+
+        aptian::pdiff_history h(dir + "history");
+        h.restart(make_version("v", 10, 2));
+        h.push(make_version("v", 20, 4), 2);
+        h.push(make_version("v", 30, 6), 2);
+
+        auto versions = h.get_versions();
+        tst::check_eq(versions.size(), size_t(3), SL);
+        tst::check_eq(versions[1].name, "v-1"s);
+        tst::check_eq(versions[2].name, "v-2"s);
+    });
+
+    suite.add("patches_bring_previous_versions_to_current", [](){
+        auto dir = make_test_dir("pdiff_patches");
+
+        auto v1 = "Package: a\n\n"s;
+        auto v2 = v1 + "Package: b\n\n"s;
+        auto v3 = v2 + "Package: c\n\n"s;
+
+        aptian::pdiff_history h(dir + "history");
+        h.restart(make_version("v1", v1.size(), 2));
+        h.push(make_version("v2", v2.size(), 4), 2);
+        h.push(make_version("v3", v3.size(), 6), 2);
+
+        // stale patch is removed
+        std::filesystem::create_directories(dir + "Packages.diff");
+        write_file(dir + "Packages.diff/T-v2-F-v1.gz", "stale"sv);
+
+        auto index = aptian::write_pdiff_patches(dir + "Packages.diff/", h, v3);
+
+        tst::check(index.starts_with("X-Patch-Precedence: merged\nSHA256-Current: sha256_v3 "s + utki::cat(v3.size(), '\n')), SL) << index;
+        tst::check(index.find(utki::cat(" sha256_v1 ", v1.size(), " T-v3-F-v1\n")) != std::string::npos, SL) << index;
+        tst::check(index.find(utki::cat(" sha256_v2 ", v2.size(), " T-v3-F-v2\n")) != std::string::npos, SL) << index;
+        tst::check(index.find(" T-v3-F-v1.gz\n"s) != std::string::npos, SL) << index;
+
+        tst::check(std::filesystem::exists(dir + "Packages.diff/T-v3-F-v1.gz"), SL);
+        tst::check(std::filesystem::exists(dir + "Packages.diff/T-v3-F-v2.gz"), SL);
+        tst::check(!std::filesystem::exists(dir + "Packages.diff/T-v2-F-v1.gz"), SL);
+    });
+});
+}
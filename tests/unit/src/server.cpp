@@ -0,0 +1,71 @@
+#include <tst/set.hpp>
+#include <tst/check.hpp>
+
+#include <aptian/server.hpp>
+
+using namespace std::string_literals;
+using namespace std::string_view_literals;
+
+namespace{
+const tst::set set("server", [](tst::suite& suite){ // NOLINT
+    suite.add("add_request_encode_decode", [](){
+        aptian::add_request request{
+            .targets = {{.dist = "bookworm"s, .comp = "main"s}, {.dist = "noble"s, .comp = "contrib"s}},
+            .package_paths = {"/tmp/my package_1.0_amd64.deb"s, "/tmp/other_2.0_all.deb"s}
+        };
+
+        auto str = aptian::to_string(request);
+
+        tst::check_eq(
+            str,
+            "target bookworm main\n"
+            "target noble contrib\n"
+            "package /tmp/my package_1.0_amd64.deb\n"
+            "package /tmp/other_2.0_all.deb\n"s
+        );
+
+        auto decoded = aptian::parse_add_request(str);
+
+        tst::check_eq(decoded.targets.size(), size_t(2));
+        tst::check_eq(decoded.targets[1].dist, "noble"s);
+        tst::check_eq(decoded.targets[1].comp, "contrib"s);
+        tst::check(decoded.package_paths == request.package_paths, SL);
+    });
+
+    suite.add("parse_malformed_add_request_throws", [](){
+        for(auto str : {
+            ""sv,
+            "target bookworm main\n"sv,
+            "package /tmp/a.deb\n"sv,
+            "target bookworm main\npackage tmp/a.deb\n"sv,
+            "target bookworm\npackage /tmp/a.deb\n"sv,
+            "target bookworm main extra\npackage /tmp/a.deb\n"sv,
+            "target bookworm main\npackage /tmp/a.deb"sv,
+            "target bookworm main\npackage /tmp/a.deb\nunknown\n"sv,
+        }){
+            bool thrown = false;
+            try{
+                aptian::parse_add_request(str);
+            }catch(std::invalid_argument&){
+                thrown = true;
+            }
+            tst::check(thrown, SL) << "str = " << str;
+        }
+    });
+
+    suite.add("encode_multiline_path_throws", [](){
+        aptian::add_request request{
+            .targets = {{.dist = "bookworm"s, .comp = "main"s}},
+            .package_paths = {"/tmp/a\n.deb"s}
+        };
+
+        bool thrown = false;
+        try{
+            aptian::to_string(request);
+        }catch(std::invalid_argument&){
+            thrown = true;
+        }
+        tst::check(thrown, SL);
+    });
+});
+}
@@ -0,0 +1,101 @@
+#include <cstdlib>
+#include <filesystem>
+#include <optional>
+
+#include <tst/set.hpp>
+#include <tst/check.hpp>
+
+#include <utki/string.hpp>
+#include <utki/util.hpp>
+
+#include <aptian/signing.hpp>
+
+#include "util.hpp"
+
+using namespace std::string_literals;
+using namespace std::string_view_literals;
+
+namespace{
+const auto release = "Origin: aptian\nLabel: aptian\nSuite: test\nSHA256:\n 0123 10 main/binary-amd64/Packages\n"sv;
+}
+
+namespace{
+const tst::set set("signing", [](tst::suite& suite){ // NOLINT
+    suite.add("get_clearsigned_signature", [](){
+        auto clearsigned =
+            "-----BEGIN PGP SIGNED MESSAGE-----\n"
+            "Hash: SHA512\n"
+            "\n"
+            "Origin: aptian\n"
+            "\n"
+            "-----BEGIN PGP SIGNATURE-----\n"
+            "\n"
+            "abcd\n"
+            "-----END PGP SIGNATURE-----\n"sv;
+
+        tst::check_eq(
+            aptian::get_clearsigned_signature(clearsigned),
+            "-----BEGIN PGP SIGNATURE-----\n\nabcd\n-----END PGP SIGNATURE-----\n"sv
+        );
+    });
+
+    suite.add("release_with_trailing_whitespace_is_not_signed", [](){
+        bool thrown = false;
+        try{
+            aptian::sign_release("Origin: aptian \n"sv, "nobody"sv, make_test_dir("signing_whitespace"));
+        }catch(std::invalid_argument&){
+            thrown = true;
+        }
+        tst::check(thrown, SL);
+    });
+
+    // uses throwaway keyring, needs gpg to be installed
+    suite.add("signatures_are_valid", [](){
+        auto dir = make_test_dir("signing");
+        auto gnupg_home = dir + "gnupg";
+        std::filesystem::create_directories(gnupg_home);
+        std::filesystem::permissions(gnupg_home, std::filesystem::perms::owner_all);
+
+        // sign_release() uses the default keyring, so make the throwaway keyring the default one while the test runs
+        std::optional<std::string> old_gnupg_home;
+        // NOLINTNEXTLINE(concurrency-mt-unsafe)
+        if(const char* v = std::getenv("GNUPGHOME")){
+            old_gnupg_home = v;
+        }
+        // NOLINTNEXTLINE(concurrency-mt-unsafe)
+        setenv("GNUPGHOME", gnupg_home.c_str(), 1);
+        utki::scope_exit gnupg_home_scope_exit([&](){
+            if(old_gnupg_home.has_value()){
+                // NOLINTNEXTLINE(concurrency-mt-unsafe)
+                setenv("GNUPGHOME", old_gnupg_home.value().c_str(), 1);
+            }else{
+                // NOLINTNEXTLINE(concurrency-mt-unsafe)
+                unsetenv("GNUPGHOME");
+            }
+        });
+
+        // NOLINTNEXTLINE(concurrency-mt-unsafe)
+        auto res = std::system(
+            "gpg --batch --quiet --passphrase '' --quick-gen-key 'aptian test <test@aptian.test>' default default never"
+        );
+        tst::check_eq(res, 0);
+
+        auto signatures = aptian::sign_release(release, "test@aptian.test"sv, dir + "tmp/");
+
+        tst::check(signatures.clearsigned.find(release) != std::string::npos, SL);
+
+        write_file(dir + "Release", release);
+        write_file(dir + "Release.gpg", signatures.detached);
+        write_file(dir + "InRelease", signatures.clearsigned);
+
+        // NOLINTNEXTLINE(concurrency-mt-unsafe)
+        tst::check_eq(std::system(utki::cat("gpg --quiet --verify ", dir, "Release.gpg ", dir, "Release").c_str()), 0);
+
+        // NOLINTNEXTLINE(concurrency-mt-unsafe)
+        tst::check_eq(std::system(utki::cat("gpg --quiet --verify ", dir, "InRelease").c_str()), 0);
+
+        // NOLINTNEXTLINE(concurrency-mt-unsafe)
+        tst::check_eq(std::system("gpgconf --kill gpg-agent"), 0);
+    });
+});
+}
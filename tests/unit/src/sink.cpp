@@ -0,0 +1,171 @@
+#include <filesystem>
+
+#include <tst/set.hpp>
+#include <tst/check.hpp>
+
+#include <aptian/sink.hpp>
+
+#include "util.hpp"
+
+using namespace std::string_literals;
+using namespace std::string_view_literals;
+
+namespace{
+const tst::set set("sink", [](tst::suite& suite){ // NOLINT
+    suite.add("hashing_file_sink_writes_file_and_gives_its_hashes", [](){
+        auto dir = make_test_dir("hashing_file_sink_write");
+        auto path = dir + "file";
+
+        {
+            aptian::hashing_file_sink s(path);
+            s.write(utki::to_uint8_t(utki::make_span("a"sv)));
+            s.write(utki::to_uint8_t(utki::make_span("bc"sv)));
+            s.finish();
+
+            auto hashes = s.get_hashes();
+            tst::check_eq(hashes.md5, "900150983cd24fb0d6963f7d28e17f72"s);
+            tst::check_eq(hashes.sha1, "a9993e364706816aba3e25717850c26c9cd0d89d"s);
+            tst::check_eq(hashes.sha256, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"s);
+        }
+
+        tst::check_eq(read_file(path), "abc"s);
+    });
+
+    suite.add("hashing_file_sink_get_hashes_before_finish_throws", [](){
+        auto dir = make_test_dir("hashing_file_sink_unfinished");
+
+        aptian::hashing_file_sink s(dir + "unfinished");
+
+        bool thrown = false;
+        try{
+            s.get_hashes();
+        }catch(std::logic_error&){
+            thrown = true;
+        }
+        tst::check(thrown, SL);
+    });
+
+    suite.add("hashing_file_sink_append_gives_hashes_of_whole_file", [](){
+        auto dir = make_test_dir("hashing_file_sink_append");
+        auto path = dir + "appended";
+
+        std::string state;
+        {
+            aptian::hashing_file_sink s(path);
+            s.write(utki::to_uint8_t(utki::make_span("a"sv)));
+            s.finish();
+            state = s.get_hasher_state();
+        }
+
+        {
+            aptian::hashing_file_sink s(path, state);
+            s.write(utki::to_uint8_t(utki::make_span("bc"sv)));
+            s.finish();
+
+            tst::check_eq(s.get_hashes().sha256, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"s);
+        }
+
+        tst::check_eq(read_file(path), "abc"s);
+    });
+
+    suite.add("hashing_file_sink_unfinished_append_is_undone", [](){
+        auto dir = make_test_dir("hashing_file_sink_unfinished_append");
+        auto path = dir + "unfinished_append";
+
+        std::string state;
+        {
+            aptian::hashing_file_sink s(path);
+            s.write(utki::to_uint8_t(utki::make_span("abc"sv)));
+            s.finish();
+            state = s.get_hasher_state();
+        }
+
+        {
+            aptian::hashing_file_sink s(path, state);
+            std::vector<uint8_t> data(0x100000, 'd');
+            s.write(data);
+        }
+
+        tst::check_eq(read_file(path), "abc"s);
+    });
+
+    suite.add("hashing_file_sink_append_with_mismatching_state_throws", [](){
+        auto dir = make_test_dir("hashing_file_sink_mismatching_state");
+        auto path = dir + "mismatching_state";
+
+        std::string state;
+        {
+            aptian::hashing_file_sink s(path);
+            s.write(utki::to_uint8_t(utki::make_span("abc"sv)));
+            s.finish();
+            state = s.get_hasher_state();
+        }
+
+        {
+            aptian::hashing_file_sink s(path);
+            s.write(utki::to_uint8_t(utki::make_span("abcd"sv)));
+            s.finish();
+        }
+
+        bool thrown = false;
+        try{
+            aptian::hashing_file_sink s(path, state);
+        }catch(std::invalid_argument&){
+            thrown = true;
+        }
+        tst::check(thrown, SL);
+    });
+
+    suite.add("hashing_file_sink_append_not_in_place_keeps_hard_links", [](){
+        auto dir = make_test_dir("hashing_file_sink_append_not_in_place");
+        auto path = dir + "appended_copy";
+        auto link_path = dir + "appended_copy_link";
+
+        std::string state;
+        {
+            aptian::hashing_file_sink s(path);
+            s.write(utki::to_uint8_t(utki::make_span("a"sv)));
+            s.finish();
+            state = s.get_hasher_state();
+        }
+
+        std::filesystem::remove(link_path);
+        std::filesystem::create_hard_link(path, link_path);
+
+        {
+            aptian::hashing_file_sink s(path, state, false);
+            s.write(utki::to_uint8_t(utki::make_span("b"sv)));
+        }
+
+        // unfinished append does not change the file
+        tst::check_eq(std::filesystem::file_size(path), uintmax_t(1));
+        tst::check(!std::filesystem::exists(path + ".new"), SL);
+
+        {
+            aptian::hashing_file_sink s(path, state, false);
+            s.write(utki::to_uint8_t(utki::make_span("bc"sv)));
+            s.finish();
+
+            tst::check_eq(s.get_hashes().sha256, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"s);
+        }
+
+        tst::check_eq(read_file(path), "abc"s);
+
+        tst::check_eq(read_file(link_path), "a"s);
+    });
+
+    suite.add("tee_sink_passes_data_to_all_outputs", [](){
+        auto dir = make_test_dir("tee_sink");
+
+        aptian::hashing_file_sink s1(dir + "tee1");
+        aptian::hashing_file_sink s2(dir + "tee2");
+
+        aptian::tee_sink tee({s1, s2});
+        tee.write(utki::to_uint8_t(utki::make_span("abc"sv)));
+        tee.finish();
+
+        tst::check_eq(s1.get_hashes().md5, "900150983cd24fb0d6963f7d28e17f72"s);
+        tst::check_eq(s2.get_hashes().md5, "900150983cd24fb0d6963f7d28e17f72"s);
+    });
+});
+}
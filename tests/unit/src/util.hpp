@@ -0,0 +1,27 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+#include <fsif/native_file.hpp>
+
+// Create empty directory for files of a test.
+// Each test uses its own directory, so that the tests can run in parallel.
+inline std::string make_test_dir(std::string_view name){
+    auto dir = (std::filesystem::temp_directory_path() / "aptian_tests" / name).string() + "/";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    return dir;
+}
+
+inline void write_file(const std::string& path, std::string_view contents){
+    fsif::native_file fi(path);
+    fsif::file::guard file_guard(fi, fsif::mode::create);
+    fi.write(contents);
+}
+
+inline std::string read_file(const std::string& path){
+    auto contents = fsif::native_file(path).load();
+    return std::string(contents.begin(), contents.end());
+}